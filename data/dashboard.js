@@ -2,6 +2,107 @@
 let ws = null;
 const terminal = document.getElementById('terminal');
 
+// Rate charts: one series of {t, rate} per counter, t in browser seconds
+const HISTORY_RECORD_WORDS = 5;   // uptimeSeconds + 4 counts, uint32 each
+const CHART_SAMPLE_SECONDS = 10;  // Matches HISTORY_SAMPLE_INTERVAL on the device
+const CHART_MAX_POINTS = 720;
+const rateSeries = [[], [], [], []];
+const lastSample = [null, null, null, null]; // {t, count} the next rate is computed from
+let chartsScheduled = false;
+
+// Record a count sample and derive units/min against the previous one
+function addCountSample(index, t, count) {
+  const previous = lastSample[index];
+  if (previous && t - previous.t < CHART_SAMPLE_SECONDS) {
+    return;
+  }
+  if (previous && t > previous.t) {
+    // A counter reset shows up as a negative delta; treat it as zero output
+    const delta = Math.max(0, count - previous.count);
+    const series = rateSeries[index];
+    series.push({ t: t, rate: delta * 60 / (t - previous.t) });
+    if (series.length > CHART_MAX_POINTS) {
+      series.shift();
+    }
+  }
+  lastSample[index] = { t: t, count: count };
+}
+
+// Load the initial window from the device's fixed-width binary history
+async function loadHistory() {
+  try {
+    const response = await fetch('/api/history');
+    if (!response.ok) {
+      return;
+    }
+    const deviceUptime = parseInt(response.headers.get('X-Device-Uptime') || '0');
+    const records = new Uint32Array(await response.arrayBuffer());
+    const now = Date.now() / 1000;
+    for (let offset = 0; offset + HISTORY_RECORD_WORDS <= records.length; offset += HISTORY_RECORD_WORDS) {
+      const t = now - (deviceUptime - records[offset]);
+      for (let i = 0; i < 4; i++) {
+        addCountSample(i, t, records[offset + 1 + i]);
+      }
+    }
+    scheduleCharts();
+  } catch (e) {
+    console.error('Error loading counter history');
+  }
+}
+
+function scheduleCharts() {
+  if (!chartsScheduled) {
+    chartsScheduled = true;
+    requestAnimationFrame(drawCharts);
+  }
+}
+
+function drawCharts() {
+  chartsScheduled = false;
+  for (let i = 0; i < 4; i++) {
+    drawChart(document.getElementById(`rate-chart-${i + 1}`), rateSeries[i]);
+    const series = rateSeries[i];
+    document.getElementById(`rate-value-${i + 1}`).textContent =
+      series.length ? `${series[series.length - 1].rate.toFixed(1)} /min` : '';
+  }
+}
+
+// Plain line chart scaled to the series maximum
+function drawChart(canvas, series) {
+  const width = canvas.clientWidth;
+  const height = canvas.clientHeight;
+  if (canvas.width !== width) {
+    canvas.width = width;
+  }
+  const ctx = canvas.getContext('2d');
+  ctx.clearRect(0, 0, width, height);
+  if (series.length < 2) {
+    return;
+  }
+  const t0 = series[0].t;
+  const span = Math.max(1, series[series.length - 1].t - t0);
+  let max = 1;
+  series.forEach(point => { max = Math.max(max, point.rate); });
+
+  ctx.strokeStyle = '#2563eb';
+  ctx.lineWidth = 1.5;
+  ctx.beginPath();
+  series.forEach((point, n) => {
+    const x = (point.t - t0) / span * (width - 1);
+    const y = height - 4 - point.rate / max * (height - 16);
+    if (n === 0) {
+      ctx.moveTo(x, y);
+    } else {
+      ctx.lineTo(x, y);
+    }
+  });
+  ctx.stroke();
+
+  ctx.fillStyle = '#6b7280';
+  ctx.font = '10px sans-serif';
+  ctx.fillText(`max ${max.toFixed(1)}`, 4, 10);
+}
+
 // WebSocket initialization
 function initWebSocket() {
   // ws = new WebSocket(`ws://192.168.0.104/ws`);
@@ -9,7 +110,6 @@ function initWebSocket() {
 
   ws.onopen = () => {
     document.getElementById('connection-status').textContent = 'WebSocket: Connected';
-    ws.send(JSON.stringify({ action: 'get_counter_config' }));
   };
 
   ws.onmessage = (event) => {
@@ -39,7 +139,9 @@ function updateStatus(data) {
       document.getElementById(`counter-pin-${i}`).value = data.counters[i-1].pin;
       document.getElementById(`delay-filter-${i}`).value = data.counters[i-1].delayFilter;
       document.getElementById(`counter-value-${i}`).textContent = data.counters[i-1].count;
+      addCountSample(i - 1, Date.now() / 1000, data.counters[i-1].count);
     }
+    scheduleCharts();
   } else if (data.action === 'login_result') {
     if (data.success) {
       window.location.href = '/index.html';
@@ -111,5 +213,5 @@ function login() {
 
 // Initialize when page loads
 document.addEventListener('DOMContentLoaded', function() {
-  initWebSocket();
+  loadHistory().then(initWebSocket);
 });
\ No newline at end of file
@@ -1,6 +1,14 @@
 // Global variables
 let ws = null;
 const terminal = document.getElementById('terminal');
+const TERMINAL_MAX_LINES = 200;
+
+// Render state: pending work is applied once per animation frame
+let pendingLines = [];
+let pendingStatus = null;
+let renderScheduled = false;
+const inputNodes = new Map();  // pin -> status element
+const outputNodes = new Map(); // pin -> button element
 
 // Page navigation
 function showPage(pageId) {
@@ -11,22 +19,95 @@ function showPage(pageId) {
   if (pageId === 'lora') {
     updateConfigVisibility();
   }
+
+  // Air-time ledger: own share against the duty budget, plus total channel occupancy
+  if (data.loraAir && data.loraE32) {
+    const channel = (data.loraAir.channels || []).find(c => c.chan === data.loraE32.chan);
+    setText('lora-air-time', channel
+      ? `own ${channel.ownPercent.toFixed(2)}% of ${data.loraAir.budgetPercent}% budget, channel ${channel.occupancyPercent.toFixed(2)}% busy`
+      : 'No traffic');
+  }
+}
+
+// Coalesce DOM work into the next animation frame
+function scheduleRender() {
+  if (!renderScheduled) {
+    renderScheduled = true;
+    requestAnimationFrame(render);
+  }
+}
+
+function render() {
+  renderScheduled = false;
+  if (pendingStatus) {
+    renderSystemStatus(pendingStatus);
+    pendingStatus = null;
+  }
+  if (pendingLines.length > 0) {
+    flushTerminal();
+  }
 }
 
 // Terminal functions
 function appendTerminal(message) {
-  const formattedMessage = message.replace(/\n/g, '<br>');
-  terminal.innerHTML += formattedMessage + '<br>';
-  terminal.scrollTop = terminal.scrollHeight;
-  if (terminal.childElementCount > 100) {
+  message.split('\n').forEach(line => pendingLines.push(line));
+  // Lines that would be trimmed straight away are never turned into nodes
+  if (pendingLines.length > TERMINAL_MAX_LINES) {
+    pendingLines = pendingLines.slice(-TERMINAL_MAX_LINES);
+  }
+  scheduleRender();
+}
+
+// Append queued lines and drop the oldest nodes so the terminal stays a fixed-size ring
+function flushTerminal() {
+  const stickToBottom = terminal.scrollTop + terminal.clientHeight >= terminal.scrollHeight - 4;
+  const fragment = document.createDocumentFragment();
+  pendingLines.forEach(line => {
+    const node = document.createElement('div');
+    node.textContent = line;
+    fragment.appendChild(node);
+  });
+  pendingLines = [];
+  terminal.appendChild(fragment);
+  while (terminal.childElementCount > TERMINAL_MAX_LINES) {
     terminal.removeChild(terminal.firstChild);
   }
+  if (stickToBottom) {
+    terminal.scrollTop = terminal.scrollHeight;
+  }
+}
+
+// Update text only when it differs, avoiding needless layout work
+function setText(id, value) {
+  const element = document.getElementById(id);
+  const text = String(value);
+  if (element && element.textContent !== text) {
+    element.textContent = text;
+  }
+}
+
+function setValue(id, value) {
+  const element = document.getElementById(id);
+  const text = String(value);
+  if (element && element.value !== text && document.activeElement !== element) {
+    element.value = text;
+  }
+}
+
+// Remove keyed nodes whose pin is no longer reported
+function pruneNodes(nodes, pins) {
+  nodes.forEach((node, pin) => {
+    if (!pins.has(pin)) {
+      node.remove();
+      nodes.delete(pin);
+    }
+  });
 }
 
 // Configuration visibility
 function updateConfigVisibility() {
   const operatingMode = document.getElementById('lora-operating-mode').value;
-  const configSections = ['address-config', 'rf-config', 'uart-config', 'options-config', 'set-config-btn'];
+  const configSections = ['address-config', 'rf-config', 'uart-config', 'options-config', 'set-config-btn', 'trial-config-btn'];
   if (operatingMode === '3') { // Sleep Mode
     configSections.forEach(section => {
       document.getElementById(section).classList.add('active');
@@ -73,7 +154,8 @@ function getLoRaE32Config() {
   }
 }
 
-function setLoRaE32Config() {
+// trial=true applies the settings without saving them in the module
+function setLoRaE32Config(trial = false) {
   if (ws && ws.readyState === WebSocket.OPEN) {
     const config = {
       action: 'set_lora_e32_config',
@@ -87,10 +169,12 @@ function setLoRaE32Config() {
       ioDriveMode: parseInt(document.getElementById('lora-io-drive-mode').value),
       wirelessWakeupTime: parseInt(document.getElementById('lora-wireless-wakeup-time').value),
       fec: parseInt(document.getElementById('lora-fec').value),
-      transmissionPower: parseInt(document.getElementById('lora-transmission-power').value)
+      transmissionPower: parseInt(document.getElementById('lora-transmission-power').value),
+      role: parseInt(document.getElementById('lora-role').value),
+      trial: trial
     };
     ws.send(JSON.stringify(config));
-    appendTerminal('Setting LoRa E32 configuration (switching to Sleep Mode temporarily)...');
+    appendTerminal(trial ? 'Trialling LoRa E32 configuration (not saved)...' : 'Setting LoRa E32 configuration (switching to Sleep Mode temporarily)...');
   }
 }
 
@@ -108,66 +192,136 @@ function setLoRaOperatingMode() {
 
 // Status update function
 function updateStatus(data) {
-  console.log('WebSocket data received:', data);
-
   if (data.action === 'system_status') {
-    // Update system status
-    document.getElementById('reset-count').textContent = data.reset_count;
-    document.getElementById('free-heap').textContent = data.free_heap;
-    document.getElementById('free-psram').textContent = data.free_psram;
-    document.getElementById('temperature').textContent = data.temperature.toFixed(2);
-    document.getElementById('ip-address').textContent = data.ip_address;
-    document.getElementById('uptime').textContent = data.uptime;
-
-    // Update Input Status
-    const inputStatus = document.getElementById('input-status');
-    inputStatus.innerHTML = '';
-    data.inputs.forEach(input => {
-      inputStatus.innerHTML += `
-        <div class="input-status">
-          Pin ${input.pin}: ${input.state}
-        </div>`;
-      if (document.getElementById(`input-${input.pin}`)?.dataset.state !== input.state) {
-        appendTerminal(`Pin ${input.pin} changed to ${input.state}`);
+    // Only the latest snapshot matters; older ones are dropped before rendering
+    pendingStatus = data;
+    scheduleRender();
+  } else if (data.action === 'node_table') {
+    renderNodeTable(data);
+  } else if (data.action === 'debug') {
+    appendTerminal(data.message);
+  }
+}
+
+// Remote I/O state from a counter report: inputs in bits 0-7, outputs in bits 8-15
+function formatIoState(io) {
+  if (io === undefined) {
+    return '-';
+  }
+  const bits = (value, count) => Array.from({ length: count }, (_, i) => (value >> i) & 1).join('');
+  return `in ${bits(io & 0xFF, 7)} out ${bits(io >> 8, 5)}`;
+}
+
+// Gateway node table; rows are keyed by address
+const nodeRows = new Map();
+function renderNodeTable(data) {
+  document.getElementById('node-table-section').classList.toggle('hidden', data.role !== 'gateway');
+  const body = document.getElementById('node-table');
+  const addresses = new Set();
+  data.nodes.forEach(node => {
+    const address = ((node.addh << 8) | node.addl).toString(16).padStart(4, '0').toUpperCase();
+    addresses.add(address);
+    let row = nodeRows.get(address);
+    if (!row) {
+      row = document.createElement('tr');
+      for (let i = 0; i < 7; i++) {
+        row.appendChild(document.createElement('td'));
       }
-      if (document.getElementById(`input-${input.pin}`)) {
-        document.getElementById(`input-${input.pin}`).dataset.state = input.state;
+      body.appendChild(row);
+      nodeRows.set(address, row);
+    }
+    const cells = [address, (node.lastSeenMs / 1000).toFixed(0), node.sequence, node.counts.join(' / '),
+                   node.rates.map(rate => rate.toFixed(1)).join(' / '), formatIoState(node.io), node.duplicates];
+    cells.forEach((value, i) => {
+      if (row.cells[i].textContent !== String(value)) {
+        row.cells[i].textContent = value;
       }
     });
+  });
+  pruneNodes(nodeRows, addresses);
+}
 
-    // Update Output Controls
-    const outputControls = document.getElementById('output-controls');
-    outputControls.innerHTML = '';
-    data.outputs.forEach(output => {
-      outputControls.innerHTML += `
-        <button id="output-btn-${output.pin}" 
-                class="output-btn px-4 py-2 rounded text-white ${output.state === 'HIGH' ? 'on' : 'off'}"
-                onclick="toggleOutput(${output.pin})">
-          ${output.state === 'HIGH' ? 'ON' : 'OFF'}
-        </button>`;
-    });
+// Keyed update of input rows
+function renderInputs(inputs) {
+  const inputStatus = document.getElementById('input-status');
+  const pins = new Set();
+  inputs.forEach(input => {
+    pins.add(input.pin);
+    let node = inputNodes.get(input.pin);
+    if (!node) {
+      node = document.createElement('div');
+      node.className = 'input-status';
+      node.dataset.state = input.state;
+      node.textContent = `Pin ${input.pin}: ${input.state}`;
+      inputStatus.appendChild(node);
+      inputNodes.set(input.pin, node);
+    } else if (node.dataset.state !== input.state) {
+      node.dataset.state = input.state;
+      node.textContent = `Pin ${input.pin}: ${input.state}`;
+      appendTerminal(`Pin ${input.pin} changed to ${input.state}`);
+    }
+  });
+  pruneNodes(inputNodes, pins);
+}
 
-    // Update LoRa E32 Information
-    if (data.loraE32) {
-      document.getElementById('lora-initialized').textContent = data.loraE32.initialized ? 'YES' : 'NO';
-      document.getElementById('lora-module-info').textContent = data.loraE32.moduleInfo || 'Not available';
-      document.getElementById('lora-addh').value = data.loraE32.addh || 0;
-      document.getElementById('lora-addl').value = data.loraE32.addl || 0;
-      document.getElementById('lora-chan').value = data.loraE32.chan || 0;
-      document.getElementById('lora-frequency').textContent = data.loraE32.frequency || 'Not available';
-      document.getElementById('lora-air-data-rate').value = data.loraE32.airDataRate ? parseInt(data.loraE32.airDataRate.replace('kbps', '')) : 2;
-      document.getElementById('lora-uart-baud-rate').value = data.loraE32.uartBaudRate ? parseInt(data.loraE32.uartBaudRate) : 3;
-      document.getElementById('lora-transmission-power').value = data.loraE32.transmissionPower ? parseInt(data.loraE32.transmissionPower.replace('dBm', '')) : 3;
-      document.getElementById('lora-parity-bit').value = data.loraE32.parityBit ? (data.loraE32.parityBit === '8N1' ? 0 : data.loraE32.parityBit === '8O1' ? 1 : 2) : 0;
-      document.getElementById('lora-wireless-wakeup-time').value = data.loraE32.wirelessWakeupTime ? parseInt(data.loraE32.wirelessWakeupTime.replace('ms', '')) / 250 : 0;
-      document.getElementById('lora-fec').value = data.loraE32.fec === 'On' ? 1 : 0;
-      document.getElementById('lora-fixed-transmission').value = data.loraE32.fixedTransmission === 'Transparent' ? 0 : 1;
-      document.getElementById('lora-io-drive-mode').value = data.loraE32.ioDriveMode === 'Push-pull' ? 1 : 0;
-      document.getElementById('lora-operating-mode').value = data.loraE32.operatingMode || 0;
-      updateConfigVisibility();
+// Keyed update of output buttons
+function renderOutputs(outputs) {
+  const outputControls = document.getElementById('output-controls');
+  const pins = new Set();
+  outputs.forEach(output => {
+    pins.add(output.pin);
+    let button = outputNodes.get(output.pin);
+    if (!button) {
+      button = document.createElement('button');
+      button.id = `output-btn-${output.pin}`;
+      button.className = 'output-btn px-4 py-2 rounded text-white';
+      button.addEventListener('click', () => toggleOutput(output.pin));
+      outputControls.appendChild(button);
+      outputNodes.set(output.pin, button);
     }
-  } else if (data.action === 'debug') {
-    appendTerminal(data.message);
+    const on = output.state === 'HIGH';
+    if (button.dataset.state !== output.state) {
+      button.dataset.state = output.state;
+      button.classList.toggle('on', on);
+      button.classList.toggle('off', !on);
+      button.textContent = on ? 'ON' : 'OFF';
+    }
+  });
+  pruneNodes(outputNodes, pins);
+}
+
+function renderSystemStatus(data) {
+  setText('reset-count', data.reset_count);
+  setText('free-heap', data.free_heap);
+  setText('free-psram', data.free_psram);
+  setText('temperature', data.temperature.toFixed(2));
+  setText('ip-address', data.ip_address);
+  setText('uptime', data.uptime);
+
+  renderInputs(data.inputs);
+  renderOutputs(data.outputs);
+
+  // Update LoRa E32 Information
+  if (data.loraE32) {
+    const lora = data.loraE32;
+    setText('lora-initialized', lora.initialized ? 'YES' : 'NO');
+    setText('lora-module-info', lora.moduleInfo || 'Not available');
+    setValue('lora-addh', lora.addh || 0);
+    setValue('lora-addl', lora.addl || 0);
+    setValue('lora-chan', lora.chan || 0);
+    setText('lora-frequency', lora.frequency || 'Not available');
+    setValue('lora-air-data-rate', lora.airDataRate ? parseInt(lora.airDataRate.replace('kbps', '')) : 2);
+    setValue('lora-uart-baud-rate', lora.uartBaudRate ? parseInt(lora.uartBaudRate) : 3);
+    setValue('lora-transmission-power', lora.transmissionPower ? parseInt(lora.transmissionPower.replace('dBm', '')) : 3);
+    setValue('lora-parity-bit', lora.parityBit ? (lora.parityBit === '8N1' ? 0 : lora.parityBit === '8O1' ? 1 : 2) : 0);
+    setValue('lora-wireless-wakeup-time', lora.wirelessWakeupTime ? parseInt(lora.wirelessWakeupTime.replace('ms', '')) / 250 : 0);
+    setValue('lora-fec', lora.fec === 'On' ? 1 : 0);
+    setValue('lora-fixed-transmission', lora.fixedTransmission === 'Transparent' ? 0 : 1);
+    setValue('lora-io-drive-mode', lora.ioDriveMode === 'Push-pull' ? 1 : 0);
+    setValue('lora-operating-mode', lora.operatingMode || 0);
+    setValue('lora-role', lora.role || 0);
+    document.getElementById('node-table-section').classList.toggle('hidden', lora.role !== 1);
+    updateConfigVisibility();
   }
 }
 
@@ -181,7 +335,6 @@ function initWebSocket() {
   ws.onopen = () => {
     document.getElementById('connection-status').textContent = 'WebSocket: Connected';
     appendTerminal('WebSocket connected');
-    ws.send(JSON.stringify({ action: 'get_lora_e32_config' }));
   };
 
   ws.onmessage = (event) => {
@@ -2,6 +2,7 @@
 #define CONFIG_H
 
 #include <Arduino.h>
+#include "lora_registers.h"
 
 // WiFi Configuration
 // const char* WIFI_SSID = "I-Soft";
@@ -33,6 +34,212 @@ const int NUM_OUTPUTS = 5;
 #define E32_RX_PIN    18
 #define E32_AUX_PIN   -1
 
+// E32 settle timing. With AUX wired we wait for it to go HIGH (up to E32_AUX_TIMEOUT_MS)
+// plus the 2ms guard from the datasheet; without AUX we fall back to these worst-case
+// busy times. Leaving program mode makes the module re-run its self-check.
+const unsigned long E32_AUX_TIMEOUT_MS = 1000;
+const unsigned long E32_AUX_GUARD_MS = 2;
+const unsigned long E32_MODE_SETTLE_MS[4] = {
+  10,  // to Normal
+  10,  // to Wake-Up
+  10,  // to Power-Saving
+  20   // to Program (module must finish any pending transmission)
+};
+const unsigned long E32_PROGRAM_EXIT_SETTLE_MS = 60;
+const unsigned long E32_CONFIG_WRITE_SETTLE_MS = 60;  // EEPROM write after a C0 command
+
+// Program mode (MODE_3) always talks 8N1 at 9600 baud, whatever SPED says; the
+// other modes run the UART at the configured SPED rate and parity
+const uint32_t E32_PROGRAM_BAUD = 9600;
+
+// Without AUX: time the module needs after power-up before it answers commands
+const unsigned long E32_POWER_ON_SETTLE_MS = 1000;
+
+// Boot stages run concurrently; each waits for the readiness bits it depends on
+const uint32_t BOOT_FS_READY = 0x01;        // Stored configuration loaded (defaults if LittleFS failed to mount)
+const uint32_t BOOT_NET_STARTED = 0x02;     // WiFi stack up and connecting
+const uint32_t BOOT_RADIO_PROBED = 0x04;    // E32 answered, its registers are read
+const uint32_t BOOT_RADIO_READY = 0x08;     // Stored radio config applied, LoRa tasks running
+const uint32_t BOOT_WEB_READY = 0x10;       // HTTP/WebSocket server listening
+const uint32_t BOOT_COUNTERS_READY = 0x20;  // Counter sampling running
+const uint32_t BOOT_WIFI_CONNECTED = 0x40;  // Got an IP address (not a dependency of any stage)
+
+// Per-stage boot timeline, µs since reset, served by /api/boot
+struct BootStageRecord {
+  int64_t queuedUs;   // Stage task created
+  int64_t startUs;    // Dependencies satisfied
+  int64_t endUs;      // Stage finished
+  bool failed;        // Stage fell back (e.g. LittleFS did not mount); dependents still run
+};
+
+// Steps inside the "fs" boot stage (mount, config decode, apply ...), served by /api/boot
+struct BootStepRecord {
+  const char *name;
+  uint32_t us;
+};
+const size_t BOOT_STEP_MAX = 16;
+
+// Task placement. Each layout says where every long-running task runs; the
+// "isolated" layout keeps core 1 for the counting engine and puts network,
+// filesystem and JSON work on core 0 next to the WiFi/LwIP stack, "shared" is
+// the original placement (counter publishing then shares core 1 and priority
+// with counting). Boot stages (bootStages in main.cpp) have entries of their
+// own, on the core of the task they lead to.
+enum TaskId : uint8_t {
+  TASK_COUNTER,          // Samples the counter inputs every COUNTER_UPDATE_INTERVAL
+  TASK_COUNTER_PUBLISH,  // Serializes counter status and sends it to WebSocket clients
+  TASK_SYSTEM_MONITOR,
+  TASK_WEBSOCKET,
+  TASK_WIFI_MONITOR,
+  TASK_LORA_RX,
+  TASK_LORA_UPLINK,
+  TASK_LORA_CONFIG,
+  TASK_LORA_MODE,        // One-shot operating mode change requested over the WebSocket
+  TASK_POWER_FAIL,
+  TASK_BENCH,            // Task layout benchmark coordinator
+  TASK_BENCH_LOAD,       // Synthetic serialization/filesystem load
+  TASK_BOOT_FS,          // Boot stages, see bootStages in main.cpp
+  TASK_BOOT_WIFI,
+  TASK_BOOT_RADIO,
+  TASK_BOOT_RADIO_CONFIG,
+  TASK_BOOT_WEB,
+  TASK_BOOT_COUNTERS,
+  TASK_RESTART,          // Flushes state and restarts into another layout
+  TASK_COUNT
+};
+
+struct TaskPlacement {
+  const char *name;  // Shorter than configMAX_TASK_NAME_LEN so /api/tasks can look it up
+  uint32_t stackSize;
+  UBaseType_t priority;
+  BaseType_t core;
+};
+
+const size_t TASK_LAYOUT_COUNT = 2;
+const char *const TASK_LAYOUT_NAMES[TASK_LAYOUT_COUNT] = {"isolated", "shared"};
+const TaskPlacement TASK_LAYOUTS[TASK_LAYOUT_COUNT][TASK_COUNT] = {
+  {
+    {"CounterMonitor", 3072, 5, 1},
+    {"CounterPublish", 4096, 2, 0},
+    {"SystemMonitor", 4096, 2, 0},
+    {"WebSocketTask", 4096, 1, 0},
+    {"WiFiMonitor", 2048, 1, 0},
+    {"LoRaRx", 4096, 3, 0},
+    {"LoRaUplink", 3072, 1, 0},
+    {"LoRaConfig", 4096, 2, 0},
+    {"LoRaMode", 4096, 2, 0},
+    {"PowerFail", 3072, configMAX_PRIORITIES - 1, 0},
+    {"TaskBench", 3072, 1, 0},
+    {"TaskBenchLoad", 4096, 2, 0},
+    {"BootFs", 4096, 2, 0},
+    {"BootWifi", 3072, 2, 0},
+    {"BootRadio", 4096, 2, 0},
+    {"BootRadioConfig", 4096, 2, 0},
+    {"BootWeb", 4096, 2, 0},
+    {"BootCounters", 2048, 2, 1},
+    {"Restart", 4096, 2, 0},
+  },
+  {
+    {"CounterMonitor", 3072, 3, 1},
+    {"CounterPublish", 4096, 3, 1},
+    {"SystemMonitor", 4096, 2, 1},
+    {"WebSocketTask", 4096, 1, 0},
+    {"WiFiMonitor", 2048, 1, 1},
+    {"LoRaRx", 4096, 3, 1},
+    {"LoRaUplink", 3072, 1, 1},
+    {"LoRaConfig", 4096, 2, 1},
+    {"LoRaMode", 4096, 2, 1},
+    {"PowerFail", 3072, configMAX_PRIORITIES - 1, 1},
+    {"TaskBench", 3072, 1, 0},
+    {"TaskBenchLoad", 4096, 2, 1},
+    {"BootFs", 4096, 2, 1},
+    {"BootWifi", 3072, 2, 0},
+    {"BootRadio", 4096, 2, 1},
+    {"BootRadioConfig", 4096, 2, 1},
+    {"BootWeb", 4096, 2, 0},
+    {"BootCounters", 2048, 2, 1},
+    {"Restart", 4096, 2, 1},
+  },
+};
+const uint8_t DEFAULT_TASK_LAYOUT = 0;
+
+// Task layout benchmark: synthetic load where SystemMonitor runs, a fake count
+// every TASK_BENCH_PULSE_MS; reports counter loop jitter and the delay from a
+// count to its WebSocket message
+const unsigned long TASK_BENCH_DURATION_MS = 30000;
+const unsigned long TASK_BENCH_PULSE_MS = 50;
+const unsigned long TASK_BENCH_FS_WRITE_MS = 100;  // Flash writes by the load task (keep wear low)
+const unsigned long TASK_BENCH_SETTLE_MS = 10000;  // Wait after a sweep reboot before measuring
+
+// Debounced config persistence: a dirty section is written once it has been
+// quiet for CONFIG_SAVE_DEBOUNCE ms
+const unsigned long CONFIG_SAVE_DEBOUNCE = 5000;
+const uint8_t CONFIG_DIRTY_IO = 0x01;
+const uint8_t CONFIG_DIRTY_LORA = 0x02;
+const uint8_t CONFIG_DIRTY_COUNTER = 0x04;
+const uint8_t CONFIG_DIRTY_ADMIN = 0x08;
+const uint8_t CONFIG_DIRTY_COUNTS = 0x10;  // Only counter values changed, see COUNTER_CHECKPOINT_INTERVAL
+
+// Binary config store (config_store.h): every section in one CRC-checked image,
+// written to a temporary file and renamed over the previous one
+#define CONFIG_STORE_PATH "/config.bin"
+#define CONFIG_STORE_TEMP_PATH "/config.tmp"
+const size_t CONFIG_STORE_MAX_SIZE = 512;
+const uint8_t CONFIG_SECTION_IO = 1;
+const uint8_t CONFIG_SECTION_LORA = 2;
+const uint8_t CONFIG_SECTION_COUNTER = 3;
+const uint8_t CONFIG_SECTION_ADMIN = 4;
+const size_t ADMIN_CREDENTIAL_MAX = 64;  // Longest username/password kept in the store
+
+// Filesystem I/O accounting (fs_stats.h)
+const size_t FS_STATS_FILES = 8;                 // Files tracked individually, the last slot takes the rest
+const uint32_t FS_BLOCK_SIZE = 4096;             // LittleFS block = flash erase sector
+const uint32_t FS_COMMIT_OVERHEAD_BYTES = 64;    // Metadata programmed per write or rename (estimate)
+const uint32_t FLASH_ERASE_ENDURANCE = 100000;   // Erase cycles per sector (datasheet minimum)
+
+// Production event log (event_log.h): records go to EVENT_LOG_DIR/<n>.bin
+// segments of EVENT_LOG_SEGMENT_SIZE bytes, the oldest segment is deleted once
+// there are EVENT_LOG_SEGMENTS. Events are buffered in RAM and appended every
+// EVENT_LOG_FLUSH_INTERVAL, which is also the resolution of the count records.
+#define EVENT_LOG_DIR "/log"
+const size_t EVENT_LOG_SEGMENT_SIZE = 4096;          // 256 records
+const size_t EVENT_LOG_SEGMENTS = 8;
+const size_t EVENT_LOG_INDEX_STRIDE = 32;            // Records per sparse index entry
+const size_t EVENT_LOG_BUFFER = 32;                  // Records held in RAM between flushes
+const unsigned long EVENT_LOG_FLUSH_INTERVAL = 60000;
+const size_t EVENT_LOG_QUERY_MAX = 512;              // Records per /api/events response
+const unsigned long EVENT_LOG_EXPORT_WAIT = 20;      // ms /api/export waits for eventLogMutex before retrying later
+
+// LoRa telemetry uplink configuration
+const bool LORA_UPLINK_ENABLED = true;
+const unsigned long LORA_REPORT_INTERVAL = 30000; // Batch counter deltas for 30s
+const float LORA_DUTY_CYCLE_PERCENT = 1.0;        // Max share of the duty window spent transmitting
+const unsigned long LORA_DUTY_WINDOW = 3600000;   // Duty-cycle accounting window (1 hour)
+const size_t LORA_DUTY_BUCKETS = 12;              // Window resolution (5 min slots)
+const size_t LORA_DUTY_CHANNELS = 4;              // Channels tracked by the air-time ledger
+const uint8_t LORA_GATEWAY_ADDH = 0x00;           // Destination for fixed transmission
+const uint8_t LORA_GATEWAY_ADDL = 0x00;
+
+// Reliable delivery: reports are sequenced per destination and retransmitted
+// with exponential backoff until the gateway acknowledges them
+const bool LORA_RELIABLE_DELIVERY = true;
+const size_t LORA_RELIABLE_WINDOW = 4;            // Reports in flight at once
+const unsigned long LORA_RETRY_MIN = 1000;        // Initial retransmission timeout
+const unsigned long LORA_RETRY_MAX = 60000;       // Backoff cap
+const uint8_t LORA_RETRY_ATTEMPTS = 6;
+const unsigned long LORA_UPLINK_POLL = 100;       // Uplink task tick for retransmissions
+const size_t LORA_PENDING_ACKS = 8;               // Senders a gateway can owe an ACK at once
+
+// LoRa roles: a node reports its counters, a gateway collects reports from nodes
+const uint8_t LORA_ROLE_NODE = 0;
+const uint8_t LORA_ROLE_GATEWAY = 1;
+const size_t LORA_NODE_TABLE_SIZE = 32;  // Remote nodes a gateway can track (power of two)
+
+// LoRa receive configuration
+const uint8_t LORA_RX_TIMEOUT_SYMBOLS = 3;  // UART idle time (in symbols) that ends a burst
+const size_t LORA_RX_RING_SIZE = 256;
+const size_t LORA_PEER_TABLE_SIZE = 16;  // Radio peers whose last contact is tracked (power of two)
+
 // System Monitor Configuration
 const unsigned long MONITOR_INTERVAL = 2000;
 const unsigned long WEBSOCKET_UPDATE_INTERVAL = 5000;
@@ -40,6 +247,38 @@ const unsigned long WEBSOCKET_UPDATE_INTERVAL = 5000;
 // Counter configuration
 const unsigned long COUNTER_UPDATE_INTERVAL = 10; // 10ms
 const unsigned long DEFAULT_COUNTER_DELAY_FILTER = 20; // 20ms debounce
+const int DEFAULT_COUNTER_PINS[4] = {37, 38, 39, 40};
+const uint32_t COUNTER_RTC_MAGIC = 0x43525443;            // "CTRC"
+
+// Power-fail flush: an optional supply-sense input (e.g. a comparator on the
+// 24V rail) that goes active while the hold-up capacitance still powers the
+// board. The counts are then written as one fixed-size record to a file kept
+// open for this. Hold-up needed: C >= I_board * worst flush time / allowed droop.
+const int POWER_FAIL_PIN = -1;              // -1 disables the supply-sense input
+const int POWER_FAIL_ACTIVE_LEVEL = LOW;
+const uint32_t POWER_FAIL_BUDGET_US = 5000; // Slower flushes are counted as overruns
+// Hold-up sizing for the power_fail_holdup_uf metric, from the worst flush seen.
+// Board-specific, must be measured on the actual board: supply current while
+// flushing, and the droop allowed between the sense threshold and the regulator
+// dropping out. The metric is left out while either is 0.
+const uint32_t POWER_FAIL_BOARD_MA = 0;
+const uint32_t POWER_FAIL_DROOP_MV = 0;
+#define POWER_FAIL_RECORD_PATH "/powerfail.bin"
+const uint32_t POWER_FAIL_MAGIC = 0x4C494650; // "PFIL"
+
+// Counts are mirrored into RTC memory on every change, which survives a reset
+// but not a power loss; flash only gets a checkpoint once they have been
+// changing for COUNTER_CHECKPOINT_INTERVAL. Without a supply-sense input a power
+// drop loses up to one interval of counts, so the interval is kept short at the
+// cost of flash wear: while counting, 30s is ~2880 commits a day against ~144
+// at 10 min. With POWER_FAIL_PIN the power-fail record covers the gap.
+const unsigned long COUNTER_CHECKPOINT_SHORT = 30000;    // 30s, no supply sense
+const unsigned long COUNTER_CHECKPOINT_LONG = 600000;    // 10 min, power-fail flush armed
+const unsigned long COUNTER_CHECKPOINT_INTERVAL = POWER_FAIL_PIN >= 0 ? COUNTER_CHECKPOINT_LONG : COUNTER_CHECKPOINT_SHORT;
+
+// Counter history configuration (served as binary by /api/history)
+const unsigned long HISTORY_SAMPLE_INTERVAL = 10000; // 10s per record
+const int HISTORY_CAPACITY = 720;                     // 2 hours of samples
 
 // Temperature sensor configuration
 const float TEMP_OFFSET = -5.0;
@@ -54,6 +293,57 @@ const int SERIAL_BAUD_RATE = 115200;
 // Reset counter storage in RTC memory
 RTC_DATA_ATTR int reset_counter = 0;
 
+// Live counter values in RTC memory. RTC_NOINIT keeps them across software
+// resets, watchdog and panic restarts (RTC_DATA_ATTR would be reloaded); after
+// power loss the content is random, which the magic and CRC reject. The epoch
+// ties the cache to the config store it was taken from.
+struct CounterRtcCache {
+  uint32_t magic;
+  uint32_t epoch;
+  uint32_t counts[4];
+  uint32_t crc;  // CRC32 of the fields above
+};
+RTC_NOINIT_ATTR CounterRtcCache counterRtcCache;
+
+// Emergency record written by the power-fail path, preformatted so the flush
+// is a single fixed-size write
+struct PowerFailRecord {
+  uint32_t magic;
+  uint32_t epoch;         // Store the counts belong to
+  uint32_t checkpoint;    // Counter checkpoint they follow; a newer checkpoint makes the record stale
+  uint32_t counts[4];
+  uint32_t worstFlushUs;  // Slowest flush measured before this one
+  uint32_t crc;           // CRC32 of the fields above
+};
+static_assert(sizeof(PowerFailRecord) == 36, "PowerFailRecord is written as-is");
+
+// Task layout selection and benchmark results. Kept in RTC memory so a layout
+// change (which needs a restart) and a benchmark sweep across layouts survive
+// the reboots; a power cycle returns to DEFAULT_TASK_LAYOUT.
+struct TaskBenchResult {
+  uint32_t valid;
+  uint32_t jitterSamples;
+  uint32_t jitterP50Us;
+  uint32_t jitterP99Us;
+  uint32_t jitterMaxUs;
+  uint32_t wsSamples;
+  uint32_t wsP50Us;
+  uint32_t wsP99Us;
+  uint32_t wsMaxUs;
+};
+
+struct TaskBenchState {
+  uint32_t magic;
+  uint8_t layout;        // Layout to use after the next restart
+  uint8_t sweepActive;   // Benchmarking each layout in turn
+  uint8_t sweepOrigin;   // Layout to return to when the sweep ends
+  uint8_t reserved;
+  TaskBenchResult results[TASK_LAYOUT_COUNT];
+  uint32_t crc;          // CRC32 of the fields above
+};
+const uint32_t TASK_BENCH_MAGIC = 0x48434E42;  // "BNCH"
+RTC_NOINIT_ATTR TaskBenchState taskBenchState;
+
 // Counter configuration
 struct CounterConfig {
   int pin;
@@ -65,6 +355,14 @@ struct CounterConfig {
   unsigned long lastPulseTime;   // Thêm để theo dõi thời gian giữa các xung
 };
 
+// Fixed-width history record, sent as-is (little-endian uint32 fields)
+// so the browser can view the response as a Uint32Array
+struct HistoryRecord {
+  uint32_t uptimeSeconds;
+  uint32_t counts[4];
+};
+static_assert(sizeof(HistoryRecord) == 20, "HistoryRecord must stay packed for /api/history");
+
 // Admin credentials
 struct AdminCredentials {
   String username = "admin";
@@ -85,33 +383,34 @@ struct OutputStatus {
   String stateStr;
 };
 
-// Structure for LoRa E32 configuration
+// LoRa E32 configuration. The radio settings are bitfields laid out like the
+// module's ADDH/ADDL/SPED/CHAN/OPTION registers; descriptions for the UI come
+// from lora_registers.h when the status is serialized. The runtime state is
+// kept in whole bytes since it is written from several tasks.
 struct LoRaE32Config {
-  bool initialized = false;
-  String moduleInfo = "";
-  String configInfo = "";
   uint8_t addh = 0;
   uint8_t addl = 0;
+  // SPED
+  uint8_t airDataRate : 3;
+  uint8_t uartBaudRate : 3;
+  uint8_t uartParity : 2;
   uint8_t chan = 0;
-  String frequency = "";
-  String airDataRateStr = "";
-  String uartBaudRateStr = "";
-  String transmissionPowerStr = "";
-  String parityBit = "";
-  String wirelessWakeupTimeStr = "";
-  String fecStr = "";
-  String fixedTransmissionStr = "";
-  String ioDriveModeStr = "";
-  uint8_t uartParity = 0;
-  uint8_t uartBaudRate = 0b011;
-  uint8_t airDataRate = 0b010;
-  uint8_t fixedTransmission = 0;
-  uint8_t ioDriveMode = 1;
-  uint8_t wirelessWakeupTime = 0;
-  uint8_t fec = 1;
-  uint8_t transmissionPower = 0b11;
+  // OPTION
+  uint8_t transmissionPower : 2;
+  uint8_t fec : 1;
+  uint8_t wirelessWakeupTime : 3;
+  uint8_t ioDriveMode : 1;
+  uint8_t fixedTransmission : 1;
+  // Runtime state
+  bool initialized = false;
   uint8_t operatingMode = 0;
+  uint8_t role = LORA_ROLE_NODE;
+
+  LoRaE32Config()
+      : airDataRate(0b010), uartBaudRate(0b011), uartParity(0), transmissionPower(0b11), fec(1),
+        wirelessWakeupTime(0), ioDriveMode(1), fixedTransmission(0) {}
 };
+static_assert(sizeof(LoRaE32Config) == 8, "LoRaE32Config should stay register-sized");
 
 // Structure for system status
 struct SystemStatus {
@@ -124,6 +423,7 @@ struct SystemStatus {
   String ipAddress;
   unsigned long uptime;
   LoRaE32Config loraE32;
+  LoRaModuleInfo loraModule;  // Valid when loraE32.initialized
   int planDisplay = 0;
   CounterConfig counters[4];
   bool adminMode = false;
@@ -132,13 +432,11 @@ struct SystemStatus {
 };
 
 // Function declarations
-void saveLoRaConfig();
+bool commitConfigStore();
 void loadLoRaConfig();
-void setLoRaConfig(LoRaE32Config config);
-void setLoRaOperatingMode(uint8_t mode);
-void saveCounterConfig();
+void setLoRaConfig(LoRaE32Config config, bool persist = true);
+bool setLoRaOperatingMode(uint8_t mode);
 void loadCounterConfig();
-void saveAdminCredentials();
 void loadAdminCredentials();
 
 #endif
\ No newline at end of file
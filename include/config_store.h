@@ -0,0 +1,227 @@
+#ifndef CONFIG_STORE_H
+#define CONFIG_STORE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+// Binary config image (multi-byte fields little-endian):
+//   header:  [0..3] magic "CFG1"  [4..5] schema version  [6..7] section count
+//            [8..11] payload length  [12..15] CRC32 of header bytes 0-11 and the payload
+//   payload: sections of [0] id  [1] section version  [2..3] length, then `length` bytes
+// Readers skip sections they do not know, so a new section does not need a
+// schema bump; a section changes its own version when its layout changes.
+const uint32_t CONFIG_STORE_MAGIC = 0x31474643;  // "CFG1"
+const uint16_t CONFIG_STORE_SCHEMA = 1;
+const size_t CONFIG_STORE_HEADER_SIZE = 16;
+const size_t CONFIG_SECTION_HEADER_SIZE = 4;
+
+// CRC32 (IEEE 802.3, as zlib), nibble table to keep it small
+inline uint32_t crc32Update(uint32_t crc, const uint8_t *data, size_t length) {
+  static const uint32_t table[16] = {0x00000000, 0x1DB71064, 0x3B6E20C8, 0x26D930AC, 0x76DC4190, 0x6B6B51F4,
+                                     0x4DB26158, 0x5005713C, 0xEDB88320, 0xF00F9344, 0xD6D6A3E8, 0xCB61B38C,
+                                     0x9B64C2B0, 0x86D3D2D4, 0xA00AE278, 0xBDBDF21C};
+  crc = ~crc;
+  for (size_t i = 0; i < length; i++) {
+    crc = table[(crc ^ data[i]) & 0x0F] ^ (crc >> 4);
+    crc = table[(crc ^ (data[i] >> 4)) & 0x0F] ^ (crc >> 4);
+  }
+  return ~crc;
+}
+
+inline uint16_t readLe16(const uint8_t *in) {
+  return (uint16_t)(in[0] | (in[1] << 8));
+}
+
+inline uint32_t readLe32(const uint8_t *in) {
+  return (uint32_t)in[0] | ((uint32_t)in[1] << 8) | ((uint32_t)in[2] << 16) | ((uint32_t)in[3] << 24);
+}
+
+inline uint32_t imageCrc(const uint8_t *image, uint32_t payload) {
+  uint32_t crc = crc32Update(0, image, CONFIG_STORE_HEADER_SIZE - 4);
+  return crc32Update(crc, image + CONFIG_STORE_HEADER_SIZE, payload);
+}
+
+// Builds an image in a caller-provided buffer. Writes past the end are dropped
+// and make finish() return 0.
+class ConfigImageWriter {
+ public:
+  ConfigImageWriter(uint8_t *buffer, size_t capacity) : buf_(buffer), cap_(capacity) {}
+
+  void beginSection(uint8_t id, uint8_t version) {
+    section_ = len_;
+    put8(id);
+    put8(version);
+    put16(0);  // Patched by endSection()
+  }
+
+  void endSection() {
+    if (!overflow_) {
+      uint16_t length = (uint16_t)(len_ - section_ - CONFIG_SECTION_HEADER_SIZE);
+      buf_[section_ + 2] = (uint8_t)(length & 0xFF);
+      buf_[section_ + 3] = (uint8_t)(length >> 8);
+    }
+    count_++;
+  }
+
+  void put8(uint8_t value) {
+    if (len_ >= cap_) {
+      overflow_ = true;
+      return;
+    }
+    buf_[len_++] = value;
+  }
+
+  void put16(uint16_t value) {
+    put8((uint8_t)(value & 0xFF));
+    put8((uint8_t)(value >> 8));
+  }
+
+  void put32(uint32_t value) {
+    put16((uint16_t)(value & 0xFFFF));
+    put16((uint16_t)(value >> 16));
+  }
+
+  // Length-prefixed string, cut at 255 bytes
+  void putString(const char *value, size_t length) {
+    length = length > 255 ? 255 : length;
+    put8((uint8_t)length);
+    for (size_t i = 0; i < length; i++) {
+      put8((uint8_t)value[i]);
+    }
+  }
+
+  // Fill in the header, returns the image size or 0 if the buffer was too small
+  size_t finish() {
+    if (overflow_ || cap_ < CONFIG_STORE_HEADER_SIZE) {
+      return 0;
+    }
+    uint32_t payload = (uint32_t)(len_ - CONFIG_STORE_HEADER_SIZE);
+    size_t end = len_;
+    len_ = 0;
+    put32(CONFIG_STORE_MAGIC);
+    put16(CONFIG_STORE_SCHEMA);
+    put16(count_);
+    put32(payload);
+    put32(imageCrc(buf_, payload));
+    len_ = end;
+    return len_;
+  }
+
+ private:
+  uint8_t *buf_;
+  size_t cap_;
+  size_t len_ = CONFIG_STORE_HEADER_SIZE;
+  size_t section_ = 0;
+  uint16_t count_ = 0;
+  bool overflow_ = false;
+};
+
+// Bounds-checked cursor over one section; a short read sets ok() to false and returns zeros
+class ConfigSectionReader {
+ public:
+  ConfigSectionReader() {}
+  ConfigSectionReader(const uint8_t *data, size_t length) : data_(data), len_(length) {}
+
+  uint8_t get8() {
+    if (pos_ >= len_) {
+      ok_ = false;
+      return 0;
+    }
+    return data_[pos_++];
+  }
+
+  uint16_t get16() {
+    uint16_t low = get8();
+    return (uint16_t)(low | (get8() << 8));
+  }
+
+  uint32_t get32() {
+    uint32_t low = get16();
+    return low | ((uint32_t)get16() << 16);
+  }
+
+  // Step over fields this build does not read
+  void skip(size_t n) {
+    if (n > remaining()) {
+      ok_ = false;
+      pos_ = len_;
+      return;
+    }
+    pos_ += n;
+  }
+
+  // Copy a length-prefixed string into out (NUL-terminated, cut to fit)
+  void getString(char *out, size_t capacity) {
+    size_t length = get8();
+    size_t n = 0;
+    for (size_t i = 0; i < length; i++) {
+      uint8_t c = get8();
+      if (n + 1 < capacity) {
+        out[n++] = (char)c;
+      }
+    }
+    if (capacity > 0) {
+      out[n] = '\0';
+    }
+  }
+
+  bool ok() const { return ok_; }
+  // Bytes left; lets a section grow new trailing fields without a version bump
+  size_t remaining() const { return pos_ < len_ ? len_ - pos_ : 0; }
+
+ private:
+  const uint8_t *data_ = nullptr;
+  size_t len_ = 0;
+  size_t pos_ = 0;
+  bool ok_ = true;
+};
+
+// Validates an image and looks up its sections; the image must outlive the reader
+class ConfigImageReader {
+ public:
+  // Check magic, schema, length and CRC
+  bool open(const uint8_t *image, size_t length) {
+    image_ = nullptr;
+    if (length < CONFIG_STORE_HEADER_SIZE || readLe32(image) != CONFIG_STORE_MAGIC ||
+        readLe16(image + 4) != CONFIG_STORE_SCHEMA) {
+      return false;
+    }
+    uint32_t payload = readLe32(image + 8);
+    if (payload > length - CONFIG_STORE_HEADER_SIZE || imageCrc(image, payload) != readLe32(image + 12)) {
+      return false;
+    }
+    image_ = image;
+    payload_ = payload;
+    return true;
+  }
+
+  bool find(uint8_t id, ConfigSectionReader *section, uint8_t *version) const {
+    if (image_ == nullptr) {
+      return false;
+    }
+    const uint8_t *p = image_ + CONFIG_STORE_HEADER_SIZE;
+    const uint8_t *end = p + payload_;
+    while (end - p >= (ptrdiff_t)CONFIG_SECTION_HEADER_SIZE) {
+      uint16_t length = readLe16(p + 2);
+      if (end - p - CONFIG_SECTION_HEADER_SIZE < length) {
+        return false;
+      }
+      if (p[0] == id) {
+        *section = ConfigSectionReader(p + CONFIG_SECTION_HEADER_SIZE, length);
+        *version = p[1];
+        return true;
+      }
+      p += CONFIG_SECTION_HEADER_SIZE + length;
+    }
+    return false;
+  }
+
+  uint16_t sections() const { return image_ != nullptr ? readLe16(image_ + 6) : 0; }
+
+ private:
+  const uint8_t *image_ = nullptr;
+  uint32_t payload_ = 0;
+};
+
+#endif
@@ -0,0 +1,98 @@
+#ifndef EVENT_LOG_H
+#define EVENT_LOG_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Production event log: fixed-size records appended to segment files. Times
+// are log seconds, which keep increasing across reboots (the device has no
+// wall clock), so records are in time order across all segments.
+enum EventType : uint8_t {
+  EVENT_NONE = 0,
+  EVENT_BOOT = 1,           // value = reset reason
+  EVENT_COUNT = 2,          // subject = counter index, value = count, previous = count at the last record
+  EVENT_COUNTER_RESET = 3,  // subject = counter index, previous = count before the reset
+  EVENT_CONFIG_CHANGE = 4,  // subject = CONFIG_DIRTY_* mask of the changed sections
+  EVENT_OUTPUT = 5,         // subject = pin, value = new state, previous = old state
+};
+
+struct EventRecord {
+  uint32_t time;  // Log seconds
+  uint8_t type;
+  uint8_t subject;
+  uint16_t reserved;
+  uint32_t value;
+  uint32_t previous;
+};
+static_assert(sizeof(EventRecord) == 16, "EventRecord is stored and served as-is");
+
+// Where a record lives: segment number and record number within the segment
+struct EventLogPosition {
+  uint32_t time;
+  uint32_t segment;
+  uint32_t record;
+};
+
+// Sparse in-RAM index over the segments, one entry every few records. Entries
+// are added in time order and dropped with the oldest segment, so a lookup is
+// a binary search followed by a short forward scan in one file.
+template <size_t CAPACITY>
+class EventLogIndex {
+ public:
+  void add(uint32_t time, uint32_t segment, uint32_t record) {
+    if (size_ == CAPACITY) {
+      dropFront(1);
+    }
+    entries_[size_++] = {time, segment, record};
+  }
+
+  // Forget every entry of segments older than `segment`
+  void dropBefore(uint32_t segment) {
+    size_t n = 0;
+    while (n < size_ && entries_[n].segment < segment) {
+      n++;
+    }
+    dropFront(n);
+  }
+
+  // Latest entry at or before `time` (the oldest entry if none is); false when empty.
+  // Scanning forward from it reaches every record at or after `time`.
+  bool seek(uint32_t time, EventLogPosition *position) const {
+    if (size_ == 0) {
+      return false;
+    }
+    size_t low = 0;
+    size_t high = size_;
+    while (low < high) {
+      size_t mid = (low + high) / 2;
+      if (entries_[mid].time <= time) {
+        low = mid + 1;
+      } else {
+        high = mid;
+      }
+    }
+    // Records with equal times may sit before the entry found, so step back past them
+    size_t i = low == 0 ? 0 : low - 1;
+    while (i > 0 && entries_[i].time == time) {
+      i--;
+    }
+    *position = entries_[i];
+    return true;
+  }
+
+  size_t size() const { return size_; }
+  void clear() { size_ = 0; }
+
+ private:
+  void dropFront(size_t n) {
+    for (size_t i = n; i < size_; i++) {
+      entries_[i - n] = entries_[i];
+    }
+    size_ -= n;
+  }
+
+  EventLogPosition entries_[CAPACITY] = {};
+  size_t size_ = 0;
+};
+
+#endif
@@ -0,0 +1,64 @@
+#ifndef EXPORT_FORMAT_H
+#define EXPORT_FORMAT_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include "event_log.h"
+
+// Row formatting for /api/export. Each call writes one complete row (with its
+// newline) into a caller buffer and returns its length, or 0 if it did not fit.
+enum ExportFormat : uint8_t {
+  EXPORT_CSV = 0,
+  EXPORT_NDJSON = 1,
+};
+
+// Longest row either format produces, with room to spare
+const size_t EXPORT_ROW_MAX = 160;
+
+constexpr const char *eventTypeNames[] = {"none", "boot", "count", "counter_reset", "config_change", "output"};
+
+inline const char *eventTypeName(uint8_t type) {
+  return type < sizeof(eventTypeNames) / sizeof(eventTypeNames[0]) ? eventTypeNames[type] : "unknown";
+}
+
+inline size_t exportRowLength(int length, size_t capacity) {
+  return length > 0 && (size_t)length < capacity ? (size_t)length : 0;
+}
+
+inline size_t formatExportHeader(char *out, size_t capacity, ExportFormat format) {
+  if (format != EXPORT_CSV) {
+    return 0;
+  }
+  return exportRowLength(snprintf(out, capacity, "time,source,type,subject,value,previous,count1,count2,count3,count4\n"),
+                         capacity);
+}
+
+inline size_t formatHistoryRow(char *out, size_t capacity, ExportFormat format, uint32_t time, const uint32_t counts[4]) {
+  int length;
+  if (format == EXPORT_CSV) {
+    length = snprintf(out, capacity, "%lu,history,,,,,%lu,%lu,%lu,%lu\n", (unsigned long)time, (unsigned long)counts[0],
+                      (unsigned long)counts[1], (unsigned long)counts[2], (unsigned long)counts[3]);
+  } else {
+    length = snprintf(out, capacity, "{\"time\":%lu,\"source\":\"history\",\"counts\":[%lu,%lu,%lu,%lu]}\n",
+                      (unsigned long)time, (unsigned long)counts[0], (unsigned long)counts[1],
+                      (unsigned long)counts[2], (unsigned long)counts[3]);
+  }
+  return exportRowLength(length, capacity);
+}
+
+inline size_t formatEventRow(char *out, size_t capacity, ExportFormat format, const EventRecord &record) {
+  int length;
+  if (format == EXPORT_CSV) {
+    length = snprintf(out, capacity, "%lu,event,%s,%u,%lu,%lu,,,,\n", (unsigned long)record.time,
+                      eventTypeName(record.type), record.subject, (unsigned long)record.value,
+                      (unsigned long)record.previous);
+  } else {
+    length = snprintf(out, capacity,
+                      "{\"time\":%lu,\"source\":\"event\",\"type\":\"%s\",\"subject\":%u,\"value\":%lu,\"previous\":%lu}\n",
+                      (unsigned long)record.time, eventTypeName(record.type), record.subject,
+                      (unsigned long)record.value, (unsigned long)record.previous);
+  }
+  return exportRowLength(length, capacity);
+}
+
+#endif
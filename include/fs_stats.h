@@ -0,0 +1,148 @@
+#ifndef FS_STATS_H
+#define FS_STATS_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+// Latency histogram with power-of-two µs buckets (64 µs .. 2 s, then overflow).
+// Percentiles resolve to the upper bound of their bucket.
+class FsLatencyHistogram {
+ public:
+  static const size_t BUCKETS = 16;
+
+  void record(uint32_t us) {
+    size_t i = 0;
+    while (i < BUCKETS - 1 && us > bound(i)) {
+      i++;
+    }
+    counts_[i]++;
+    count_++;
+    if (us > maxUs_) {
+      maxUs_ = us;
+    }
+  }
+
+  uint32_t count() const { return count_; }
+  uint32_t maxUs() const { return maxUs_; }
+
+  uint32_t percentileUs(float percentile) const {
+    if (count_ == 0) {
+      return 0;
+    }
+    uint32_t rank = (uint32_t)(count_ * percentile / 100.0f + 0.5f);
+    rank = rank == 0 ? 1 : rank;
+    uint32_t seen = 0;
+    for (size_t i = 0; i < BUCKETS; i++) {
+      seen += counts_[i];
+      if (seen >= rank) {
+        return i == BUCKETS - 1 ? maxUs_ : bound(i);
+      }
+    }
+    return maxUs_;
+  }
+
+  static uint32_t bound(size_t i) { return (uint32_t)64 << i; }
+
+ private:
+  uint32_t counts_[BUCKETS] = {};
+  uint32_t count_ = 0;
+  uint32_t maxUs_ = 0;
+};
+
+struct FsFileStats {
+  char path[24];
+  uint32_t writes;
+  uint64_t bytesWritten;
+  uint32_t reads;
+  uint64_t bytesRead;
+  uint32_t metadataOps;     // Renames and removes
+  uint64_t bytesProgrammed;  // Written bytes plus an estimate of the metadata each commit adds
+  FsLatencyHistogram writeLatency;
+};
+
+// Per-file I/O accounting. Flash wear is estimated from the bytes programmed:
+// littlefs is copy-on-write, so every programmed block was erased first, and
+// small files are appended to metadata logs that are erased once they fill.
+// Files beyond CAPACITY are folded into the last slot.
+template <size_t CAPACITY>
+class FsStatsTable {
+ public:
+  FsStatsTable(uint32_t blockSize, uint32_t commitOverhead) : blockSize_(blockSize), commitOverhead_(commitOverhead) {}
+
+  void recordWrite(const char *path, size_t bytes, uint32_t us) {
+    FsFileStats &file = lookup(path);
+    file.writes++;
+    file.bytesWritten += bytes;
+    file.bytesProgrammed += bytes + commitOverhead_;
+    file.writeLatency.record(us);
+  }
+
+  void recordRead(const char *path, size_t bytes) {
+    FsFileStats &file = lookup(path);
+    file.reads++;
+    file.bytesRead += bytes;
+  }
+
+  void recordMetadata(const char *path) {
+    FsFileStats &file = lookup(path);
+    file.metadataOps++;
+    file.bytesProgrammed += commitOverhead_;
+  }
+
+  size_t size() const { return size_; }
+  const FsFileStats &file(size_t index) const { return files_[index]; }
+
+  double erases(const FsFileStats &file) const { return (double)file.bytesProgrammed / blockSize_; }
+
+  double totalErases() const {
+    double total = 0;
+    for (size_t i = 0; i < size_; i++) {
+      total += erases(files_[i]);
+    }
+    return total;
+  }
+
+  // Years until the average block reaches its erase endurance at the rate seen
+  // over elapsedSeconds, assuming littlefs spreads wear evenly; 0 if nothing was written
+  double lifetimeYears(uint32_t totalBlocks, uint32_t endurance, double elapsedSeconds) const {
+    double erased = totalErases();
+    if (erased <= 0 || elapsedSeconds <= 0) {
+      return 0;
+    }
+    double perSecond = erased / elapsedSeconds;
+    return (double)totalBlocks * endurance / perSecond / (365.0 * 24 * 3600);
+  }
+
+ private:
+  // Files in a subdirectory share one "<dir>/*" entry
+  FsFileStats &lookup(const char *path) {
+    char key[sizeof(FsFileStats::path)];
+    const char *slash = strchr(path + 1, '/');
+    if (slash != nullptr && (size_t)(slash - path) + 2 < sizeof(key)) {
+      memcpy(key, path, slash - path);
+      strcpy(key + (slash - path), "/*");
+    } else {
+      strncpy(key, path, sizeof(key) - 1);
+      key[sizeof(key) - 1] = '\0';
+    }
+    for (size_t i = 0; i < size_; i++) {
+      if (strcmp(files_[i].path, key) == 0) {
+        return files_[i];
+      }
+    }
+    if (size_ == CAPACITY) {
+      return files_[CAPACITY - 1];
+    }
+    FsFileStats &file = files_[size_++];
+    strncpy(file.path, size_ == CAPACITY ? "(other)" : key, sizeof(file.path) - 1);
+    return file;
+  }
+
+  FsFileStats files_[CAPACITY] = {};
+  size_t size_ = 0;
+  uint32_t blockSize_;
+  uint32_t commitOverhead_;
+};
+
+#endif
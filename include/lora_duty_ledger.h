@@ -0,0 +1,119 @@
+#ifndef LORA_DUTY_LEDGER_H
+#define LORA_DUTY_LEDGER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Air time seen on one channel over the ledger window
+struct LoRaChannelUsage {
+  uint8_t chan;
+  uint32_t ownMs;    // Our own transmissions
+  uint32_t heardMs;  // Frames received from other nodes
+};
+
+// Sliding-window air-time ledger per E32 channel (CHAN).
+// The window is split into BUCKETS time slots; totals cover the current slot plus
+// the BUCKETS - 1 before it, so old air time ages out one slot at a time. Only
+// CHANNELS channels are tracked; the least recently used one is recycled when a
+// new channel shows up. Nothing allocates, callers provide the locking.
+template <size_t CHANNELS, size_t BUCKETS>
+class LoRaDutyLedger {
+ public:
+  explicit LoRaDutyLedger(uint32_t windowMs) : bucketMs_(windowMs / BUCKETS) {}
+
+  uint32_t windowMs() const { return bucketMs_ * BUCKETS; }
+
+  void recordTransmit(uint8_t chan, uint32_t airMs, uint32_t nowMs) {
+    Slot &slot = slotFor(chan, nowMs);
+    slot.own[slot.epoch % BUCKETS] += airMs;
+  }
+
+  void recordHeard(uint8_t chan, uint32_t airMs, uint32_t nowMs) {
+    Slot &slot = slotFor(chan, nowMs);
+    slot.heard[slot.epoch % BUCKETS] += airMs;
+  }
+
+  // True if sending airMs more keeps our own share of the window within budgetPercent
+  bool canTransmit(uint8_t chan, uint32_t airMs, float budgetPercent, uint32_t nowMs) {
+    return usage(chan, nowMs).ownMs + airMs <= (uint32_t)(windowMs() * budgetPercent / 100.0f);
+  }
+
+  LoRaChannelUsage usage(uint8_t chan, uint32_t nowMs) {
+    LoRaChannelUsage result = {chan, 0, 0};
+    for (size_t i = 0; i < CHANNELS; i++) {
+      if (slots_[i].used && slots_[i].chan == chan) {
+        roll(slots_[i], nowMs);
+        result = total(slots_[i]);
+      }
+    }
+    return result;
+  }
+
+  // Fill out[] with every tracked channel, returns the number written
+  size_t snapshot(LoRaChannelUsage out[CHANNELS], uint32_t nowMs) {
+    size_t n = 0;
+    for (size_t i = 0; i < CHANNELS; i++) {
+      if (slots_[i].used) {
+        roll(slots_[i], nowMs);
+        out[n++] = total(slots_[i]);
+      }
+    }
+    return n;
+  }
+
+ private:
+  struct Slot {
+    bool used;
+    uint8_t chan;
+    uint32_t epoch;  // nowMs / bucketMs_ of the current bucket
+    uint32_t own[BUCKETS];
+    uint32_t heard[BUCKETS];
+  };
+
+  // Clear the buckets that fell out of the window since the slot was last touched
+  void roll(Slot &slot, uint32_t nowMs) {
+    uint32_t epoch = nowMs / bucketMs_;
+    uint32_t elapsed = epoch - slot.epoch;
+    if (elapsed >= BUCKETS) {
+      elapsed = BUCKETS;  // Also covers millis() wrap-around
+    }
+    for (uint32_t i = 1; i <= elapsed; i++) {
+      slot.own[(slot.epoch + i) % BUCKETS] = 0;
+      slot.heard[(slot.epoch + i) % BUCKETS] = 0;
+    }
+    slot.epoch = epoch;
+  }
+
+  Slot &slotFor(uint8_t chan, uint32_t nowMs) {
+    Slot *oldest = &slots_[0];
+    for (size_t i = 0; i < CHANNELS; i++) {
+      Slot &slot = slots_[i];
+      if (slot.used && slot.chan == chan) {
+        roll(slot, nowMs);
+        return slot;
+      }
+      if (!slot.used || (oldest->used && slot.epoch < oldest->epoch)) {
+        oldest = &slot;
+      }
+    }
+    *oldest = Slot();
+    oldest->used = true;
+    oldest->chan = chan;
+    oldest->epoch = nowMs / bucketMs_;
+    return *oldest;
+  }
+
+  LoRaChannelUsage total(const Slot &slot) const {
+    LoRaChannelUsage result = {slot.chan, 0, 0};
+    for (size_t i = 0; i < BUCKETS; i++) {
+      result.ownMs += slot.own[i];
+      result.heardMs += slot.heard[i];
+    }
+    return result;
+  }
+
+  uint32_t bucketMs_;
+  Slot slots_[CHANNELS] = {};
+};
+
+#endif
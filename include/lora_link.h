@@ -0,0 +1,127 @@
+#ifndef LORA_LINK_H
+#define LORA_LINK_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "lora_telemetry.h"
+
+// Link frame wrapped around every LoRa payload:
+//   [0] sync 0xA5  [1] type  [2] payload length  [3..] payload  [..] CRC-16 (LE)
+// The CRC (CCITT-FALSE) covers type, length and payload.
+const uint8_t LORA_FRAME_SYNC = 0xA5;
+const uint8_t LORA_FRAME_OVERHEAD = 5;
+const uint8_t LORA_MAX_FRAME_PAYLOAD = LORA_MAX_PACKET_SIZE - LORA_FRAME_OVERHEAD;
+
+enum LoRaFrameType : uint8_t {
+  LORA_FRAME_COUNTER_REPORT = 0x01,
+  LORA_FRAME_RELIABLE = 0x02,  // Sequenced wrapper around another frame, see lora_reliable.h
+  LORA_FRAME_ACK = 0x03,
+  LORA_FRAME_TYPE_COUNT
+};
+
+inline uint16_t crc16Ccitt(const uint8_t *data, size_t len, uint16_t crc = 0xFFFF) {
+  for (size_t i = 0; i < len; i++) {
+    crc ^= (uint16_t)data[i] << 8;
+    for (int bit = 0; bit < 8; bit++) {
+      crc = (crc & 0x8000) ? (uint16_t)((crc << 1) ^ 0x1021) : (uint16_t)(crc << 1);
+    }
+  }
+  return crc;
+}
+
+// Wrap a payload into a link frame, returns the frame size (0 if the payload is too long)
+inline size_t encodeLoRaFrame(uint8_t *out, uint8_t type, const uint8_t *payload, size_t length) {
+  if (length > LORA_MAX_FRAME_PAYLOAD) {
+    return 0;
+  }
+  out[0] = LORA_FRAME_SYNC;
+  out[1] = type;
+  out[2] = (uint8_t)length;
+  for (size_t i = 0; i < length; i++) {
+    out[3 + i] = payload[i];
+  }
+  uint16_t crc = crc16Ccitt(out + 1, length + 2);
+  out[3 + length] = (uint8_t)(crc & 0xFF);
+  out[4 + length] = (uint8_t)(crc >> 8);
+  return length + LORA_FRAME_OVERHEAD;
+}
+
+struct LoRaParserStats {
+  uint32_t bytes = 0;
+  uint32_t frames = 0;
+  uint32_t skippedBytes = 0;   // Bytes dropped while hunting for sync or after a bad length
+  uint32_t crcErrors = 0;
+  uint32_t overflows = 0;      // Bytes dropped because the ring was full
+};
+
+// Reassembles link frames from a byte stream.
+// Each byte is stored twice, at i and i + CAPACITY, so the pending data is always
+// one contiguous window and handlers get a pointer into the ring instead of a copy.
+template <size_t CAPACITY>
+class LoRaFrameParser {
+ public:
+  typedef void (*Handler)(uint8_t type, const uint8_t *payload, uint8_t length, void *context);
+
+  void push(const uint8_t *data, size_t len) {
+    for (size_t i = 0; i < len; i++) {
+      if (count_ == CAPACITY) {
+        drop(1);
+        stats.overflows++;
+      }
+      size_t slot = (head_ + count_) % CAPACITY;
+      storage_[slot] = data[i];
+      storage_[slot + CAPACITY] = data[i];
+      count_++;
+    }
+    stats.bytes += len;
+  }
+
+  // Dispatch every complete frame; an incomplete tail stays buffered
+  void parse(Handler handler, void *context) {
+    while (count_ > 0) {
+      const uint8_t *p = &storage_[head_];
+      if (p[0] != LORA_FRAME_SYNC) {
+        stats.skippedBytes++;
+        drop(1);
+        continue;
+      }
+      if (count_ < 3) {
+        return;
+      }
+      uint8_t length = p[2];
+      if (length > LORA_MAX_FRAME_PAYLOAD) {
+        stats.skippedBytes++;
+        drop(1);
+        continue;
+      }
+      if (count_ < (size_t)length + LORA_FRAME_OVERHEAD) {
+        return;
+      }
+      uint16_t expected = (uint16_t)(p[3 + length] | (p[4 + length] << 8));
+      if (crc16Ccitt(p + 1, length + 2) != expected) {
+        stats.crcErrors++;
+        drop(1); // Resync from the next byte
+        continue;
+      }
+      stats.frames++;
+      handler(p[1], p + 3, length, context);
+      drop(length + LORA_FRAME_OVERHEAD);
+    }
+  }
+
+  size_t pending() const { return count_; }
+
+  LoRaParserStats stats;
+
+ private:
+  void drop(size_t n) {
+    head_ = (head_ + n) % CAPACITY;
+    count_ -= n;
+  }
+
+  uint8_t storage_[2 * CAPACITY];
+  size_t head_ = 0;
+  size_t count_ = 0;
+};
+
+#endif
@@ -0,0 +1,114 @@
+#ifndef LORA_LINK_STATS_H
+#define LORA_LINK_STATS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Fixed-bucket latency histogram (ms). Percentiles resolve to the upper bound of
+// the bucket they fall in, which is plenty for telling 300 ms from 3 s.
+class LoRaLatencyHistogram {
+ public:
+  static const size_t BUCKETS = 20;
+
+  void record(uint32_t ms) {
+    size_t i = 0;
+    while (i < BUCKETS - 1 && ms > bound(i)) {
+      i++;
+    }
+    counts_[i]++;
+    count_++;
+    sumMs_ += ms;
+    if (ms > maxMs_) {
+      maxMs_ = ms;
+    }
+  }
+
+  uint32_t count() const { return count_; }
+  uint32_t meanMs() const { return count_ > 0 ? (uint32_t)(sumMs_ / count_) : 0; }
+  uint32_t maxMs() const { return maxMs_; }
+
+  // Upper bound of the bucket holding the given percentile (0-100); the overflow bucket reports the max
+  uint32_t percentileMs(float percentile) const {
+    if (count_ == 0) {
+      return 0;
+    }
+    uint32_t rank = (uint32_t)(count_ * percentile / 100.0f + 0.5f);
+    rank = rank == 0 ? 1 : rank;
+    uint32_t seen = 0;
+    for (size_t i = 0; i < BUCKETS; i++) {
+      seen += counts_[i];
+      if (seen >= rank) {
+        return i == BUCKETS - 1 ? maxMs_ : bound(i);
+      }
+    }
+    return maxMs_;
+  }
+
+  static uint32_t bound(size_t i) {
+    static const uint32_t bounds[BUCKETS] = {50,   100,  150,  200,   300,   400,   500,   750,   1000,  1500,
+                                             2000, 3000, 4000, 6000, 8000, 12000, 16000, 24000, 32000, UINT32_MAX};
+    return bounds[i];
+  }
+
+ private:
+  uint32_t counts_[BUCKETS] = {};
+  uint32_t count_ = 0;
+  uint64_t sumMs_ = 0;
+  uint32_t maxMs_ = 0;
+};
+
+// Last contact with each radio peer, whatever frame type it sent
+struct LoRaPeerEntry {
+  bool used;
+  uint16_t address;
+  uint32_t lastSeen;  // ms
+  uint32_t frames;
+  uint32_t bytes;
+};
+
+// Fixed-capacity open-addressing table keyed by peer address (same scheme as
+// LoRaNodeTable). When it is full, new peers are counted but not tracked.
+template <size_t CAPACITY>
+class LoRaPeerTable {
+  static_assert((CAPACITY & (CAPACITY - 1)) == 0, "Peer table capacity must be a power of two");
+
+ public:
+  void seen(uint16_t address, uint32_t bytes, uint32_t nowMs) {
+    size_t slot = (size_t)((address * 2654435761u) >> 16) & (CAPACITY - 1);
+    for (size_t probe = 0; probe < CAPACITY; probe++) {
+      LoRaPeerEntry &entry = entries_[(slot + probe) & (CAPACITY - 1)];
+      if (!entry.used) {
+        entry = LoRaPeerEntry();
+        entry.used = true;
+        entry.address = address;
+        size_++;
+      }
+      if (entry.address == address) {
+        entry.lastSeen = nowMs;
+        entry.frames++;
+        entry.bytes += bytes;
+        return;
+      }
+    }
+    untracked++;
+  }
+
+  size_t size() const { return size_; }
+  static size_t capacity() { return CAPACITY; }
+  const LoRaPeerEntry &slot(size_t index) const { return entries_[index]; }
+
+  uint32_t untracked = 0;
+
+ private:
+  LoRaPeerEntry entries_[CAPACITY] = {};
+  size_t size_ = 0;
+};
+
+// Transmit-side counters; receive-side counters live in LoRaParserStats
+struct LoRaTxStats {
+  uint32_t frames = 0;
+  uint32_t bytes = 0;     // Bytes handed to the module, including the fixed-mode header
+  uint32_t failures = 0;  // Module rejected the write or stayed busy
+};
+
+#endif
@@ -0,0 +1,136 @@
+#ifndef LORA_NODE_TABLE_H
+#define LORA_NODE_TABLE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "lora_telemetry.h"
+
+// State kept by a gateway for each remote counter node
+struct LoRaNodeEntry {
+  bool used;
+  uint16_t address;          // ADDH << 8 | ADDL
+  uint8_t session;           // Boot session of the node, see CounterReport
+  uint16_t lastSequence;     // Highest sequence applied
+  uint16_t seen;             // Bit i: lastSequence - 1 - i applied
+  uint32_t firstSeen;        // ms
+  uint32_t lastSeen;         // ms
+  uint32_t counts[LORA_REPORT_COUNTERS];
+  float rates[LORA_REPORT_COUNTERS];  // units/min over the last report interval
+  bool hasIo;
+  uint16_t ioState;          // Last I/O state reported (inputs bits 0-7, outputs bits 8-15)
+  uint32_t frames;
+  uint32_t duplicates;
+};
+
+enum LoRaReportResult {
+  LORA_REPORT_APPLIED,
+  LORA_REPORT_DUPLICATE,
+  LORA_REPORT_TABLE_FULL
+};
+
+// Fixed-capacity open-addressing hash table keyed by node address.
+// Lookups and updates are O(1) on average and never allocate, so it is safe to
+// update from the LoRa receive task. Entries are never removed.
+template <size_t CAPACITY>
+class LoRaNodeTable {
+  static_assert((CAPACITY & (CAPACITY - 1)) == 0, "Node table capacity must be a power of two");
+
+ public:
+  // Sequence numbers this far behind the last one are checked against the seen
+  // bitmap, so a late report that filled a hole is still applied; anything older
+  // is assumed to be a node that restarted its sequence. A new session always
+  // restarts it.
+  static const int16_t DUPLICATE_WINDOW = 16;
+
+  LoRaNodeEntry *find(uint16_t address) {
+    size_t slot = hash(address);
+    for (size_t probe = 0; probe < CAPACITY; probe++) {
+      LoRaNodeEntry &entry = entries_[(slot + probe) & (CAPACITY - 1)];
+      if (!entry.used) {
+        return nullptr;
+      }
+      if (entry.address == address) {
+        return &entry;
+      }
+    }
+    return nullptr;
+  }
+
+  // deduplicated: the frame came through LoRaReliableReceiver, which already
+  // delivers each sequence once, possibly out of order
+  LoRaReportResult applyReport(const CounterReport &report, uint32_t nowMs, bool deduplicated = false) {
+    LoRaNodeEntry *entry = findOrInsert(report.address, nowMs);
+    if (entry == nullptr) {
+      return LORA_REPORT_TABLE_FULL;
+    }
+    bool restart = entry->frames == 0 || report.session != entry->session;
+    int16_t distance = (int16_t)(report.sequence - entry->lastSequence);
+    if (!restart && !deduplicated && distance <= -DUPLICATE_WINDOW) {
+      restart = true;
+    }
+    if (restart) {
+      entry->seen = 0;
+      entry->lastSequence = report.sequence;
+    } else if (distance > 0) {
+      // Slide the bitmap up to the new sequence; the old last one was applied
+      entry->seen = distance >= DUPLICATE_WINDOW ? 0 : (uint16_t)((entry->seen << distance) | (1u << (distance - 1)));
+      entry->lastSequence = report.sequence;
+    } else if (distance > -DUPLICATE_WINDOW) {
+      uint16_t bit = distance == 0 ? 0 : (uint16_t)(1u << (-distance - 1));
+      if (!deduplicated && (distance == 0 || (entry->seen & bit) != 0)) {
+        entry->duplicates++;
+        return LORA_REPORT_DUPLICATE;
+      }
+      entry->seen |= bit;
+    }
+    uint32_t elapsed = nowMs - entry->lastSeen;
+    for (size_t i = 0; i < LORA_REPORT_COUNTERS; i++) {
+      entry->counts[i] += (uint32_t)report.deltas[i];  // Negative after a remote counter reset
+      if (entry->frames > 0 && elapsed > 0) {
+        entry->rates[i] = report.deltas[i] > 0 ? report.deltas[i] * 60000.0f / elapsed : 0.0f;
+      }
+    }
+    if (report.hasIo && (restart || distance > 0)) {  // A late report carries an older state
+      entry->hasIo = true;
+      entry->ioState = report.ioState;
+    }
+    entry->session = report.session;
+    entry->lastSeen = nowMs;
+    entry->frames++;
+    return LORA_REPORT_APPLIED;
+  }
+
+  size_t size() const { return size_; }
+  static size_t capacity() { return CAPACITY; }
+  const LoRaNodeEntry &slot(size_t index) const { return entries_[index]; }
+
+ private:
+  static size_t hash(uint16_t address) {
+    return (size_t)((address * 2654435761u) >> 16) & (CAPACITY - 1);
+  }
+
+  LoRaNodeEntry *findOrInsert(uint16_t address, uint32_t nowMs) {
+    size_t slot = hash(address);
+    for (size_t probe = 0; probe < CAPACITY; probe++) {
+      LoRaNodeEntry &entry = entries_[(slot + probe) & (CAPACITY - 1)];
+      if (entry.used && entry.address == address) {
+        return &entry;
+      }
+      if (!entry.used) {
+        entry = LoRaNodeEntry();
+        entry.used = true;
+        entry.address = address;
+        entry.firstSeen = nowMs;
+        entry.lastSeen = nowMs;
+        size_++;
+        return &entry;
+      }
+    }
+    return nullptr;
+  }
+
+  LoRaNodeEntry entries_[CAPACITY] = {};
+  size_t size_ = 0;
+};
+
+#endif
@@ -0,0 +1,40 @@
+#ifndef LORA_REGISTERS_H
+#define LORA_REGISTERS_H
+
+#include <stdint.h>
+
+// Human-readable names for the E32 register fields, looked up only when a
+// status message is serialized. Wording follows the LoRa_E32 library so the
+// web UI sees the same strings as before.
+constexpr const char *loraAirDataRateNames[8] = {"0.3kbps", "1.2kbps", "2.4kbps (default)", "4.8kbps",
+                                                 "9.6kbps", "19.2kbps", "19.2kbps", "19.2kbps"};
+constexpr const char *loraUartBaudRateNames[8] = {"1200bps",  "2400bps",  "4800bps",  "9600bps (default)",
+                                                  "19200bps", "38400bps", "57600bps", "115200bps"};
+constexpr const char *loraUartParityNames[4] = {"8N1 (default)", "8O1", "8E1", "8N1 (equal to 00)"};
+constexpr const char *loraTransmissionPowerNames[4] = {"20dBm (default)", "17dBm", "14dBm", "10dBm"};
+constexpr const char *loraWakeUpTimeNames[8] = {"250ms (default)", "500ms",  "750ms",  "1000ms",
+                                                "1250ms",          "1500ms", "1750ms", "2000ms"};
+constexpr const char *loraFecNames[2] = {"Turn off Forward Error Correction Switch",
+                                         "Turn on Forward Error Correction Switch (default)"};
+constexpr const char *loraFixedTransmissionNames[2] = {
+    "Transparent transmission (default)",
+    "Fixed transmission (first three bytes can be used as high/low address and channel)"};
+constexpr const char *loraIoDriveModeNames[2] = {"TXD, RXD, AUX are open-collectors",
+                                                 "TXD, AUX push-pulls, RXD pull-ups"};
+
+// CHAN counts 1 MHz steps up from this (433 MHz modules)
+const uint16_t LORA_BASE_FREQUENCY_MHZ = 410;
+
+inline uint16_t loraChannelMHz(uint8_t chan) {
+  return LORA_BASE_FREQUENCY_MHZ + chan;
+}
+
+// Reply to the C3 (module information) command
+struct LoRaModuleInfo {
+  uint8_t head;
+  uint8_t frequency;
+  uint8_t version;
+  uint8_t features;
+};
+
+#endif
@@ -0,0 +1,380 @@
+#ifndef LORA_RELIABLE_H
+#define LORA_RELIABLE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "lora_link.h"
+#include "lora_link_stats.h"
+
+// Optional reliable delivery on top of the link frames.
+//
+// LORA_FRAME_RELIABLE payload (multi-byte fields little-endian):
+//   [0] src ADDH  [1] src ADDL  [2] session  [3..4] sequence  [5] inner frame type  [6..] inner payload
+// LORA_FRAME_ACK payload:
+//   [0] src ADDH  [1] src ADDL  [2] dst ADDH  [3] dst ADDL  [4] session  [5..6] next expected sequence
+//   [7..10] selective-ACK bitmap, bit i = next + 1 + i received
+//
+// A sender keeps its own sequence space per destination; the session byte is
+// picked at boot so a receiver can tell a restarted sender from a very late one.
+const uint8_t LORA_RELIABLE_HEADER_SIZE = 6;
+const uint8_t LORA_RELIABLE_MAX_PAYLOAD = LORA_MAX_FRAME_PAYLOAD - LORA_RELIABLE_HEADER_SIZE;
+const uint8_t LORA_ACK_SIZE = 11;
+const uint8_t LORA_SACK_BITS = 32;
+
+struct LoRaAck {
+  uint16_t source;       // Receiver that sent the ACK
+  uint16_t destination;  // Sender being acknowledged
+  uint8_t session;
+  uint16_t next;         // Every sequence before this one was received
+  uint32_t bitmap;
+};
+
+inline size_t packLoRaAck(uint8_t *out, const LoRaAck &ack) {
+  out[0] = (uint8_t)(ack.source >> 8);
+  out[1] = (uint8_t)(ack.source & 0xFF);
+  out[2] = (uint8_t)(ack.destination >> 8);
+  out[3] = (uint8_t)(ack.destination & 0xFF);
+  out[4] = ack.session;
+  out[5] = (uint8_t)(ack.next & 0xFF);
+  out[6] = (uint8_t)(ack.next >> 8);
+  for (int i = 0; i < 4; i++) {
+    out[7 + i] = (uint8_t)(ack.bitmap >> (8 * i));
+  }
+  return LORA_ACK_SIZE;
+}
+
+inline bool unpackLoRaAck(const uint8_t *in, size_t len, LoRaAck *ack) {
+  if (len < LORA_ACK_SIZE) {
+    return false;
+  }
+  ack->source = (uint16_t)((in[0] << 8) | in[1]);
+  ack->destination = (uint16_t)((in[2] << 8) | in[3]);
+  ack->session = in[4];
+  ack->next = (uint16_t)(in[5] | (in[6] << 8));
+  ack->bitmap = 0;
+  for (int i = 0; i < 4; i++) {
+    ack->bitmap |= (uint32_t)in[7 + i] << (8 * i);
+  }
+  return true;
+}
+
+struct LoRaReliableStats {
+  uint32_t queued = 0;
+  uint32_t transmissions = 0;
+  uint32_t retransmissions = 0;
+  uint32_t acked = 0;
+  uint32_t dropped = 0;       // Gave up after maxAttempts
+  uint32_t srttMs = 0;        // Smoothed round-trip time from first-attempt ACKs
+  LoRaLatencyHistogram rtt;   // Same samples, for mean and tail latency
+};
+
+// Sender side for one destination: up to WINDOW frames in flight, each
+// retransmitted with exponential backoff until it is acknowledged (cumulatively
+// or selectively) or runs out of attempts. Callers provide the locking.
+template <size_t WINDOW>
+class LoRaReliableSender {
+  static_assert(WINDOW > 0 && WINDOW <= LORA_SACK_BITS / 2, "Window must fit the selective-ACK bitmap");
+
+ public:
+  struct Params {
+    uint32_t rtoMinMs;     // Initial and minimum retransmission timeout
+    uint32_t rtoMaxMs;     // Backoff cap
+    uint8_t maxAttempts;
+  };
+
+  LoRaReliableSender(uint16_t source, uint8_t session, const Params &params)
+      : source_(source), session_(session), params_(params), rtoMs_(params.rtoMinMs), rng_(session * 2654435761u | 1) {}
+
+  void setSource(uint16_t source) { source_ = source; }
+  uint8_t session() const { return session_; }
+
+  // True if another frame can be queued without overrunning the receiver's SACK window
+  bool canQueue() const {
+    const Pending *oldest = nullptr;
+    size_t used = 0;
+    for (size_t i = 0; i < WINDOW; i++) {
+      if (pending_[i].used) {
+        used++;
+        if (oldest == nullptr || (int16_t)(pending_[i].sequence - oldest->sequence) < 0) {
+          oldest = &pending_[i];
+        }
+      }
+    }
+    return used < WINDOW && (oldest == nullptr || (uint16_t)(nextSequence_ - oldest->sequence) < LORA_SACK_BITS);
+  }
+
+  // Wrap an inner frame and queue it for the next poll(); returns false if the window is full
+  bool queue(uint8_t type, const uint8_t *payload, size_t length, uint32_t nowMs) {
+    if (length > LORA_RELIABLE_MAX_PAYLOAD || !canQueue()) {
+      return false;
+    }
+    for (size_t i = 0; i < WINDOW; i++) {
+      Pending &slot = pending_[i];
+      if (slot.used) {
+        continue;
+      }
+      uint8_t body[LORA_MAX_FRAME_PAYLOAD];
+      body[0] = (uint8_t)(source_ >> 8);
+      body[1] = (uint8_t)(source_ & 0xFF);
+      body[2] = session_;
+      body[3] = (uint8_t)(nextSequence_ & 0xFF);
+      body[4] = (uint8_t)(nextSequence_ >> 8);
+      body[5] = type;
+      for (size_t b = 0; b < length; b++) {
+        body[LORA_RELIABLE_HEADER_SIZE + b] = payload[b];
+      }
+      slot.length = (uint8_t)encodeLoRaFrame(slot.frame, LORA_FRAME_RELIABLE, body, length + LORA_RELIABLE_HEADER_SIZE);
+      slot.used = true;
+      slot.sequence = nextSequence_++;
+      slot.attempts = 0;
+      slot.firstSentMs = 0;
+      slot.dueMs = nowMs;
+      stats.queued++;
+      return true;
+    }
+    return false;
+  }
+
+  // Transmit every frame that is due. send(frame, length) returns false when the
+  // frame could not go out (busy radio, duty budget), which leaves it due.
+  template <typename SendFn>
+  void poll(uint32_t nowMs, SendFn send) {
+    poll(nowMs, send, [](uint8_t, const uint8_t *, uint8_t) {});
+  }
+
+  // As above; dropped(type, payload, length) gets the inner frame of each frame
+  // given up after maxAttempts, so the caller can carry its content forward.
+  // The frame may still have arrived with only its ACKs lost.
+  template <typename SendFn, typename DropFn>
+  void poll(uint32_t nowMs, SendFn send, DropFn dropped) {
+    for (size_t i = 0; i < WINDOW; i++) {
+      Pending &slot = pending_[i];
+      if (!slot.used || (int32_t)(nowMs - slot.dueMs) < 0) {
+        continue;
+      }
+      if (slot.attempts >= params_.maxAttempts) {
+        slot.used = false;
+        stats.dropped++;
+        const uint8_t *body = slot.frame + 3;  // Past the link header, see encodeLoRaFrame
+        dropped(body[5], body + LORA_RELIABLE_HEADER_SIZE, (uint8_t)(slot.frame[2] - LORA_RELIABLE_HEADER_SIZE));
+        continue;
+      }
+      if (!send(slot.frame, slot.length)) {
+        return;  // Later slots would fail the same way
+      }
+      if (slot.attempts == 0) {
+        slot.firstSentMs = nowMs;
+      } else {
+        stats.retransmissions++;
+      }
+      stats.transmissions++;
+      slot.attempts++;
+      uint32_t backoff = rtoMs_ << (slot.attempts - 1);
+      if (backoff > params_.rtoMaxMs || backoff < rtoMs_) {
+        backoff = params_.rtoMaxMs;
+      }
+      slot.dueMs = nowMs + backoff + jitter(backoff / 4);
+      // The receiver answers a burst once the channel goes quiet, so no frame
+      // already in flight may time out before this one could be acknowledged
+      for (size_t j = 0; j < WINDOW; j++) {
+        Pending &other = pending_[j];
+        if (j != i && other.used && other.attempts > 0 && (int32_t)(other.dueMs - (nowMs + rtoMs_)) < 0) {
+          other.dueMs = nowMs + rtoMs_;
+        }
+      }
+    }
+  }
+
+  // Release every frame the ACK covers
+  void onAck(const LoRaAck &ack, uint32_t nowMs) {
+    if (ack.destination != source_ || ack.session != session_) {
+      return;
+    }
+    // Highest sequence (relative to ack.next) the receiver has seen; anything
+    // unacknowledged below it was lost, since the link does not reorder
+    int16_t highest = 0;
+    for (int bit = LORA_SACK_BITS - 1; bit >= 0; bit--) {
+      if (ack.bitmap & (1UL << bit)) {
+        highest = (int16_t)(bit + 1);
+        break;
+      }
+    }
+    for (size_t i = 0; i < WINDOW; i++) {
+      Pending &slot = pending_[i];
+      if (!slot.used || slot.attempts == 0) {
+        continue;
+      }
+      int16_t distance = (int16_t)(slot.sequence - ack.next);
+      bool covered = distance < 0 || (distance > 0 && distance <= LORA_SACK_BITS &&
+                                      (ack.bitmap & (1UL << (distance - 1))) != 0);
+      if (!covered) {
+        if (distance < highest) {
+          slot.dueMs = nowMs;  // Hole in the selective ACK: resend now instead of waiting for the timeout
+        }
+        continue;
+      }
+      if (slot.attempts == 1) {
+        // Karn's rule: only unambiguous samples update the RTT estimate
+        uint32_t sample = nowMs - slot.firstSentMs;
+        stats.rtt.record(sample);
+        stats.srttMs = stats.srttMs == 0 ? sample : (stats.srttMs * 7 + sample) / 8;
+        rtoMs_ = 2 * stats.srttMs < params_.rtoMinMs ? params_.rtoMinMs : 2 * stats.srttMs;
+      }
+      slot.used = false;
+      stats.acked++;
+    }
+  }
+
+  size_t inFlight() const {
+    size_t n = 0;
+    for (size_t i = 0; i < WINDOW; i++) {
+      n += pending_[i].used ? 1 : 0;
+    }
+    return n;
+  }
+
+  LoRaReliableStats stats;
+
+ private:
+  struct Pending {
+    bool used;
+    uint16_t sequence;
+    uint8_t attempts;
+    uint8_t length;
+    uint32_t firstSentMs;
+    uint32_t dueMs;
+    uint8_t frame[LORA_MAX_PACKET_SIZE];
+  };
+
+  // Spread retries so nodes that collided do not collide again
+  uint32_t jitter(uint32_t range) {
+    rng_ ^= rng_ << 13;
+    rng_ ^= rng_ >> 17;
+    rng_ ^= rng_ << 5;
+    return range > 0 ? rng_ % range : 0;
+  }
+
+  uint16_t source_;
+  uint8_t session_;
+  Params params_;
+  uint32_t rtoMs_;
+  uint32_t rng_;
+  uint16_t nextSequence_ = 0;
+  Pending pending_[WINDOW] = {};
+};
+
+enum LoRaReliableResult {
+  LORA_RELIABLE_NEW,
+  LORA_RELIABLE_DUPLICATE,  // Already delivered, only needs another ACK
+  LORA_RELIABLE_REJECTED    // Malformed or no room to track the sender
+};
+
+// Receiver side: per-sender receive window in a fixed-capacity hash table keyed
+// by sender address (same scheme as LoRaNodeTable). Decides whether a frame is
+// new and builds the selective ACK to send back.
+template <size_t CAPACITY>
+class LoRaReliableReceiver {
+  static_assert((CAPACITY & (CAPACITY - 1)) == 0, "Receiver capacity must be a power of two");
+
+ public:
+  // Parses a LORA_FRAME_RELIABLE payload. On NEW/DUPLICATE the inner frame and the
+  // ACK to send are filled in; only NEW frames should be delivered.
+  LoRaReliableResult accept(const uint8_t *payload, uint8_t length, uint16_t self, uint8_t *innerType,
+                            const uint8_t **inner, uint8_t *innerLength, LoRaAck *ack) {
+    if (length < LORA_RELIABLE_HEADER_SIZE) {
+      return LORA_RELIABLE_REJECTED;
+    }
+    uint16_t source = (uint16_t)((payload[0] << 8) | payload[1]);
+    uint8_t session = payload[2];
+    uint16_t sequence = (uint16_t)(payload[3] | (payload[4] << 8));
+    Window *window = findOrInsert(source);
+    if (window == nullptr) {
+      return LORA_RELIABLE_REJECTED;
+    }
+    bool isNew = window->apply(session, sequence);
+    *innerType = payload[5];
+    *inner = payload + LORA_RELIABLE_HEADER_SIZE;
+    *innerLength = (uint8_t)(length - LORA_RELIABLE_HEADER_SIZE);
+    ack->source = self;
+    ack->destination = source;
+    ack->session = session;
+    ack->next = window->next;
+    ack->bitmap = window->bitmap;
+    return isNew ? LORA_RELIABLE_NEW : LORA_RELIABLE_DUPLICATE;
+  }
+
+  size_t size() const { return size_; }
+
+ private:
+  struct Window {
+    bool used;
+    bool started;
+    uint16_t address;
+    uint8_t session;
+    uint16_t next;    // Lowest sequence not yet received
+    uint32_t bitmap;  // Bit i: next + 1 + i received
+
+    bool apply(uint8_t frameSession, uint16_t sequence) {
+      if (!started || session != frameSession) {
+        // First frame or restarted sender: start a fresh window at this frame
+        started = true;
+        session = frameSession;
+        next = (uint16_t)(sequence + 1);
+        bitmap = 0;
+        return true;
+      }
+      int16_t distance = (int16_t)(sequence - next);
+      if (distance < 0) {
+        return false;
+      }
+      if (distance == 0) {
+        next++;
+        while (bitmap & 1) {
+          bitmap >>= 1;
+          next++;
+        }
+        bitmap >>= 1;
+        return true;
+      }
+      if (distance > LORA_SACK_BITS) {
+        // Far beyond the window the sender may use; treat as a resync
+        next = (uint16_t)(sequence + 1);
+        bitmap = 0;
+        return true;
+      }
+      uint32_t bit = 1UL << (distance - 1);
+      if (bitmap & bit) {
+        return false;
+      }
+      bitmap |= bit;
+      return true;
+    }
+  };
+
+  static size_t hash(uint16_t address) {
+    return (size_t)((address * 2654435761u) >> 16) & (CAPACITY - 1);
+  }
+
+  Window *findOrInsert(uint16_t address) {
+    size_t slot = hash(address);
+    for (size_t probe = 0; probe < CAPACITY; probe++) {
+      Window &window = windows_[(slot + probe) & (CAPACITY - 1)];
+      if (window.used && window.address == address) {
+        return &window;
+      }
+      if (!window.used) {
+        window = Window();
+        window.used = true;
+        window.address = address;
+        size_++;
+        return &window;
+      }
+    }
+    return nullptr;
+  }
+
+  Window windows_[CAPACITY] = {};
+  size_t size_ = 0;
+};
+
+#endif
@@ -0,0 +1,211 @@
+#ifndef LORA_TELEMETRY_H
+#define LORA_TELEMETRY_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Counter report frame carried over the E32 (multi-byte fields little-endian):
+//   [0] ADDH  [1] ADDL  [2] session  [3..4] sequence
+//   [5] flags: bits 0-3 changed-counter mask, bit 7 I/O state follows
+//   then one zigzag LEB128 varint delta per bit set in the mask
+//   then, if flagged, the I/O state as a uint16 (inputs in bits 0-7, outputs in bits 8-15)
+// The session byte is picked at boot, so a gateway can tell a node that
+// restarted its sequence numbers from a retransmission.
+// Deltas are signed. After a counter reset the delta is the new count minus the
+// old one, so it costs as many bytes as the old count (up to 5); the gateway
+// total still comes out right.
+const uint8_t LORA_MAX_PACKET_SIZE = 58;   // E32 sub-packet size
+const uint8_t LORA_REPORT_COUNTERS = 4;
+const uint8_t LORA_REPORT_HEADER_SIZE = 6;
+const uint8_t LORA_REPORT_FLAG_IO = 0x80;
+const uint8_t LORA_REPORT_MAX_SIZE = LORA_REPORT_HEADER_SIZE + LORA_REPORT_COUNTERS * 5 + 2;
+
+struct CounterReport {
+  uint16_t address;   // ADDH << 8 | ADDL of the sender
+  uint8_t session;
+  uint16_t sequence;
+  int32_t deltas[LORA_REPORT_COUNTERS];
+  bool hasIo;
+  uint16_t ioState;
+};
+
+// Write an unsigned LEB128 varint, returns bytes written (max 5)
+inline size_t writeVarint(uint8_t *out, uint32_t value) {
+  size_t n = 0;
+  while (value >= 0x80) {
+    out[n++] = (uint8_t)(value | 0x80);
+    value >>= 7;
+  }
+  out[n++] = (uint8_t)value;
+  return n;
+}
+
+// Read an unsigned LEB128 varint, returns bytes consumed or 0 on truncated input
+inline size_t readVarint(const uint8_t *in, size_t len, uint32_t *value) {
+  uint32_t result = 0;
+  for (size_t n = 0; n < len && n < 5; n++) {
+    result |= (uint32_t)(in[n] & 0x7F) << (7 * n);
+    if ((in[n] & 0x80) == 0) {
+      *value = result;
+      return n + 1;
+    }
+  }
+  return 0;
+}
+
+// Zigzag mapping keeps small negative numbers small: 0, -1, 1, -2 -> 0, 1, 2, 3
+inline uint32_t zigzagEncode(int32_t value) {
+  return ((uint32_t)value << 1) ^ (uint32_t)(value >> 31);
+}
+
+inline int32_t zigzagDecode(uint32_t value) {
+  return (int32_t)(value >> 1) ^ -(int32_t)(value & 1);
+}
+
+// Pack a counter report (out needs LORA_REPORT_MAX_SIZE bytes); zero deltas are left out of the mask
+inline size_t packCounterReport(uint8_t *out, const CounterReport &report) {
+  size_t n = 0;
+  out[n++] = (uint8_t)(report.address >> 8);
+  out[n++] = (uint8_t)(report.address & 0xFF);
+  out[n++] = report.session;
+  out[n++] = (uint8_t)(report.sequence & 0xFF);
+  out[n++] = (uint8_t)(report.sequence >> 8);
+  uint8_t &flags = out[n++];
+  flags = report.hasIo ? LORA_REPORT_FLAG_IO : 0;
+  for (uint8_t i = 0; i < LORA_REPORT_COUNTERS; i++) {
+    if (report.deltas[i] != 0) {
+      flags |= (uint8_t)(1 << i);
+      n += writeVarint(out + n, zigzagEncode(report.deltas[i]));
+    }
+  }
+  if (report.hasIo) {
+    out[n++] = (uint8_t)(report.ioState & 0xFF);
+    out[n++] = (uint8_t)(report.ioState >> 8);
+  }
+  return n;
+}
+
+// Parse a counter report; counters missing from the mask get a zero delta
+inline bool unpackCounterReport(const uint8_t *in, size_t len, CounterReport *report) {
+  if (len < LORA_REPORT_HEADER_SIZE) {
+    return false;
+  }
+  report->address = (uint16_t)((in[0] << 8) | in[1]);
+  report->session = in[2];
+  report->sequence = (uint16_t)(in[3] | (in[4] << 8));
+  uint8_t flags = in[5];
+  size_t n = LORA_REPORT_HEADER_SIZE;
+  for (uint8_t i = 0; i < LORA_REPORT_COUNTERS; i++) {
+    report->deltas[i] = 0;
+    if (flags & (1 << i)) {
+      uint32_t value;
+      size_t used = readVarint(in + n, len - n, &value);
+      if (used == 0) {
+        return false;
+      }
+      report->deltas[i] = zigzagDecode(value);
+      n += used;
+    }
+  }
+  report->hasIo = (flags & LORA_REPORT_FLAG_IO) != 0;
+  report->ioState = 0;
+  if (report->hasIo) {
+    if (len - n < 2) {
+      return false;
+    }
+    report->ioState = (uint16_t)(in[n] | (in[n + 1] << 8));
+  }
+  return true;
+}
+
+// Node side: counter values and I/O state already handed to the link. Each
+// report carries the difference to these, so the gateway total is the sum of
+// the reports it applies.
+struct CounterReportBase {
+  uint32_t counts[LORA_REPORT_COUNTERS] = {};
+  int32_t ioState = -1;  // -1 before the first report
+
+  // Fill the deltas and I/O fields of a report; false if nothing changed
+  bool diff(const uint32_t *snapshot, uint16_t io, CounterReport *report) const {
+    bool changed = false;
+    for (uint8_t i = 0; i < LORA_REPORT_COUNTERS; i++) {
+      // Negative when the counter was reset since the last report
+      report->deltas[i] = (int32_t)(snapshot[i] - counts[i]);
+      changed |= report->deltas[i] != 0;
+    }
+    report->hasIo = (int32_t)io != ioState;
+    report->ioState = io;
+    return changed || report->hasIo;
+  }
+
+  // The report built by diff() was accepted by the link
+  void commit(const uint32_t *snapshot, uint16_t io) {
+    for (uint8_t i = 0; i < LORA_REPORT_COUNTERS; i++) {
+      counts[i] = snapshot[i];
+    }
+    ioState = io;
+  }
+
+  // The link gave up on a report: its deltas go out again with the next one
+  void fold(const CounterReport &dropped) {
+    for (uint8_t i = 0; i < LORA_REPORT_COUNTERS; i++) {
+      counts[i] -= (uint32_t)dropped.deltas[i];
+    }
+    if (dropped.hasIo) {
+      ioState = -1;
+    }
+  }
+};
+
+// Nominal air data rate in bits/s for the E32 SPED.airDataRate field
+constexpr uint32_t airDataRateBpsTable[8] = {300, 1200, 2400, 4800, 9600, 19200, 19200, 19200};
+
+inline uint32_t airDataRateBps(uint8_t airDataRate) {
+  return airDataRateBpsTable[airDataRate & 0x07];
+}
+
+// UART rate in baud for the E32 SPED.uartBaudRate field
+constexpr uint32_t uartBaudRateTable[8] = {1200, 2400, 4800, 9600, 19200, 38400, 57600, 115200};
+
+inline uint32_t uartBaudRateBps(uint8_t uartBaudRate) {
+  return uartBaudRateTable[uartBaudRate & 0x07];
+}
+
+// On-air cost of a packet beyond its UART bytes: preamble, LoRa header and CRC,
+// modelled as extra bytes at the nominal rate. With FEC on every 4 data bits
+// carry one parity bit.
+const uint8_t LORA_AIR_OVERHEAD_BYTES = 6;
+const uint8_t LORA_AIR_MAX_BYTES = LORA_MAX_PACKET_SIZE + 3;  // Sub-packet plus fixed-mode address header
+
+constexpr uint32_t computeAirTimeMs(uint8_t airDataRate, uint8_t fec, size_t bytes) {
+  return (uint32_t)(((bytes + LORA_AIR_OVERHEAD_BYTES) * 8 * (fec ? 5 : 4) * 1000 / 4 +
+                     airDataRateBpsTable[airDataRate & 0x07] - 1) /
+                    airDataRateBpsTable[airDataRate & 0x07]);
+}
+
+// Air time in ms for every (airDataRate, fec, bytes on air) combination, built at compile time
+struct LoRaAirTimeTable {
+  uint16_t ms[8][2][LORA_AIR_MAX_BYTES + 1];
+
+  constexpr LoRaAirTimeTable() : ms() {
+    for (uint8_t rate = 0; rate < 8; rate++) {
+      for (uint8_t fec = 0; fec < 2; fec++) {
+        for (size_t bytes = 0; bytes <= LORA_AIR_MAX_BYTES; bytes++) {
+          ms[rate][fec][bytes] = (uint16_t)computeAirTimeMs(rate, fec, bytes);
+        }
+      }
+    }
+  }
+};
+constexpr LoRaAirTimeTable loraAirTimeTable;
+static_assert(computeAirTimeMs(0, 1, LORA_AIR_MAX_BYTES) <= 0xFFFF, "Slowest air time must fit in uint16_t");
+
+// Channel occupancy of a packet in ms, rounded up
+inline uint32_t estimateAirTimeMs(uint8_t airDataRate, uint8_t fec, size_t bytes) {
+  if (bytes > LORA_AIR_MAX_BYTES) {
+    return computeAirTimeMs(airDataRate, fec, bytes);
+  }
+  return loraAirTimeTable.ms[airDataRate & 0x07][fec ? 1 : 0][bytes];
+}
+
+#endif
@@ -0,0 +1,98 @@
+// Host-side walkthrough of the E32 simulator: programs two modules through
+// their Stream interface, then sends fixed-transmission packets between them
+// and prints config latency and packet latency/throughput.
+//
+// Build and run on Linux:
+//   g++ -std=c++17 -O2 -Ilib/E32Simulator/src -o host_loopback lib/E32Simulator/src/E32Simulator.cpp lib/E32Simulator/examples/host_loopback/host_loopback.cpp
+//   ./host_loopback
+
+#include <stdio.h>
+#include "E32Simulator.h"
+
+// Run the simulation until `count` bytes can be read or the timeout expires
+static bool waitForBytes(E32SimAir &air, E32SimModule &module, int count, uint64_t timeoutUs) {
+  uint64_t deadline = air.now() + timeoutUs;
+  while (module.available() < count) {
+    if (air.now() >= deadline) {
+      return false;
+    }
+    air.advance(100);
+  }
+  return true;
+}
+
+// Write a full register image with C0 (saved) and wait for the echo
+static uint64_t programModule(E32SimAir &air, E32SimModule &module, uint8_t addh, uint8_t addl, uint8_t sped,
+                              uint8_t chan, uint8_t option) {
+  module.setMode(3);
+  module.setHostBaud(9600);
+  air.advance(60000);
+  uint64_t start = air.now();
+  const uint8_t command[6] = {0xC0, addh, addl, sped, chan, option};
+  module.write(command, sizeof(command));
+  if (!waitForBytes(air, module, 6, 1000000)) {
+    printf("%s: no reply to C0\n", module.name());
+  }
+  uint64_t latency = air.now() - start;
+  while (module.available() > 0) {
+    module.read();
+  }
+  module.setMode(0);
+  module.setHostBaud(module.registers().uartBaud());
+  air.advance(60000);
+  return latency;
+}
+
+int main() {
+  E32SimAir air(42);
+  E32SimModule node(air, "node");
+  E32SimModule gateway(air, "gateway");
+
+  // SPED 0x1A: 8N1, 9600 baud, 2.4k air; OPTION 0xC4: fixed transmission, push-pull, FEC on
+  uint64_t nodeConfigUs = programModule(air, node, 0x00, 0x02, 0x1A, 0x17, 0xC4);
+  uint64_t gatewayConfigUs = programModule(air, gateway, 0x00, 0x01, 0x1A, 0x17, 0xC4);
+  printf("Config write + echo: node %.1f ms, gateway %.1f ms\n", nodeConfigUs / 1000.0, gatewayConfigUs / 1000.0);
+
+  // Read module information (C3 C3 C3)
+  node.setMode(3);
+  node.setHostBaud(9600);
+  air.advance(60000);
+  const uint8_t info[3] = {0xC3, 0xC3, 0xC3};
+  node.write(info, sizeof(info));
+  if (waitForBytes(air, node, 4, 1000000)) {
+    printf("Module info:");
+    while (node.available() > 0) {
+      printf(" %02X", node.read());
+    }
+    printf("\n");
+  }
+  node.setMode(0);
+  node.setHostBaud(node.registers().uartBaud());
+  air.advance(60000);
+
+  const int packets = 20;
+  const int payloadSize = 20;
+  uint64_t totalLatency = 0;
+  uint64_t start = air.now();
+  int delivered = 0;
+  for (int p = 0; p < packets; p++) {
+    uint64_t sent = air.now();
+    uint8_t frame[3 + payloadSize] = {0x00, 0x01, 0x17};  // Target ADDH, ADDL, CHAN
+    for (int i = 0; i < payloadSize; i++) {
+      frame[3 + i] = (uint8_t)(p + i);
+    }
+    node.write(frame, sizeof(frame));
+    if (waitForBytes(air, gateway, payloadSize, 2000000)) {
+      totalLatency += air.now() - sent;
+      delivered++;
+      while (gateway.available() > 0) {
+        gateway.read();
+      }
+    }
+  }
+  double seconds = (air.now() - start) / 1e6;
+  printf("Delivered %d/%d packets of %d bytes, mean latency %.1f ms, goodput %.0f bit/s\n", delivered, packets,
+         payloadSize, delivered ? totalLatency / 1000.0 / delivered : 0.0, delivered * payloadSize * 8 / seconds);
+  printf("Node air time %.1f ms, EEPROM writes %u\n", node.stats.airTimeUs / 1000.0, node.stats.eepromWrites);
+  return 0;
+}
@@ -0,0 +1,134 @@
+// Encoded counter report size (lora_telemetry.h) over four days of simulated
+// production at the rates a counter node sees: an idle line, ~1, ~10 and ~100
+// parts/s. Each trace has two 8-hour shifts a day with a break, random
+// stoppages, an operator reset of all counters at the start of each shift and
+// a run input and a shift lamp output that follow the line. Reports are built
+// every LORA_REPORT_INTERVAL the way sendLoRaCounterReport() does, so an idle
+// interval sends nothing.
+//
+// Build and run on Linux from the project root:
+//   g++ -std=c++17 -O2 -Iinclude -Ilib/E32Simulator/src -o report_size lib/E32Simulator/examples/report_size/report_size.cpp
+//   ./report_size
+
+#include <stdio.h>
+#include <algorithm>
+#include <vector>
+#include "lora_link.h"
+#include "lora_reliable.h"
+#include "lora_telemetry.h"
+
+const uint32_t DAYS = 4;
+const uint32_t REPORT_INTERVAL_S = 30;                 // LORA_REPORT_INTERVAL
+const uint8_t AIR_DATA_RATE = 0x02;                    // 2.4k, the default SPED
+const size_t FIXED_HEADER = 3;                         // ADDH, ADDL, CHAN in fixed transmission
+const size_t RAW_REPORT = 2 + 1 + 2 + 4 * 4 + 2;       // Address, session, sequence, uint32 counts, I/O
+
+// xorshift32, so every run sees the same traces
+static uint32_t rngState = 0x1234567;
+static uint32_t nextRandom() {
+  rngState ^= rngState << 13;
+  rngState ^= rngState >> 17;
+  rngState ^= rngState << 5;
+  return rngState;
+}
+static double uniform() { return (nextRandom() >> 8) / 16777216.0; }
+
+struct Profile {
+  const char *name;
+  double partsPerSecond;  // Counter 1 while the line runs
+};
+
+// Counter 1 counts good parts, counter 2 rejects (~2%), counter 3 a second
+// station at half the rate and counter 4 pallets of 50
+static const double COUNTER_SHARE[LORA_REPORT_COUNTERS] = {1.0, 0.02, 0.5, 0.02};
+
+struct Result {
+  uint32_t reports;
+  uint64_t bytes;
+  size_t maxBytes;
+  size_t p95Bytes;
+  uint64_t airMs;
+};
+
+static Result run(const Profile &profile) {
+  CounterReportBase base;
+  uint32_t counts[LORA_REPORT_COUNTERS] = {};
+  double pending[LORA_REPORT_COUNTERS] = {};
+  uint32_t stoppedUntil = 0;
+  std::vector<size_t> sizes;
+  Result result = {};
+  uint16_t sequence = 0;
+
+  for (uint32_t t = 0; t < DAYS * 86400; t++) {
+    uint32_t daySecond = t % 86400;
+    bool shift = daySecond >= 6 * 3600 && daySecond < 22 * 3600;
+    bool onBreak = (daySecond >= 10 * 3600 && daySecond < 10 * 3600 + 1800) ||
+                   (daySecond >= 18 * 3600 && daySecond < 18 * 3600 + 1800);
+    if (daySecond == 6 * 3600 || daySecond == 14 * 3600) {
+      for (uint8_t i = 0; i < LORA_REPORT_COUNTERS; i++) {
+        counts[i] = 0;  // resetAllCounters() at the start of each shift
+      }
+    }
+    // About one stoppage an hour, 1-10 minutes long
+    if (shift && !onBreak && t >= stoppedUntil && nextRandom() % 3600 == 0) {
+      stoppedUntil = t + 60 + nextRandom() % 540;
+    }
+    bool running = shift && !onBreak && t >= stoppedUntil && profile.partsPerSecond > 0;
+    if (running) {
+      for (uint8_t i = 0; i < LORA_REPORT_COUNTERS; i++) {
+        // +-20% jitter around the nominal rate, fractions carried to the next second
+        pending[i] += profile.partsPerSecond * COUNTER_SHARE[i] * (0.8 + 0.4 * uniform());
+        uint32_t whole = (uint32_t)pending[i];
+        counts[i] += whole;
+        pending[i] -= whole;
+      }
+    }
+    // Inputs: bit 0 line running. Outputs: bit 0 shift lamp.
+    uint16_t io = (uint16_t)((running ? 0x0001 : 0) | (shift ? 0x0100 : 0));
+
+    if ((t + 1) % REPORT_INTERVAL_S != 0) {
+      continue;
+    }
+    CounterReport report = {};
+    report.address = 0x0002;
+    report.session = 0x5A;
+    report.sequence = sequence;
+    if (!base.diff(counts, io, &report)) {
+      continue;
+    }
+    base.commit(counts, io);
+    sequence++;
+    uint8_t payload[LORA_REPORT_MAX_SIZE];
+    size_t length = packCounterReport(payload, report);
+    sizes.push_back(length);
+    result.reports++;
+    result.bytes += length;
+    result.maxBytes = std::max(result.maxBytes, length);
+    size_t onAir = FIXED_HEADER + LORA_FRAME_OVERHEAD + LORA_RELIABLE_HEADER_SIZE + length;
+    result.airMs += estimateAirTimeMs(AIR_DATA_RATE, 1, onAir);
+  }
+  if (!sizes.empty()) {
+    std::sort(sizes.begin(), sizes.end());
+    result.p95Bytes = sizes[sizes.size() * 95 / 100];
+  }
+  return result;
+}
+
+int main() {
+  const Profile profiles[] = {{"idle", 0.0}, {"~1 part/s", 1.0}, {"~10 parts/s", 10.0}, {"~100 parts/s", 100.0}};
+  const uint32_t intervals = DAYS * 86400 / REPORT_INTERVAL_S;
+  size_t rawOnAir = FIXED_HEADER + LORA_FRAME_OVERHEAD + LORA_RELIABLE_HEADER_SIZE + RAW_REPORT;
+  printf("%u days, a report every %u s at most (%u intervals), 2.4k air rate with FEC\n", (unsigned)DAYS,
+         (unsigned)REPORT_INTERVAL_S, (unsigned)intervals);
+  printf("Raw struct: %u B payload, %u ms on air per report\n\n", (unsigned)RAW_REPORT,
+         (unsigned)estimateAirTimeMs(AIR_DATA_RATE, 1, rawOnAir));
+  printf("  %-14s %8s %8s %5s %5s %12s %10s\n", "trace", "reports", "mean B", "p95", "max", "ms/report", "air s/day");
+  for (const Profile &profile : profiles) {
+    Result r = run(profile);
+    double mean = r.reports ? (double)r.bytes / r.reports : 0.0;
+    double airPerReport = r.reports ? (double)r.airMs / r.reports : 0.0;
+    printf("  %-14s %8u %8.1f %5u %5u %12.1f %10.1f\n", profile.name, (unsigned)r.reports, mean,
+           (unsigned)r.p95Bytes, (unsigned)r.maxBytes, airPerReport, r.airMs / 1000.0 / DAYS);
+  }
+  return 0;
+}
@@ -0,0 +1,112 @@
+// End-to-end frame latency between two simulated E32s for every UART rate the
+// module supports, at a slow and a fast air rate. Both modules are programmed
+// at 9600 baud in MODE_3 and the host side then follows them to the configured
+// rate, the same sequence the firmware's syncLoRaUart() goes through.
+//
+// Build and run on Linux from the project root:
+//   g++ -std=c++17 -O2 -Iinclude -Ilib/E32Simulator/src -o uart_baud lib/E32Simulator/src/E32Simulator.cpp lib/E32Simulator/examples/uart_baud/uart_baud.cpp
+//   ./uart_baud
+
+#include <stdio.h>
+#include "E32Simulator.h"
+#include "lora_telemetry.h"
+
+const uint16_t NODE_ADDRESS = 0x0002;
+const uint16_t GATEWAY_ADDRESS = 0x0001;
+const uint8_t CHANNEL = 0x17;
+const int FRAMES = 20;
+const size_t LARGE_FRAME = 55;  // Fills a 58-byte sub-packet together with the fixed-mode header
+const uint64_t STEP_US = 50;
+
+static bool waitForBytes(E32SimAir &air, E32SimModule &module, int count, uint64_t timeoutUs) {
+  uint64_t deadline = air.now() + timeoutUs;
+  while (module.available() < count) {
+    if (air.now() >= deadline) {
+      return false;
+    }
+    air.advance(STEP_US);
+  }
+  return true;
+}
+
+// Program fixed transmission with the given SPED byte, then follow the module to its UART rate
+static bool configure(E32SimAir &air, E32SimModule &module, uint16_t address, uint8_t sped) {
+  module.setMode(3);
+  module.setHostBaud(9600);
+  air.advance(60000);
+  const uint8_t command[6] = {0xC0, (uint8_t)(address >> 8), (uint8_t)(address & 0xFF), sped, CHANNEL, 0xC4};
+  module.write(command, sizeof(command));
+  bool ok = waitForBytes(air, module, 6, 1000000);
+  while (module.available() > 0) {
+    module.read();
+  }
+  module.setMode(0);
+  module.setHostBaud(uartBaudRateBps(sped >> 3));
+  air.advance(60000);
+  return ok;
+}
+
+struct Result {
+  int delivered;
+  double meanMs;
+  double goodputBps;
+  uint32_t uartErrors;
+};
+
+// Send FRAMES frames of `size` bytes one at a time, each as soon as the previous one arrived
+static Result run(uint8_t uartCode, uint8_t airCode, size_t size) {
+  E32SimAir air(7);
+  E32SimModule node(air, "node");
+  E32SimModule gateway(air, "gateway");
+  uint8_t sped = (uint8_t)((uartCode << 3) | airCode);
+  configure(air, node, NODE_ADDRESS, sped);
+  configure(air, gateway, GATEWAY_ADDRESS, sped);
+
+  Result result = {0, 0.0, 0.0, 0};
+  uint64_t totalUs = 0;
+  uint64_t start = air.now();
+  for (int f = 0; f < FRAMES; f++) {
+    uint8_t frame[3 + LARGE_FRAME] = {(uint8_t)(GATEWAY_ADDRESS >> 8), (uint8_t)(GATEWAY_ADDRESS & 0xFF),
+                                               CHANNEL};
+    for (size_t i = 0; i < size; i++) {
+      frame[3 + i] = (uint8_t)(f + i);
+    }
+    uint64_t sent = air.now();
+    node.write(frame, 3 + size);
+    if (waitForBytes(air, gateway, (int)size, 10000000)) {
+      totalUs += air.now() - sent;
+      result.delivered++;
+    }
+    while (gateway.available() > 0) {
+      gateway.read();
+    }
+    air.advance(20000);  // Let AUX settle between frames
+  }
+  double seconds = (air.now() - start) / 1e6;
+  result.meanMs = result.delivered ? totalUs / 1000.0 / result.delivered : 0.0;
+  result.goodputBps = result.delivered * size * 8 / seconds;
+  result.uartErrors = node.stats.uartErrors + gateway.stats.uartErrors;
+  return result;
+}
+
+int main() {
+  const uint8_t airCodes[2] = {0x02, 0x05};  // 2.4k and 19.2k air rate
+  const size_t sizes[2] = {12, LARGE_FRAME};
+  for (uint8_t a = 0; a < 2; a++) {
+    printf("Air rate %u bit/s\n", (unsigned)airDataRateBps(airCodes[a]));
+    printf("  %7s  %22s  %22s\n", "UART", "12 B frame: ms, bit/s", "55 B frame: ms, bit/s");
+    for (uint8_t uart = 0; uart < 8; uart++) {
+      printf("  %7u", (unsigned)uartBaudRateBps(uart));
+      for (size_t s = 0; s < 2; s++) {
+        Result r = run(uart, airCodes[a], sizes[s]);
+        if (r.delivered != FRAMES || r.uartErrors != 0) {
+          printf("  %10s %2d/%d lost %u", "", FRAMES - r.delivered, FRAMES, r.uartErrors);
+        } else {
+          printf("  %10.1f %11.0f", r.meanMs, r.goodputBps);
+        }
+      }
+      printf("\n");
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,317 @@
+#include "E32Simulator.h"
+
+#include <algorithm>
+
+namespace {
+
+const size_t E32_SIM_PACKET_SIZE = 58;            // Sub-packet size of the E32
+const size_t E32_SIM_AIR_OVERHEAD_BYTES = 6;      // Preamble, header and CRC on air
+const uint64_t E32_SIM_IDLE_BYTES = 3;            // UART idle time that closes a packet
+const uint64_t E32_SIM_MODE_SETTLE_US = 10000;
+const uint64_t E32_SIM_PROGRAM_EXIT_US = 60000;   // Self-check after leaving program mode
+const uint64_t E32_SIM_EEPROM_WRITE_US = 60000;
+const uint64_t E32_SIM_REGISTER_WRITE_US = 10000;
+const uint64_t E32_SIM_RESET_US = 60000;
+const uint64_t NEVER = UINT64_MAX;
+
+// C3 response: HEAD, frequency (0x32 = 433MHz), version, features
+const uint8_t E32_SIM_MODULE_INFO[4] = {0xC3, 0x32, 0x48, 0x14};
+
+}  // namespace
+
+uint32_t E32SimRegisters::uartBaud() const {
+  static const uint32_t rates[8] = {1200, 2400, 4800, 9600, 19200, 38400, 57600, 115200};
+  return rates[(sped >> 3) & 0x07];
+}
+
+uint32_t E32SimRegisters::airBps() const {
+  static const uint32_t rates[8] = {300, 1200, 2400, 4800, 9600, 19200, 19200, 19200};
+  return rates[sped & 0x07];
+}
+
+E32SimModule::E32SimModule(E32SimAir &air, const char *name) : air_(air), name_(name) {
+  saved_ = regs_;
+  air_.attach(this);
+}
+
+E32SimModule::~E32SimModule() {
+  air_.detach(this);
+}
+
+void E32SimModule::setPins(bool m0, bool m1) {
+  uint8_t mode = (uint8_t)((m0 ? 1 : 0) | (m1 ? 2 : 0));
+  if (mode == mode_) {
+    return;
+  }
+  uint64_t settle = (mode_ == 3) ? E32_SIM_PROGRAM_EXIT_US : E32_SIM_MODE_SETTLE_US;
+  if (mode_ == 3) {
+    command_.clear();
+  }
+  mode_ = mode;
+  busyUntil_ = std::max(busyUntil_, air_.now() + settle);
+}
+
+bool E32SimModule::aux() const {
+  uint64_t now = air_.now();
+  return now >= busyUntil_ && now >= transmittingUntil_ && packet_.empty() && fromHost_.empty();
+}
+
+void E32SimModule::powerCycle() {
+  regs_ = saved_;
+  fromHost_.clear();
+  toHost_.clear();
+  command_.clear();
+  packet_.clear();
+  busyUntil_ = air_.now() + E32_SIM_RESET_US;
+}
+
+int E32SimModule::available() {
+  uint64_t now = air_.now();
+  int count = 0;
+  for (const TimedByte &byte : toHost_) {
+    if (byte.time > now) {
+      break;
+    }
+    count++;
+  }
+  return count;
+}
+
+int E32SimModule::read() {
+  if (available() == 0) {
+    return -1;
+  }
+  uint8_t value = toHost_.front().value;
+  toHost_.pop_front();
+  return value;
+}
+
+int E32SimModule::peek() {
+  return available() > 0 ? toHost_.front().value : -1;
+}
+
+size_t E32SimModule::write(uint8_t value) {
+  uint64_t start = std::max(air_.now(), hostLineFree_);
+  hostLineFree_ = start + byteTimeUs(hostBaud_);
+  fromHost_.push_back({hostLineFree_, value});
+  return 1;
+}
+
+uint64_t E32SimModule::nextEventTime() const {
+  uint64_t next = fromHost_.empty() ? NEVER : fromHost_.front().time;
+  if (!packet_.empty()) {
+    next = std::min(next, lastPacketByte_ + E32_SIM_IDLE_BYTES * byteTimeUs(moduleBaud()));
+  }
+  return next;
+}
+
+void E32SimModule::process(uint64_t now) {
+  while (!fromHost_.empty() && fromHost_.front().time <= now) {
+    TimedByte byte = fromHost_.front();
+    fromHost_.pop_front();
+    if (hostBaud_ != moduleBaud()) {
+      stats.uartErrors++;
+      continue;
+    }
+    if (mode_ == 3) {
+      handleCommandByte(byte.value, byte.time);
+    } else if (mode_ <= 1) {
+      packet_.push_back(byte.value);
+      lastPacketByte_ = byte.time;
+      if (packet_.size() == E32_SIM_PACKET_SIZE) {
+        closePacket(byte.time);
+      }
+    }
+    // Power-saving mode does not transmit; UART input is discarded
+  }
+  if (!packet_.empty() && lastPacketByte_ + E32_SIM_IDLE_BYTES * byteTimeUs(moduleBaud()) <= now) {
+    closePacket(now);
+  }
+}
+
+void E32SimModule::handleCommandByte(uint8_t value, uint64_t now) {
+  command_.push_back(value);
+  uint8_t head = command_[0];
+
+  if (head == 0xC0 || head == 0xC2) {
+    if (command_.size() < 6) {
+      return;
+    }
+    regs_.addh = command_[1];
+    regs_.addl = command_[2];
+    regs_.sped = command_[3];
+    regs_.chan = command_[4];
+    regs_.option = command_[5];
+    stats.configWrites++;
+    uint64_t busy = E32_SIM_REGISTER_WRITE_US;
+    if (head == 0xC0) {
+      saved_ = regs_;
+      stats.eepromWrites++;
+      busy = E32_SIM_EEPROM_WRITE_US;
+    }
+    busyUntil_ = now + busy;
+    uint8_t reply[6] = {head, regs_.addh, regs_.addl, regs_.sped, regs_.chan, regs_.option};
+    respond(reply, sizeof(reply), busyUntil_);
+    command_.clear();
+    return;
+  }
+
+  if (head == 0xC1 || head == 0xC3 || head == 0xC4) {
+    if (command_.size() < 3) {
+      if (value != head) {
+        command_.clear();  // Not a repeated triple, resync
+      }
+      return;
+    }
+    if (value != head) {
+      command_.clear();
+      return;
+    }
+    if (head == 0xC1) {
+      uint8_t reply[6] = {0xC0, regs_.addh, regs_.addl, regs_.sped, regs_.chan, regs_.option};
+      respond(reply, sizeof(reply), now);
+    } else if (head == 0xC3) {
+      respond(E32_SIM_MODULE_INFO, sizeof(E32_SIM_MODULE_INFO), now);
+    } else {
+      regs_ = saved_;
+      busyUntil_ = now + E32_SIM_RESET_US;
+    }
+    command_.clear();
+    return;
+  }
+
+  command_.clear();  // Unknown command byte
+}
+
+void E32SimModule::respond(const uint8_t *data, size_t length, uint64_t at) {
+  uint64_t start = std::max(at, moduleLineFree_);
+  for (size_t i = 0; i < length; i++) {
+    start += byteTimeUs(moduleBaud());
+    if (hostBaud_ != moduleBaud()) {
+      stats.uartErrors++;
+      continue;
+    }
+    toHost_.push_back({start, data[i]});
+  }
+  moduleLineFree_ = start;
+}
+
+void E32SimModule::closePacket(uint64_t now) {
+  E32SimAir::Transmission tx;
+  tx.sender = this;
+  tx.wakeUp = mode_ == 1;
+  tx.bps = regs_.airBps();
+  tx.collided = false;
+  if (regs_.fixedTransmission()) {
+    if (packet_.size() <= 3) {
+      packet_.clear();  // Address header without payload
+      return;
+    }
+    tx.target = (uint16_t)((packet_[0] << 8) | packet_[1]);
+    tx.chan = packet_[2];
+    tx.payload.assign(packet_.begin() + 3, packet_.end());
+  } else {
+    tx.target = regs_.address();
+    tx.chan = regs_.chan;
+    tx.payload = packet_;
+  }
+  packet_.clear();
+
+  tx.start = std::max(now, transmittingUntil_);
+  uint64_t preamble = tx.wakeUp ? (uint64_t)regs_.wakeUpTimeMs() * 1000 : 0;
+  tx.end = tx.start + preamble + E32SimAir::airTimeUs(tx.payload.size(), tx.bps);
+  transmittingSince_ = tx.start;
+  transmittingUntil_ = tx.end;
+  stats.packetsSent++;
+  stats.bytesSent += (uint32_t)tx.payload.size();
+  stats.airTimeUs += tx.end - tx.start;
+  air_.transmit(tx);
+}
+
+void E32SimModule::deliver(const std::vector<uint8_t> &payload, uint64_t at) {
+  stats.packetsReceived++;
+  stats.bytesReceived += (uint32_t)payload.size();
+  respond(payload.data(), payload.size(), at);
+}
+
+uint64_t E32SimAir::airTimeUs(size_t payloadBytes, uint32_t bps) {
+  return ((payloadBytes + E32_SIM_AIR_OVERHEAD_BYTES) * 8ULL * 1000000ULL + bps - 1) / bps;
+}
+
+void E32SimAir::detach(E32SimModule *module) {
+  modules_.erase(std::remove(modules_.begin(), modules_.end(), module), modules_.end());
+}
+
+void E32SimAir::transmit(Transmission transmission) {
+  for (Transmission &other : inFlight_) {
+    if (other.chan == transmission.chan && other.start < transmission.end && transmission.start < other.end) {
+      other.collided = true;
+      transmission.collided = true;
+    }
+  }
+  inFlight_.push_back(transmission);
+}
+
+bool E32SimAir::lose() {
+  if (lossRate_ <= 0.0) {
+    return false;
+  }
+  rng_ ^= rng_ << 13;  // xorshift32, deterministic per seed
+  rng_ ^= rng_ >> 17;
+  rng_ ^= rng_ << 5;
+  return (rng_ / 4294967296.0) < lossRate_;
+}
+
+void E32SimAir::finish(const Transmission &tx) {
+  for (E32SimModule *module : modules_) {
+    if (module == tx.sender) {
+      continue;
+    }
+    const E32SimRegisters &regs = module->regs_;
+    bool listening = module->mode_ <= 1 || (module->mode_ == 2 && tx.wakeUp);
+    bool addressed = tx.target == 0xFFFF || regs.address() == 0xFFFF || regs.address() == tx.target;
+    if (!listening || !addressed || regs.chan != tx.chan || regs.airBps() != tx.bps) {
+      continue;
+    }
+    // Half duplex: a module that was transmitting meanwhile hears nothing
+    if (module->transmittingSince_ < tx.end && module->transmittingUntil_ > tx.start) {
+      tx.sender->stats.packetsLost++;
+      continue;
+    }
+    if (tx.collided || lose()) {
+      tx.sender->stats.packetsLost++;
+      continue;
+    }
+    module->deliver(tx.payload, tx.end);
+  }
+}
+
+void E32SimAir::advance(uint64_t us) {
+  uint64_t target = now_ + us;
+  while (true) {
+    uint64_t next = NEVER;
+    for (E32SimModule *module : modules_) {
+      next = std::min(next, module->nextEventTime());
+    }
+    for (const Transmission &tx : inFlight_) {
+      next = std::min(next, tx.end);
+    }
+    if (next > target) {
+      break;
+    }
+    now_ = std::max(now_, next);
+    for (E32SimModule *module : modules_) {
+      module->process(now_);
+    }
+    for (size_t i = 0; i < inFlight_.size();) {
+      if (inFlight_[i].end <= now_) {
+        Transmission done = inFlight_[i];
+        finish(done);
+        inFlight_.erase(inFlight_.begin() + i);
+      } else {
+        i++;
+      }
+    }
+  }
+  now_ = target;
+}
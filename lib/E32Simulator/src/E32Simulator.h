@@ -0,0 +1,151 @@
+#ifndef E32_SIMULATOR_H
+#define E32_SIMULATOR_H
+
+// Software model of an EBYTE E32 (TTL-100 family) module for host-side runs.
+//
+// E32SimModule is a Stream, i.e. the same interface LoRa_E32 uses for Serial1, and
+// emulates what sits behind it: the M0/M1 modes, the C0/C1/C2/C3/C4 program-mode
+// commands, UART byte timing at the configured baud and 58-byte sub-packets sent
+// over a shared E32SimAir. The air delivers packets between modules on the same
+// channel and air rate, honours fixed/transparent addressing and can drop packets
+// (random loss, collisions, half-duplex).
+//
+// Time is virtual: nothing moves until E32SimAir::advance() is called.
+
+#include <stdint.h>
+#include <deque>
+#include <vector>
+#include "HostStream.h"
+
+class E32SimAir;
+
+// Register image as written by C0/C2 (see the E32 datasheet for the bit layout)
+struct E32SimRegisters {
+  uint8_t addh = 0x00;
+  uint8_t addl = 0x00;
+  uint8_t sped = 0x1A;    // 8N1, 9600 baud, 2.4k air rate
+  uint8_t chan = 0x17;    // 433 MHz
+  uint8_t option = 0x44;  // Transparent, push-pull, 250ms wake-up, FEC on, 30dBm
+
+  uint16_t address() const { return (uint16_t)((addh << 8) | addl); }
+  uint32_t uartBaud() const;
+  uint32_t airBps() const;
+  bool fixedTransmission() const { return (option & 0x80) != 0; }
+  uint32_t wakeUpTimeMs() const { return 250 * (((option >> 3) & 0x07) + 1); }
+};
+
+struct E32SimStats {
+  uint32_t packetsSent = 0;
+  uint32_t packetsReceived = 0;
+  uint32_t packetsLost = 0;       // Dropped by the loss model or a collision
+  uint32_t bytesSent = 0;         // Payload bytes put on air
+  uint32_t bytesReceived = 0;     // Payload bytes handed to the host
+  uint32_t uartErrors = 0;        // Bytes lost to a host/module baud mismatch
+  uint32_t configWrites = 0;
+  uint32_t eepromWrites = 0;      // C0 (save) writes only
+  uint64_t airTimeUs = 0;
+};
+
+class E32SimModule : public Stream {
+ public:
+  explicit E32SimModule(E32SimAir &air, const char *name = "e32");
+  ~E32SimModule();
+
+  // M0/M1 pins: (0,0) normal, (1,0) wake-up, (0,1) power-saving, (1,1) program
+  void setPins(bool m0, bool m1);
+  void setMode(uint8_t mode) { setPins(mode & 0x01, mode & 0x02); }
+  uint8_t mode() const { return mode_; }
+  bool aux() const;  // HIGH when idle, like the AUX pin
+
+  // Baud the host side of the UART is running at; bytes are garbled on mismatch
+  void setHostBaud(uint32_t baud) { hostBaud_ = baud; }
+
+  const E32SimRegisters &registers() const { return regs_; }
+  const E32SimRegisters &savedRegisters() const { return saved_; }
+  void powerCycle();  // Reload the saved registers, drop buffered data
+  const char *name() const { return name_; }
+
+  E32SimStats stats;
+
+  // Stream
+  int available() override;
+  int read() override;
+  int peek() override;
+  size_t write(uint8_t value) override;
+  using Print::write;
+
+ private:
+  friend class E32SimAir;
+
+  struct TimedByte {
+    uint64_t time;  // When the byte has fully crossed the UART
+    uint8_t value;
+  };
+
+  uint32_t moduleBaud() const { return mode_ == 3 ? 9600 : regs_.uartBaud(); }
+  static uint64_t byteTimeUs(uint32_t baud) { return 10000000ULL / baud; }  // 8N1 = 10 bits
+  uint64_t nextEventTime() const;
+  void process(uint64_t now);
+  void handleCommandByte(uint8_t value, uint64_t now);
+  void respond(const uint8_t *data, size_t length, uint64_t at);
+  void closePacket(uint64_t now);
+  void deliver(const std::vector<uint8_t> &payload, uint64_t at);
+
+  E32SimAir &air_;
+  const char *name_;
+  uint8_t mode_ = 0;
+  uint64_t busyUntil_ = 0;
+  uint64_t transmittingSince_ = 0;
+  uint64_t transmittingUntil_ = 0;
+  uint32_t hostBaud_ = 9600;
+  E32SimRegisters regs_;
+  E32SimRegisters saved_;
+  std::deque<TimedByte> fromHost_;
+  std::deque<TimedByte> toHost_;
+  uint64_t hostLineFree_ = 0;
+  uint64_t moduleLineFree_ = 0;
+  std::vector<uint8_t> command_;
+  std::vector<uint8_t> packet_;
+  uint64_t lastPacketByte_ = 0;
+};
+
+class E32SimAir {
+ public:
+  explicit E32SimAir(uint32_t seed = 1) : rng_(seed ? seed : 1) {}
+
+  uint64_t now() const { return now_; }
+  void advance(uint64_t us);
+  void setLossRate(double probability) { lossRate_ = probability; }
+
+  // On-air time of a payload at the given air rate (preamble/header modelled as extra bytes)
+  static uint64_t airTimeUs(size_t payloadBytes, uint32_t bps);
+
+ private:
+  friend class E32SimModule;
+
+  struct Transmission {
+    E32SimModule *sender;
+    uint8_t chan;
+    uint16_t target;
+    bool wakeUp;
+    uint32_t bps;
+    uint64_t start;
+    uint64_t end;
+    bool collided;
+    std::vector<uint8_t> payload;
+  };
+
+  void attach(E32SimModule *module) { modules_.push_back(module); }
+  void detach(E32SimModule *module);
+  void transmit(Transmission transmission);
+  void finish(const Transmission &transmission);
+  bool lose();
+
+  std::vector<E32SimModule *> modules_;
+  std::vector<Transmission> inFlight_;
+  uint64_t now_ = 0;
+  double lossRate_ = 0.0;
+  uint32_t rng_;
+};
+
+#endif
@@ -0,0 +1,43 @@
+#ifndef HOST_STREAM_H
+#define HOST_STREAM_H
+
+// Minimal stand-in for the Arduino Print/Stream classes so the simulator
+// (and code written against Stream) can be compiled on Linux.
+#ifdef ARDUINO
+#include <Stream.h>
+#else
+
+#include <stddef.h>
+#include <stdint.h>
+
+class Print {
+ public:
+  virtual ~Print() {}
+  virtual size_t write(uint8_t value) = 0;
+  virtual size_t write(const uint8_t *buffer, size_t size) {
+    size_t n = 0;
+    while (n < size && write(buffer[n])) {
+      n++;
+    }
+    return n;
+  }
+  virtual void flush() {}
+};
+
+class Stream : public Print {
+ public:
+  virtual int available() = 0;
+  virtual int read() = 0;
+  virtual int peek() = 0;
+
+  size_t readBytes(uint8_t *buffer, size_t length) {
+    size_t n = 0;
+    while (n < length && available() > 0) {
+      buffer[n++] = (uint8_t)read();
+    }
+    return n;
+  }
+};
+
+#endif
+#endif
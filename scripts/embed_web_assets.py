@@ -0,0 +1,98 @@
+# PlatformIO pre-build script: compiles data/ into include/web_assets.h
+#
+# Every file in data/ is gzipped (mtime pinned so the output is reproducible)
+# and emitted as a constexpr byte array together with its MIME type and a
+# precomputed ETag. The arrays land in .rodata, i.e. flash-mapped memory, so
+# the web server can answer straight from flash without touching LittleFS.
+#
+# Used by the [env:esp32-s3-devkitc-1-embedded] environment, which also
+# defines EMBED_WEB_ASSETS so main.cpp registers the embedded handlers.
+
+import gzip
+import hashlib
+import os
+
+Import("env")  # noqa: F821 - provided by PlatformIO
+
+MIME_TYPES = {
+    ".html": "text/html",
+    ".js": "application/javascript",
+    ".css": "text/css",
+    ".json": "application/json",
+    ".png": "image/png",
+    ".ico": "image/x-icon",
+    ".svg": "image/svg+xml",
+}
+
+project_dir = env.subst("$PROJECT_DIR")  # noqa: F821
+data_dir = os.path.join(project_dir, "data")
+output_path = os.path.join(project_dir, "include", "web_assets.h")
+
+
+def symbol_name(index):
+    return "WEB_ASSET_DATA_%d" % index
+
+
+def format_bytes(data):
+    lines = []
+    for offset in range(0, len(data), 16):
+        chunk = data[offset:offset + 16]
+        lines.append("  " + ", ".join("0x%02x" % b for b in chunk) + ",")
+    return "\n".join(lines)
+
+
+def build_header():
+    assets = []
+    for name in sorted(os.listdir(data_dir)):
+        path = os.path.join(data_dir, name)
+        extension = os.path.splitext(name)[1].lower()
+        if not os.path.isfile(path) or extension not in MIME_TYPES:
+            continue
+        with open(path, "rb") as source:
+            raw = source.read()
+        compressed = gzip.compress(raw, compresslevel=9, mtime=0)
+        etag = '"%s"' % hashlib.sha1(raw).hexdigest()[:16]
+        assets.append(("/" + name, MIME_TYPES[extension], compressed, etag, len(raw)))
+
+    out = []
+    out.append("// Auto-generated by scripts/embed_web_assets.py - do not edit.")
+    out.append("#ifndef WEB_ASSETS_H")
+    out.append("#define WEB_ASSETS_H")
+    out.append("")
+    out.append("#include <stddef.h>")
+    out.append("#include <stdint.h>")
+    out.append("")
+    out.append("struct WebAsset {")
+    out.append("  const char* path;")
+    out.append("  const char* contentType;")
+    out.append("  const uint8_t* data;  // gzip-compressed body")
+    out.append("  size_t length;")
+    out.append("  const char* etag;")
+    out.append("};")
+    out.append("")
+    for index, (path, mime, compressed, etag, raw_len) in enumerate(assets):
+        out.append("// %s: %d bytes, %d gzipped" % (path, raw_len, len(compressed)))
+        out.append("static constexpr uint8_t %s[] = {" % symbol_name(index))
+        out.append(format_bytes(compressed))
+        out.append("};")
+        out.append("")
+    out.append("static constexpr WebAsset WEB_ASSETS[] = {")
+    for index, (path, mime, compressed, etag, raw_len) in enumerate(assets):
+        out.append('  {"%s", "%s", %s, sizeof(%s), "%s"},' % (
+            path, mime, symbol_name(index), symbol_name(index), etag.replace('"', '\\"')))
+    out.append("};")
+    out.append("static constexpr size_t WEB_ASSET_COUNT = sizeof(WEB_ASSETS) / sizeof(WEB_ASSETS[0]);")
+    out.append("")
+    out.append("#endif")
+    return "\n".join(out) + "\n"
+
+
+header = build_header()
+existing = None
+if os.path.exists(output_path):
+    with open(output_path, "r") as current:
+        existing = current.read()
+if header != existing:
+    with open(output_path, "w") as target:
+        target.write(header)
+    print("embed_web_assets: regenerated include/web_assets.h")
@@ -6,8 +6,25 @@
 #include <LittleFS.h>
 #include <freertos/FreeRTOS.h>
 #include <freertos/task.h>
+#include <freertos/event_groups.h>
+#include <esp_timer.h>
+#include <esp_system.h>
+#include <memory>
 #include "LoRa_E32.h"
 #include "config.h"
+#include "lora_telemetry.h"
+#include "lora_link.h"
+#include "lora_node_table.h"
+#include "lora_duty_ledger.h"
+#include "lora_reliable.h"
+#include "lora_link_stats.h"
+#include "config_store.h"
+#include "fs_stats.h"
+#include "event_log.h"
+#include "export_format.h"
+#ifdef EMBED_WEB_ASSETS
+#include "web_assets.h"
+#endif
 
 // Global variables
 AsyncWebServer server(WEBSOCKET_PORT);
@@ -18,48 +35,312 @@ unsigned long lastWebSocketTime = 0;
 unsigned long bootTime = 0;
 unsigned long lastAdminActivity = 0;
 SemaphoreHandle_t loraMutex = xSemaphoreCreateMutex();
+SemaphoreHandle_t snapshotMutex = xSemaphoreCreateMutex();
+// Last serialized message per topic, replayed to newly connecting clients
+String systemStatusSnapshot;
+String counterStatusSnapshot;
+// Counter history ring buffer
+HistoryRecord historyBuffer[HISTORY_CAPACITY];
+int historyHead = 0;  // Next slot to write
+int historyCount = 0;
+uint32_t historyWritten = 0;  // Records written since boot; record n lives in slot n % HISTORY_CAPACITY
+portMUX_TYPE historyMux = portMUX_INITIALIZER_UNLOCKED;
+// LoRa telemetry uplink state
+CounterReportBase loraReportBase;      // Counts and I/O state already reported (delta base)
+uint16_t loraUplinkSequence = 0;
+uint8_t loraSession = 0;                // Picked at boot, sent with every report
+// Per-channel air time, own transmissions and frames heard from other nodes
+LoRaDutyLedger<LORA_DUTY_CHANNELS, LORA_DUTY_BUCKETS> loraDutyLedger(LORA_DUTY_WINDOW);
+portMUX_TYPE dutyLedgerMux = portMUX_INITIALIZER_UNLOCKED;
+uint32_t loraDutyDeferred = 0;  // Reports held back because the budget was spent
+// Reliable delivery: sender towards the gateway, per-node receive windows on a gateway
+LoRaReliableSender<LORA_RELIABLE_WINDOW> loraSender(0, 0, {LORA_RETRY_MIN, LORA_RETRY_MAX, LORA_RETRY_ATTEMPTS});
+SemaphoreHandle_t reliableMutex = xSemaphoreCreateMutex();
+// Copy of loraSender's counters for the web handlers, which must not wait on
+// reliableMutex while the uplink task transmits under it. Guarded by linkStatsMux.
+LoRaReliableStats loraReliableSnapshot;
+size_t loraInFlightSnapshot = 0;
+LoRaReliableReceiver<LORA_NODE_TABLE_SIZE> loraReceiver;
+LoRaAck loraPendingAcks[LORA_PENDING_ACKS];  // One cumulative ACK per sender, sent once the channel is quiet
+size_t loraPendingAckCount = 0;
+unsigned long loraLastFrameTime = 0;
+uint32_t loraAcksSent = 0;
+uint32_t loraReliableDuplicates = 0;
+// Link statistics: transmit counters and last contact per radio peer
+LoRaTxStats loraTxStats;
+LoRaPeerTable<LORA_PEER_TABLE_SIZE> loraPeers;
+portMUX_TYPE linkStatsMux = portMUX_INITIALIZER_UNLOCKED;
+bool loraDeliveringReliable = false;  // Set while a reliable wrapper hands its inner frame to a handler
+// LoRa receive path
+typedef void (*LoRaFrameHandler)(const uint8_t *payload, uint8_t length);
+LoRaFrameParser<LORA_RX_RING_SIZE> loraRxParser;
+LoRaFrameHandler loraFrameHandlers[LORA_FRAME_TYPE_COUNT] = {nullptr};
+TaskHandle_t loraRxTaskHandle = NULL;
+volatile bool loraReprobeRequested = false;  // refresh_lora_e32: loraRxTask re-runs initLoRaE32()
+volatile unsigned long loraRxEventMicros = 0;  // When the UART driver signalled the current burst
+unsigned long loraRxLatencyTotal = 0;          // Event-to-dispatch latency, µs; these three guarded by linkStatsMux
+unsigned long loraRxLatencyMax = 0;
+// Per UART rate (index into uartBaudRateTable), guarded by linkStatsMux: how long
+// handing a frame to the module takes and the receive event-to-dispatch latency
+struct LoRaBaudLatency {
+  uint32_t txFrames;
+  uint64_t txTotalUs;
+  uint32_t txMaxUs;
+  uint32_t rxBursts;
+  uint64_t rxTotalUs;
+  uint32_t rxMaxUs;
+};
+LoRaBaudLatency loraBaudLatency[8];
+unsigned long loraRxBursts = 0;
+// Gateway node table
+LoRaNodeTable<LORA_NODE_TABLE_SIZE> loraNodeTable;
+portMUX_TYPE nodeTableMux = portMUX_INITIALIZER_UNLOCKED;
+volatile bool nodeTableChanged = false;
+uint32_t nodeTableRejected = 0;  // Reports dropped because the table was full
+String nodeTableSnapshot;
+// Last configuration read back from the E32, used to skip redundant writes
+Configuration loraConfirmedConfig;
+bool loraConfigConfirmed = false;
+bool loraTrialActive = false;  // Module holds a temporary (non-saved) configuration
+// Debounced config store
+volatile uint8_t configDirtyMask = 0;
+unsigned long configDirtyTime = 0;  // Last time a section was marked dirty
+portMUX_TYPE configDirtyMux = portMUX_INITIALIZER_UNLOCKED;
+SemaphoreHandle_t configStoreMutex = xSemaphoreCreateMutex();
+uint8_t configImage[CONFIG_STORE_MAX_SIZE];  // Read/commit buffer, guarded by configStoreMutex
+int64_t configStoreLoadUs = 0;                // Open, read, verify and decode at boot
+size_t configStoreBytes = 0;
+const char *configStoreSource = "defaults";   // Where the running configuration came from
+bool fsMounted = false;                       // LittleFS came up; nothing is read or saved without it
+uint32_t configStoreCommits = 0;
+uint32_t configStoreLastUs = 0;               // Duration of the last successful commit
+FsStatsTable<FS_STATS_FILES> fsStats(FS_BLOCK_SIZE, FS_COMMIT_OVERHEAD_BYTES);
+portMUX_TYPE fsStatsMux = portMUX_INITIALIZER_UNLOCKED;
+// Event log: segment files, index and the count bookkeeping are guarded by
+// eventLogMutex, the RAM buffer by eventBufferMux
+const size_t EVENT_LOG_SEGMENT_RECORDS = EVENT_LOG_SEGMENT_SIZE / sizeof(EventRecord);
+SemaphoreHandle_t eventLogMutex = xSemaphoreCreateMutex();
+EventLogIndex<EVENT_LOG_SEGMENTS * EVENT_LOG_SEGMENT_RECORDS / EVENT_LOG_INDEX_STRIDE> eventIndex;
+uint32_t eventFirstSegment = 1;
+uint32_t eventLastSegment = 1;
+size_t eventLastSegmentRecords = 0;
+uint32_t eventTimeBase = 0;  // Log time at boot: one past the newest stored record
+portMUX_TYPE eventBufferMux = portMUX_INITIALIZER_UNLOCKED;
+EventRecord eventBuffer[EVENT_LOG_BUFFER];
+size_t eventBufferCount = 0;
+uint32_t eventsDropped = 0;  // Buffer was full
+bool eventLogReady = false;
+uint32_t eventLoggedCounts[4];
+unsigned long lastEventFlush = 0;
+// Last completed /api/export, and totals over every completed one
+uint32_t exportsCompleted = 0;
+uint32_t exportLastBytes = 0;
+uint32_t exportLastRows = 0;
+uint32_t exportLastUs = 0;
+uint64_t exportTotalBytes = 0;
+uint64_t exportTotalUs = 0;
+uint32_t exportLockRetries = 0;  // Chunks put off because eventLogMutex was busy
+// Page serving: handler entry to the first body chunk handed to TCP (async_tcp only)
+struct FirstByteStats {
+  uint32_t count;
+  uint32_t lastUs;
+  uint32_t maxUs;
+  uint64_t totalUs;
+};
+FirstByteStats firstByteStats;
+unsigned long countsDirtyTime = 0;            // First count since the last checkpoint
+uint32_t counterEpoch = 0;                    // Identifies the store lineage in the RTC cache
+portMUX_TYPE counterRtcMux = portMUX_INITIALIZER_UNLOCKED;
+uint32_t counterCheckpoint = 0;               // Advanced by each commit that changed the counter section
+// What the counter section holds; commitConfigStore() compares the snapshot it
+// encodes with the last committed one. Both guarded by configStoreMutex.
+struct CounterSectionState {
+  int planDisplay;
+  uint8_t pins[4];
+  uint32_t filters[4];
+  uint32_t counts[4];
+};
+CounterSectionState committedCounterSection;
+CounterSectionState counterSectionToWrite;
+uint32_t counterCheckpointToWrite = 0;
+const char *counterRestoreSource = "store";   // "power_fail" or "rtc" when counts came back from there
+// Power-fail flush (POWER_FAIL_PIN)
+File powerFailFile;                           // Opened at boot so the flush does not allocate
+PowerFailRecord powerFailRecord;
+TaskHandle_t powerFailTaskHandle = NULL;
+volatile int64_t powerFailEdgeUs = 0;         // When the supply-sense input went active
+uint32_t powerFailFlushes = 0;
+uint32_t powerFailOverruns = 0;
+uint32_t powerFailLastUs = 0;
+uint32_t powerFailWorstUs = 0;                // Includes flushes from earlier power cycles
+// Boot scheduler: each stage runs in its own task once the stages it depends on are ready
+EventGroupHandle_t bootEvents = xEventGroupCreate();
+typedef bool (*BootStageFn)();  // false: the stage fell back, see BootStageRecord::failed
+struct BootStage {
+  const char *name;
+  uint32_t waitFor;   // Readiness bits required before the stage starts
+  uint32_t ready;     // Bit set when the stage is done
+  BootStageFn run;
+  TaskId task;        // Its TASK_LAYOUTS entry: stack, priority and core
+  BootStageRecord record;
+};
+bool initLittleFS();
+bool initWiFi();
+bool initLoRaE32();
+bool startLoRa();
+bool initWebSocket();
+bool startCounters();
+#ifdef EMBED_WEB_ASSETS
+const uint32_t BOOT_WEB_WAITS_FOR = BOOT_NET_STARTED;  // Pages come from flash, LittleFS is not needed
+#else
+const uint32_t BOOT_WEB_WAITS_FOR = BOOT_FS_READY | BOOT_NET_STARTED;
+#endif
+BootStage bootStages[] = {
+  {"fs", 0, BOOT_FS_READY, initLittleFS, TASK_BOOT_FS, {}},
+  {"wifi", 0, BOOT_NET_STARTED, initWiFi, TASK_BOOT_WIFI, {}},
+  {"radio", 0, BOOT_RADIO_PROBED, initLoRaE32, TASK_BOOT_RADIO, {}},
+  {"radio_config", BOOT_FS_READY | BOOT_RADIO_PROBED, BOOT_RADIO_READY, startLoRa, TASK_BOOT_RADIO_CONFIG, {}},
+  {"web", BOOT_WEB_WAITS_FOR, BOOT_WEB_READY, initWebSocket, TASK_BOOT_WEB, {}},
+  {"counters", BOOT_FS_READY, BOOT_COUNTERS_READY, startCounters, TASK_BOOT_COUNTERS, {}},
+};
+const size_t BOOT_STAGE_COUNT = sizeof(bootStages) / sizeof(bootStages[0]);
+size_t bootStagesPending = BOOT_STAGE_COUNT;
+portMUX_TYPE bootMux = portMUX_INITIALIZER_UNLOCKED;
+// Boot milestones, µs since reset (0 until reached)
+int64_t bootCompleteUs = 0;
+int64_t bootWifiConnectedUs = 0;
+int64_t bootFirstCountUs = 0;
+int64_t bootFirstClientUs = 0;
+BootStepRecord fsBootSteps[BOOT_STEP_MAX];
+size_t fsBootStepCount = 0;
+// Task placement (TASK_LAYOUTS) and the counting engine's hand-off to its publisher
+uint8_t taskLayout = DEFAULT_TASK_LAYOUT;
+TaskHandle_t counterPublishTaskHandle = NULL;
+volatile int64_t counterPublishRequestUs = 0;
+// Task layout benchmark; each histogram is written by one task only
+volatile bool benchRunning = false;
+volatile bool benchPulse = false;  // Fake count for the counter task to publish
+FsLatencyHistogram benchJitter;    // Counter loop lateness, µs
+FsLatencyHistogram benchWsLatency; // Count to WebSocket send, µs
+// Radio settings read from LittleFS, applied once the module has been probed
+LoRaE32Config loraStoredConfig;
+bool loraStoredConfigLoaded = false;
 const unsigned long ADMIN_TIMEOUT = 30 * 60 * 1000; // 30 minutes
 
+// Host side of the E32 UART, follows the module between program and configured rates
+uint32_t loraUartBaud = 0;  // 0 while Serial1 is closed
+uint32_t loraUartConfig = SERIAL_8N1;
+volatile uint32_t loraUartErrors = 0;  // Frame/parity errors reported by the UART driver
+
 // LoRa E32 instance
 LoRa_E32 e32ttl100(&Serial1, E32_AUX_PIN, E32_M0_PIN, E32_M1_PIN);
 
 // Forward declarations
 void initInputs();
 void initOutputs();
-void initWiFi();
-void initLittleFS();
-void initWebSocket();
-void initLoRaE32();
+void onWiFiGotIp(WiFiEvent_t event, WiFiEventInfo_t info);
+void applyStoredLoRaConfig();
+void bootStageTask(void *pvParameters);
+void startBootStages();
+String buildBootTimelineJson();
 void updateSystemStatus();
 void sendSystemStatus();
+void sendSnapshots(AsyncWebSocketClient *client);
+void storeSnapshot(String &snapshot, const String &jsonString);
+String readSnapshot(const String &snapshot);
 void sendDebugMessage(const String& message);
 float getTemperature();
 void onWebSocketEvent(AsyncWebSocket *server, AsyncWebSocketClient *client, AwsEventType type, void *arg, uint8_t *data, size_t len);
 void systemMonitorTask(void *pvParameters);
 void webSocketTask(void *pvParameters);
-void handleWebSocketMessage(void *arg, uint8_t *data, size_t len);
-void saveIOConfig();
+void handleWebSocketMessage(AsyncWebSocketClient *client, void *arg, uint8_t *data, size_t len);
+int64_t recordFsBootStep(const char *name, int64_t startUs);
+bool loadConfigStore();
+void applyIOConfig();
+int removeLegacyConfigFiles();
+void storeLoRaConfig();
 void loadIOConfig();
-void saveLoRaConfig();
 void loadLoRaConfig();
-void setLoRaConfig(LoRaE32Config config);
-void setLoRaOperatingMode(uint8_t mode);
+void setLoRaConfig(LoRaE32Config config, bool persist);
+void fillRadioConfiguration(Configuration &target, const LoRaE32Config &config);
+void readRadioConfiguration(LoRaE32Config &target, const Configuration &source);
+bool sameRadioConfiguration(const Configuration &a, const Configuration &b);
+bool setLoRaOperatingMode(uint8_t mode);
+void waitForLoRaReady(unsigned long fallbackMs);
+void openLoRaUart(uint32_t baud, uint32_t serialConfig);
+void syncLoRaUart(uint8_t mode);
+void onLoRaUartError(hardwareSerial_error_t error);
+const char* loraModeName(uint8_t mode);
+void markConfigDirty(uint8_t mask);
+TaskHandle_t startTask(TaskId id, TaskFunction_t task, void *param);
+void loadTaskBenchState();
+void saveTaskBenchState();
+void startTaskBenchmark(bool sweep);
+void restartWithTaskLayout(uint8_t layout);
+void restartTask(void *pvParameters);
+void requestCounterPublish();
+String buildTaskTableJson();
+bool fsWriteFile(const char *path, const uint8_t *data, size_t length);
+size_t fsReadFile(const char *path, uint8_t *buffer, size_t capacity);
+String fsReadString(File &file, const char *path);
+bool fsRename(const char *from, const char *to);
+bool fsRemove(const char *path);
+bool fsAppendFile(const char *path, const uint8_t *data, size_t length);
+void initEventLog();
+uint32_t eventLogTime();
+void logEvent(uint8_t type, uint8_t subject, uint32_t value, uint32_t previous);
+void flushEventLog(bool force);
+void handleEventsRequest(AsyncWebServerRequest *request);
+void handleExportRequest(AsyncWebServerRequest *request);
+void fsRecordWrite(const char *path, size_t bytes, uint32_t us);
+String buildFsStatsJson();
+void markCountsDirty();
+void saveCounterRtcCache();
+void restoreCounterRtcCache();
+void restorePowerFailRecord();
+void initPowerFailFlush();
+void triggerPowerFailFlush();
+void triggerPowerFailFlushDuringCommit();
+void flushConfigStore(bool force);
 void clearTerminal();
 void controlOutput(int pin, bool state);
 void printModuleInformation(struct ModuleInformation moduleInformation);
 void printParameters(struct Configuration configuration);
+uint16_t currentIoState();
+bool transmitLoRaFrame(uint16_t target, const uint8_t *frame, size_t length);
+bool sendLoRaCounterReport();
+void handleReliableFrame(const uint8_t *payload, uint8_t length);
+void handleAckFrame(const uint8_t *payload, uint8_t length);
+void publishReliableStats();
+unsigned long loraAckDelay();
+void flushLoRaAcks();
+void recordLoRaPeer(uint16_t address, uint8_t length);
+String buildMetrics();
+void loraUplinkTask(void *pvParameters);
+void loraRxTask(void *pvParameters);
+void onLoRaUartReceive();
+void registerLoRaFrameHandler(uint8_t type, LoRaFrameHandler handler);
+void handleCounterReportFrame(const uint8_t *payload, uint8_t length);
+String buildNodeTableJson();
+void sendNodeTable();
 //dashboard functions
 void initCounters();
-void saveCounterConfig();
 void loadCounterConfig();
+void applyDefaultCounterConfig();
 void resetCounter(int counterIndex);
 void resetAllCounters();
 // Admin functions
-void saveAdminCredentials();
 void loadAdminCredentials();
 void sendCounterStatus();
+String buildCounterStatusJson();
+String buildSystemStatusJson();
 void updateCounterStatus();
 void checkAdminTimeout();
+// History functions
+void recordHistorySample();
+void historyRange(uint32_t *first, uint32_t *end);
+bool copyHistoryRecord(uint32_t sequence, HistoryRecord *out);
+void handleHistoryRequest(AsyncWebServerRequest *request);
 
 // Initialize input pins
 void initInputs() {
@@ -84,55 +365,115 @@ void initOutputs() {
   Serial.println("Output pins initialized");
 }
 
-// Initialize WiFi connection
-void initWiFi() {
+// Start the WiFi connection; onWiFiGotIp reports when it is up
+bool initWiFi() {
   WiFi.setAutoReconnect(true);  //  tự động kết nối lại
   WiFi.persistent(true);       // lưu cấu hình WiFi vào bộ nhớ
-  
-  Serial.print("Connecting to WiFi");
-  WiFi.begin(WIFI_SSID, WIFI_PASSWORD);
+  WiFi.onEvent(onWiFiGotIp, ARDUINO_EVENT_WIFI_STA_GOT_IP);
 
-  unsigned long startAttemptTime = millis();
-  
-  while (WiFi.status() != WL_CONNECTED && millis() - startAttemptTime < 10000) {
-    vTaskDelay(pdMS_TO_TICKS(500));
-    Serial.print(".");
-  }
+  Serial.println("Connecting to WiFi in the background");
+  WiFi.begin(WIFI_SSID, WIFI_PASSWORD);
+  return true;
+}
 
-  if (WiFi.status() == WL_CONNECTED) {
-    Serial.println("\nWiFi connected!");
-    Serial.print("IP address: ");
-    Serial.println(WiFi.localIP());
-    systemStatus.ipAddress = WiFi.localIP().toString();
-    sendDebugMessage("WiFi connected! IP: " + systemStatus.ipAddress);
-  } else {
-    Serial.println("\nFailed to connect WiFi, will retry in background");
-    sendDebugMessage("Failed to connect WiFi, auto-reconnecting...");
+// WiFi event: station got an IP address
+void onWiFiGotIp(WiFiEvent_t event, WiFiEventInfo_t info) {
+  systemStatus.ipAddress = WiFi.localIP().toString();
+  if (bootWifiConnectedUs == 0) {
+    bootWifiConnectedUs = esp_timer_get_time();
   }
+  xEventGroupSetBits(bootEvents, BOOT_WIFI_CONNECTED);
+  Serial.println("WiFi connected! IP: " + systemStatus.ipAddress);
 }
+
 // Initialize LittleFS
-void initLittleFS() {
+// Loading only decodes into systemStatus and loraStoredConfig; the apply steps
+// then drive the hardware (the radio is programmed later, by startLoRa)
+bool initLittleFS() {
+  int64_t mark = esp_timer_get_time();
   if (!LittleFS.begin(true)) {
-    Serial.println("An error has occurred while mounting LittleFS");
-    return;
+    // Even formatting failed. Run this boot on the built-in configuration:
+    // counting works, but nothing is saved and there is no event log.
+    Serial.println("An error has occurred while mounting LittleFS, running on defaults");
+    mark = recordFsBootStep("mount_failed", mark);
+    configStoreSource = "defaults_no_fs";
+    applyDefaultCounterConfig();
+    applyIOConfig();
+    initCounters();
+    recordFsBootStep("apply_defaults", mark);
+    return false;
   }
+  fsMounted = true;
   Serial.println("LittleFS mounted successfully");
-  loadIOConfig();
-  loadLoRaConfig();
-  loadCounterConfig();
-  loadAdminCredentials();
+  mark = recordFsBootStep("mount", mark);
+  bool fromStore = loadConfigStore();
+  mark = esp_timer_get_time();  // loadConfigStore() records its own steps
+  if (!fromStore) {
+    // No store yet: import the JSON files written by older firmware, once
+    loadIOConfig();
+    loadLoRaConfig();
+    loadCounterConfig();
+    loadAdminCredentials();
+    mark = recordFsBootStep("legacy_import", mark);
+  }
+  if (counterEpoch == 0) {
+    counterEpoch = esp_random() | 1;  // New store (or one written before the RTC cache existed)
+    markConfigDirty(CONFIG_DIRTY_COUNTER);
+  }
+  if (!fromStore && commitConfigStore()) {
+    configStoreSource = removeLegacyConfigFiles() > 0 ? "legacy" : "defaults";
+    mark = recordFsBootStep("legacy_commit", mark);
+  }
+  restorePowerFailRecord();
+  restoreCounterRtcCache();
+  mark = recordFsBootStep("restore_counts", mark);
+  applyIOConfig();
+  mark = recordFsBootStep("apply_io", mark);
+  initCounters();
+  mark = recordFsBootStep("apply_counters", mark);
+  initPowerFailFlush();
+  mark = recordFsBootStep("power_fail", mark);
+  initEventLog();
+  recordFsBootStep("event_log", mark);
+  return true;
 }
 
-// Initialize LoRa E32
-void initLoRaE32() {
+// Time one step of the fs boot stage; returns the end time as the next step's start
+int64_t recordFsBootStep(const char *name, int64_t startUs) {
+  int64_t now = esp_timer_get_time();
+  if (fsBootStepCount < BOOT_STEP_MAX) {
+    fsBootSteps[fsBootStepCount++] = {name, (uint32_t)(now - startUs)};
+  }
+  return now;
+}
+
+// Drive the outputs to the states loaded from the store
+void applyIOConfig() {
+  for (int i = 0; i < NUM_OUTPUTS; i++) {
+    digitalWrite(OUTPUT_PINS[i], systemStatus.outputs[i].state ? HIGH : LOW);
+  }
+}
+
+// Initialize LoRa E32; false when the module did not answer
+bool initLoRaE32() {
   Serial.println("=== Initializing LoRa E32 ===");
   
   // Initialize chân M0, M1 là OUTPUT
   pinMode(E32_M0_PIN, OUTPUT);
   pinMode(E32_M1_PIN, OUTPUT);
   
-  // Khởi tạo Serial1 với các chân đã định nghĩa
-  Serial1.begin(9600, SERIAL_8N1, E32_RX_PIN, E32_TX_PIN);
+  // Keep loraRxTask and the uplink off Serial1 while it is reopened and the
+  // library talks to the module
+  if (xSemaphoreTake(loraMutex, pdMS_TO_TICKS(5000)) != pdTRUE) {
+    Serial.println("Failed to acquire LoRa mutex");
+    sendDebugMessage("Failed to acquire LoRa mutex");
+    return false;
+  }
+
+  // Khởi tạo Serial1 ở tốc độ program mode; the configured rate is only known
+  // (and only safe to use) once the module's registers have been read back
+  loraConfigConfirmed = false;
+  openLoRaUart(E32_PROGRAM_BAUD, SERIAL_8N1);
   
   // Khởi tạo LoRa E32
   e32ttl100.begin();
@@ -140,8 +481,8 @@ void initLoRaE32() {
   // Đặt chế độ mặc định là Normal Mode
   setLoRaOperatingMode(0); // Normal mode
   
-  vTaskDelay(pdMS_TO_TICKS(1000)); // Tăng delay để module ổn định
-  
+  waitForLoRaReady(E32_POWER_ON_SETTLE_MS); // Chờ module tự kiểm tra xong
+
   Serial.println("Reading module information...");
   
   // Đọc thông tin module với error handling
@@ -153,10 +494,10 @@ void initLoRaE32() {
     printModuleInformation(mi);
     
     // Lưu thông tin module vào system status
-    systemStatus.loraE32.moduleInfo = "HEAD: " + String(mi.HEAD, HEX) + 
-                                      ", Freq: " + String(mi.frequency, HEX) + 
-                                      ", Ver: " + String(mi.version, HEX) + 
-                                      ", Features: " + String(mi.features, HEX);
+    systemStatus.loraModule.head = mi.HEAD;
+    systemStatus.loraModule.frequency = mi.frequency;
+    systemStatus.loraModule.version = mi.version;
+    systemStatus.loraModule.features = mi.features;
     systemStatus.loraE32.initialized = true;
     
     sendDebugMessage("LoRa E32 module information read successfully");
@@ -171,7 +512,7 @@ void initLoRaE32() {
     c.close();
   }
   
-  vTaskDelay(pdMS_TO_TICKS(1000));
+  waitForLoRaReady(E32_PROGRAM_EXIT_SETTLE_MS);
   
   // Chỉ đọc configuration nếu module đã được khởi tạo thành công
   if (systemStatus.loraE32.initialized) {
@@ -186,28 +527,11 @@ void initLoRaE32() {
       Serial.println("Configuration read successfully!");
       
       printParameters(configuration);
+      loraConfirmedConfig = configuration;
+      loraConfigConfirmed = true;
       
       // Lưu cấu hình vào system status
-      systemStatus.loraE32.addh = configuration.ADDH;
-      systemStatus.loraE32.addl = configuration.ADDL;
-      systemStatus.loraE32.chan = configuration.CHAN;
-      systemStatus.loraE32.uartParity = configuration.SPED.uartParity;
-      systemStatus.loraE32.uartBaudRate = configuration.SPED.uartBaudRate;
-      systemStatus.loraE32.airDataRate = configuration.SPED.airDataRate;
-      systemStatus.loraE32.fixedTransmission = configuration.OPTION.fixedTransmission;
-      systemStatus.loraE32.ioDriveMode = configuration.OPTION.ioDriveMode;
-      systemStatus.loraE32.wirelessWakeupTime = configuration.OPTION.wirelessWakeupTime;
-      systemStatus.loraE32.fec = configuration.OPTION.fec;
-      systemStatus.loraE32.transmissionPower = configuration.OPTION.transmissionPower;
-      systemStatus.loraE32.frequency = configuration.getChannelDescription();
-      systemStatus.loraE32.parityBit = configuration.SPED.getUARTParityDescription();
-      systemStatus.loraE32.airDataRateStr = configuration.SPED.getAirDataRate();
-      systemStatus.loraE32.uartBaudRateStr = configuration.SPED.getUARTBaudRate();
-      systemStatus.loraE32.fixedTransmissionStr = configuration.OPTION.getFixedTransmissionDescription();
-      systemStatus.loraE32.ioDriveModeStr = configuration.OPTION.getIODroveModeDescription();
-      systemStatus.loraE32.wirelessWakeupTimeStr = configuration.OPTION.getWirelessWakeUPTimeDescription();
-      systemStatus.loraE32.fecStr = configuration.OPTION.getFECDescription();
-      systemStatus.loraE32.transmissionPowerStr = configuration.OPTION.getTransmissionPowerDescription();
+      readRadioConfiguration(systemStatus.loraE32, configuration);
       
       sendDebugMessage("LoRa E32 configuration read successfully");
     } else {
@@ -220,50 +544,21 @@ void initLoRaE32() {
       configContainer.close();
     }
   }
+  // Step up to the module's configured UART rate for normal traffic
+  syncLoRaUart(systemStatus.loraE32.operatingMode);
+  xSemaphoreGive(loraMutex);
   
   Serial.println("=== LoRa E32 Initialization Complete ===");
+  return systemStatus.loraE32.initialized;
 }
 
 
-// Save LoRa configuration to JSON
-void saveLoRaConfig() {
-  JSONVar config;
-  JSONVar loraE32;
-  loraE32["addh"] = systemStatus.loraE32.addh;
-  loraE32["addl"] = systemStatus.loraE32.addl;
-  loraE32["chan"] = systemStatus.loraE32.chan;
-  loraE32["uartParity"] = systemStatus.loraE32.uartParity;
-  loraE32["uartBaudRate"] = systemStatus.loraE32.uartBaudRate;
-  loraE32["airDataRate"] = systemStatus.loraE32.airDataRate;
-  loraE32["fixedTransmission"] = systemStatus.loraE32.fixedTransmission;
-  loraE32["ioDriveMode"] = systemStatus.loraE32.ioDriveMode;
-  loraE32["wirelessWakeupTime"] = systemStatus.loraE32.wirelessWakeupTime;
-  loraE32["fec"] = systemStatus.loraE32.fec;
-  loraE32["transmissionPower"] = systemStatus.loraE32.transmissionPower;
-  loraE32["operatingMode"] = systemStatus.loraE32.operatingMode;
-  config["loraE32"] = loraE32;
-
-  String jsonString = JSON.stringify(config);
-  
-  File file = LittleFS.open("/lora_config.json", "w");
-  if (file) {
-    file.print(jsonString);
-    file.close();
-    Serial.println("LoRa E32 configuration saved");
-    sendDebugMessage("LoRa E32 configuration saved to LittleFS");
-  } else {
-    Serial.println("Failed to save LoRa E32 configuration");
-    sendDebugMessage("Failed to save LoRa E32 configuration");
-  }
-}
-
-// Load LoRa configuration from JSON
+// Import the LoRa configuration from the pre-store JSON file; applyStoredLoRaConfig() programs the radio later
 void loadLoRaConfig() {
   if (LittleFS.exists("/lora_config.json")) {
     File file = LittleFS.open("/lora_config.json", "r");
     if (file) {
-      String jsonString = file.readString();
-      file.close();
+      String jsonString = fsReadString(file, "/lora_config.json");
       
       JSONVar config = JSON.parse(jsonString);
       
@@ -275,23 +570,22 @@ void loadLoRaConfig() {
       
       if (config.hasOwnProperty("loraE32")) {
         JSONVar loraE32 = config["loraE32"];
-        systemStatus.loraE32.addh = (int)loraE32["addh"];
-        systemStatus.loraE32.addl = (int)loraE32["addl"];
-        systemStatus.loraE32.chan = (int)loraE32["chan"];
-        systemStatus.loraE32.uartParity = (int)loraE32["uartParity"];
-        systemStatus.loraE32.uartBaudRate = (int)loraE32["uartBaudRate"];
-        systemStatus.loraE32.airDataRate = (int)loraE32["airDataRate"];
-        systemStatus.loraE32.fixedTransmission = (int)loraE32["fixedTransmission"];
-        systemStatus.loraE32.ioDriveMode = (int)loraE32["ioDriveMode"];
-        systemStatus.loraE32.wirelessWakeupTime = (int)loraE32["wirelessWakeupTime"];
-        systemStatus.loraE32.fec = (int)loraE32["fec"];
-        systemStatus.loraE32.transmissionPower = (int)loraE32["transmissionPower"];
-        systemStatus.loraE32.operatingMode = (int)loraE32["operatingMode"];
-        
-        // Áp dụng cấu hình LoRa
-        setLoRaConfig(systemStatus.loraE32);
-        // Áp dụng chế độ hoạt động
-        setLoRaOperatingMode(systemStatus.loraE32.operatingMode);
+        loraStoredConfig.addh = (int)loraE32["addh"];
+        loraStoredConfig.addl = (int)loraE32["addl"];
+        loraStoredConfig.chan = (int)loraE32["chan"];
+        loraStoredConfig.uartParity = (int)loraE32["uartParity"];
+        loraStoredConfig.uartBaudRate = (int)loraE32["uartBaudRate"];
+        loraStoredConfig.airDataRate = (int)loraE32["airDataRate"];
+        loraStoredConfig.fixedTransmission = (int)loraE32["fixedTransmission"];
+        loraStoredConfig.ioDriveMode = (int)loraE32["ioDriveMode"];
+        loraStoredConfig.wirelessWakeupTime = (int)loraE32["wirelessWakeupTime"];
+        loraStoredConfig.fec = (int)loraE32["fec"];
+        loraStoredConfig.transmissionPower = (int)loraE32["transmissionPower"];
+        loraStoredConfig.operatingMode = (int)loraE32["operatingMode"];
+        if (loraE32.hasOwnProperty("role")) {
+          loraStoredConfig.role = (int)loraE32["role"] == LORA_ROLE_GATEWAY ? LORA_ROLE_GATEWAY : LORA_ROLE_NODE;
+        }
+        loraStoredConfigLoaded = true;
         
         Serial.println("LoRa E32 configuration loaded");
         sendDebugMessage("LoRa E32 configuration loaded from LittleFS");
@@ -300,76 +594,110 @@ void loadLoRaConfig() {
   }
 }
 
-// Set LoRa E32 configuration
-void setLoRaConfig(LoRaE32Config config) {
+// Program the radio with the configuration loaded from LittleFS, once the module has been probed
+void applyStoredLoRaConfig() {
+  systemStatus.loraE32.role = loraStoredConfig.role;
+  // Áp dụng cấu hình LoRa (bỏ qua nếu module đã có cấu hình này)
+  if (loraStoredConfigLoaded) {
+    setLoRaConfig(loraStoredConfig);
+  }
+  // Áp dụng chế độ hoạt động
+  if (xSemaphoreTake(loraMutex, pdMS_TO_TICKS(1000)) == pdTRUE) {
+    setLoRaOperatingMode(loraStoredConfig.operatingMode);
+    xSemaphoreGive(loraMutex);
+  }
+}
+
+// Fill the E32 register image from our configuration
+void fillRadioConfiguration(Configuration &target, const LoRaE32Config &config) {
+  target.HEAD = 0xC0;
+  target.ADDH = config.addh;
+  target.ADDL = config.addl;
+  target.CHAN = config.chan;
+  target.SPED.uartParity = config.uartParity;
+  target.SPED.uartBaudRate = config.uartBaudRate;
+  target.SPED.airDataRate = config.airDataRate;
+  target.OPTION.fixedTransmission = config.fixedTransmission;
+  target.OPTION.ioDriveMode = config.ioDriveMode;
+  target.OPTION.wirelessWakeupTime = config.wirelessWakeupTime;
+  target.OPTION.fec = config.fec;
+  target.OPTION.transmissionPower = config.transmissionPower;
+}
+
+// Take the radio settings from a register image read back from the module
+void readRadioConfiguration(LoRaE32Config &target, const Configuration &source) {
+  target.addh = source.ADDH;
+  target.addl = source.ADDL;
+  target.chan = source.CHAN;
+  target.uartParity = source.SPED.uartParity;
+  target.uartBaudRate = source.SPED.uartBaudRate;
+  target.airDataRate = source.SPED.airDataRate;
+  target.fixedTransmission = source.OPTION.fixedTransmission;
+  target.ioDriveMode = source.OPTION.ioDriveMode;
+  target.wirelessWakeupTime = source.OPTION.wirelessWakeupTime;
+  target.fec = source.OPTION.fec;
+  target.transmissionPower = source.OPTION.transmissionPower;
+}
+
+// Compare the radio parameters of two register images (HEAD is the write command, not a setting)
+bool sameRadioConfiguration(const Configuration &a, const Configuration &b) {
+  return a.ADDH == b.ADDH && a.ADDL == b.ADDL && a.CHAN == b.CHAN &&
+         a.SPED.uartParity == b.SPED.uartParity &&
+         a.SPED.uartBaudRate == b.SPED.uartBaudRate &&
+         a.SPED.airDataRate == b.SPED.airDataRate &&
+         a.OPTION.fixedTransmission == b.OPTION.fixedTransmission &&
+         a.OPTION.ioDriveMode == b.OPTION.ioDriveMode &&
+         a.OPTION.wirelessWakeupTime == b.OPTION.wirelessWakeupTime &&
+         a.OPTION.fec == b.OPTION.fec &&
+         a.OPTION.transmissionPower == b.OPTION.transmissionPower;
+}
+
+// Set LoRa E32 configuration; persist=false writes a temporary configuration
+// that the module forgets at power-down (for trialling settings)
+void setLoRaConfig(LoRaE32Config config, bool persist) {
   if (xSemaphoreTake(loraMutex, pdMS_TO_TICKS(1000)) == pdTRUE) {
     if (!systemStatus.loraE32.initialized) {
       sendDebugMessage("LoRa E32 not initialized, cannot set configuration");
       xSemaphoreGive(loraMutex);
       return;
     }
+
+    Configuration loraConfig;
+    fillRadioConfiguration(loraConfig, config);
+
+    // Nothing to do if the module already runs these settings (and they are saved, when asked to persist)
+    if (loraConfigConfirmed && sameRadioConfiguration(loraConfig, loraConfirmedConfig) && !(persist && loraTrialActive)) {
+      Serial.println("LoRa E32 configuration unchanged, skipping program mode");
+      sendDebugMessage("LoRa E32 configuration unchanged");
+      xSemaphoreGive(loraMutex);
+      return;
+    }
     
     uint8_t previousMode = systemStatus.loraE32.operatingMode;
     setLoRaOperatingMode(3); // MODE_3_PROGRAM
-    vTaskDelay(pdMS_TO_TICKS(500));
 
-    Configuration loraConfig;
-    loraConfig.HEAD = 0xC0;
-    loraConfig.ADDH = config.addh;
-    loraConfig.ADDL = config.addl;
-    loraConfig.CHAN = config.chan;
-    loraConfig.SPED.uartParity = config.uartParity;
-    loraConfig.SPED.uartBaudRate = config.uartBaudRate;
-    loraConfig.SPED.airDataRate = config.airDataRate;
-    loraConfig.OPTION.fixedTransmission = config.fixedTransmission;
-    loraConfig.OPTION.ioDriveMode = config.ioDriveMode;
-    loraConfig.OPTION.wirelessWakeupTime = config.wirelessWakeupTime;
-    loraConfig.OPTION.fec = config.fec;
-    loraConfig.OPTION.transmissionPower = config.transmissionPower;
-
-    ResponseStatus rs = e32ttl100.setConfiguration(loraConfig, WRITE_CFG_PWR_DWN_SAVE);
+    ResponseStatus rs = e32ttl100.setConfiguration(loraConfig, persist ? WRITE_CFG_PWR_DWN_SAVE : WRITE_CFG_PWR_DWN_LOSE);
     if (rs.code == SUCCESS) {
-      Serial.println("LoRa E32 configuration set successfully");
-      sendDebugMessage("LoRa E32 configuration set successfully");
+      loraTrialActive = !persist;
+      Serial.println(persist ? "LoRa E32 configuration set successfully" : "LoRa E32 trial configuration set (not saved)");
+      sendDebugMessage(persist ? "LoRa E32 configuration set successfully" : "LoRa E32 trial configuration set (not saved)");
       
-      systemStatus.loraE32.addh = config.addh;
-      systemStatus.loraE32.addl = config.addl;
-      systemStatus.loraE32.chan = config.chan;
-      systemStatus.loraE32.uartParity = config.uartParity;
-      systemStatus.loraE32.uartBaudRate = config.uartBaudRate;
-      systemStatus.loraE32.airDataRate = config.airDataRate;
-      systemStatus.loraE32.fixedTransmission = config.fixedTransmission;
-      systemStatus.loraE32.ioDriveMode = config.ioDriveMode;
-      systemStatus.loraE32.wirelessWakeupTime = config.wirelessWakeupTime;
-      systemStatus.loraE32.fec = config.fec;
-      systemStatus.loraE32.transmissionPower = config.transmissionPower;
-      systemStatus.loraE32.frequency = loraConfig.getChannelDescription();
-      systemStatus.loraE32.parityBit = loraConfig.SPED.getUARTParityDescription();
-      systemStatus.loraE32.airDataRateStr = loraConfig.SPED.getAirDataRate();
-      systemStatus.loraE32.uartBaudRateStr = loraConfig.SPED.getUARTBaudRate();
-      systemStatus.loraE32.fixedTransmissionStr = loraConfig.OPTION.getFixedTransmissionDescription();
-      systemStatus.loraE32.ioDriveModeStr = loraConfig.OPTION.getIODroveModeDescription();
-      systemStatus.loraE32.wirelessWakeupTimeStr = loraConfig.OPTION.getWirelessWakeUPTimeDescription();
-      systemStatus.loraE32.fecStr = loraConfig.OPTION.getFECDescription();
-      systemStatus.loraE32.transmissionPowerStr = loraConfig.OPTION.getTransmissionPowerDescription();
+      readRadioConfiguration(systemStatus.loraE32, loraConfig);
       
-      saveLoRaConfig();
+      if (persist) {
+        storeLoRaConfig();
+      }
       
-      vTaskDelay(pdMS_TO_TICKS(500));
+      waitForLoRaReady(E32_CONFIG_WRITE_SETTLE_MS);
       
       ResponseStructContainer configContainer = e32ttl100.getConfiguration();
+      loraConfigConfirmed = false;
       if (configContainer.status.code == 1 && configContainer.data != nullptr) {
         Configuration newConfig = *(Configuration*)configContainer.data;
         printParameters(newConfig);
-        systemStatus.loraE32.frequency = newConfig.getChannelDescription();
-        systemStatus.loraE32.parityBit = newConfig.SPED.getUARTParityDescription();
-        systemStatus.loraE32.airDataRateStr = newConfig.SPED.getAirDataRate();
-        systemStatus.loraE32.uartBaudRateStr = newConfig.SPED.getUARTBaudRate();
-        systemStatus.loraE32.fixedTransmissionStr = newConfig.OPTION.getFixedTransmissionDescription();
-        systemStatus.loraE32.ioDriveModeStr = newConfig.OPTION.getIODroveModeDescription();
-        systemStatus.loraE32.wirelessWakeupTimeStr = newConfig.OPTION.getWirelessWakeUPTimeDescription();
-        systemStatus.loraE32.fecStr = newConfig.OPTION.getFECDescription();
-        systemStatus.loraE32.transmissionPowerStr = newConfig.OPTION.getTransmissionPowerDescription();
+        loraConfirmedConfig = newConfig;
+        loraConfigConfirmed = true;
+        readRadioConfiguration(systemStatus.loraE32, newConfig);
       } else {
         Serial.print("Error reading configuration: ");
         Serial.println(configContainer.status.getResponseDescription());
@@ -385,51 +713,1577 @@ void setLoRaConfig(LoRaE32Config config) {
       sendDebugMessage("Error setting LoRa E32 configuration: " + String(rs.getResponseDescription()));
     }
 
+    // The E32 only answers commands in program mode, always at 9600, so the C1
+    // read-back above is the check of the new UART rate: the host follows to
+    // the SPED it returned, or stays at 9600 if nothing was confirmed
     setLoRaOperatingMode(previousMode);
-    vTaskDelay(pdMS_TO_TICKS(500));
     xSemaphoreGive(loraMutex);
   } else {
     sendDebugMessage("Failed to acquire LoRa mutex");
   }
 }
 
-// Set LoRa operating mode
-void setLoRaOperatingMode(uint8_t mode) {
+// Wait until the E32 is idle: AUX HIGH when wired, otherwise a fixed worst-case time
+void waitForLoRaReady(unsigned long fallbackMs) {
+  if (E32_AUX_PIN < 0) {
+    vTaskDelay(pdMS_TO_TICKS(fallbackMs));
+    return;
+  }
+  unsigned long start = millis();
+  while (digitalRead(E32_AUX_PIN) == LOW && millis() - start < E32_AUX_TIMEOUT_MS) {
+    vTaskDelay(1);
+  }
+  vTaskDelay(pdMS_TO_TICKS(E32_AUX_GUARD_MS));
+}
+
+// Serial config matching the E32 SPED.uartParity field (0 and 3 are both 8N1)
+uint32_t loraUartSerialConfig(uint8_t uartParity) {
+  switch (uartParity) {
+    case 1: return SERIAL_8O1;
+    case 2: return SERIAL_8E1;
+    default: return SERIAL_8N1;
+  }
+}
+
+// (Re)open Serial1; the receive hooks are re-attached since end() drops them
+void openLoRaUart(uint32_t baud, uint32_t serialConfig) {
+  if (baud == loraUartBaud && serialConfig == loraUartConfig) {
+    return;
+  }
+  if (loraUartBaud != 0) {
+    Serial1.flush();
+    Serial1.end();
+  }
+  Serial1.begin(baud, serialConfig, E32_RX_PIN, E32_TX_PIN);
+  // Wake the receive task from the UART driver's event queue instead of polling
+  Serial1.setRxTimeout(LORA_RX_TIMEOUT_SYMBOLS);
+  Serial1.onReceive(onLoRaUartReceive, false);
+  Serial1.onReceiveError(onLoRaUartError);
+  loraUartBaud = baud;
+  loraUartConfig = serialConfig;
+  Serial.printf("LoRa UART at %lu baud\n", (unsigned long)baud);
+}
+
+// Match the host UART to what the module speaks in the given mode. Until the
+// registers have been read back the only rate we can rely on is 9600.
+void syncLoRaUart(uint8_t mode) {
+  if (mode == 3 || !loraConfigConfirmed) {
+    openLoRaUart(E32_PROGRAM_BAUD, SERIAL_8N1);
+  } else {
+    openLoRaUart(uartBaudRateBps(loraConfirmedConfig.SPED.uartBaudRate),
+                 loraUartSerialConfig(loraConfirmedConfig.SPED.uartParity));
+  }
+}
+
+// Index of the host UART rate in uartBaudRateTable, for the per-rate latency stats
+uint8_t loraUartBaudIndex() {
+  for (uint8_t i = 0; i < 8; i++) {
+    if (uartBaudRateTable[i] == loraUartBaud) {
+      return i;
+    }
+  }
+  return 3;  // 9600
+}
+
+// UART driver error callback: frame and parity errors usually mean a baud mismatch
+void onLoRaUartError(hardwareSerial_error_t error) {
+  if (error == UART_FRAME_ERROR || error == UART_PARITY_ERROR) {
+    loraUartErrors++;
+  }
+}
+
+const char* loraModeName(uint8_t mode) {
+  switch (mode) {
+    case 0: return "Normal";
+    case 1: return "Wake-Up";
+    case 2: return "Power-Saving";
+    case 3: return "Sleep";
+    default: return "Unknown";
+  }
+}
+
+// Set LoRa operating mode: only drives M0/M1 and updates state.
+// Persisting the mode and reporting it are up to the caller.
+bool setLoRaOperatingMode(uint8_t mode) {
+  uint8_t previousMode = systemStatus.loraE32.operatingMode;
   switch (mode) {
     case 0: // Normal Mode (M0=0, M1=0)
       digitalWrite(E32_M0_PIN, LOW);
       digitalWrite(E32_M1_PIN, LOW);
       e32ttl100.setMode(MODE_0_NORMAL);
-      systemStatus.loraE32.operatingMode = 0;
-      sendDebugMessage("LoRa E32 set to Normal Mode");
       break;
     case 1: // Wake-Up Mode (M0=1, M1=0)
       digitalWrite(E32_M0_PIN, HIGH);
       digitalWrite(E32_M1_PIN, LOW);
       e32ttl100.setMode(MODE_1_WAKE_UP);
-      systemStatus.loraE32.operatingMode = 1;
-      sendDebugMessage("LoRa E32 set to Wake-Up Mode");
       break;
     case 2: // Power-Saving Mode (M0=0, M1=1)
       digitalWrite(E32_M0_PIN, LOW);
       digitalWrite(E32_M1_PIN, HIGH);
       e32ttl100.setMode(MODE_2_POWER_SAVING);
-      systemStatus.loraE32.operatingMode = 2;
-      sendDebugMessage("LoRa E32 set to Power-Saving Mode");
       break;
     case 3: // Sleep Mode (M0=1, M1=1)
       digitalWrite(E32_M0_PIN, HIGH);
       digitalWrite(E32_M1_PIN, HIGH);
       e32ttl100.setMode(MODE_3_PROGRAM);
-      systemStatus.loraE32.operatingMode = 3;
-      sendDebugMessage("LoRa E32 set to Sleep Mode");
       break;
     default:
-      sendDebugMessage("Invalid LoRa E32 operating mode");
+      return false;
+  }
+  systemStatus.loraE32.operatingMode = mode;
+  syncLoRaUart(mode);
+  unsigned long settle = E32_MODE_SETTLE_MS[mode];
+  if (previousMode == 3 && mode != 3) {
+    settle = max(settle, E32_PROGRAM_EXIT_SETTLE_MS);
+  }
+  waitForLoRaReady(settle);
+  return true;
+}
+
+// Mark config sections for a debounced save
+void markConfigDirty(uint8_t mask) {
+  if (mask & ~CONFIG_DIRTY_COUNTS) {
+    logEvent(EVENT_CONFIG_CHANGE, mask & ~CONFIG_DIRTY_COUNTS, 0, 0);
+  }
+  portENTER_CRITICAL(&configDirtyMux);
+  configDirtyMask |= mask;
+  configDirtyTime = millis();
+  portEXIT_CRITICAL(&configDirtyMux);
+}
+
+// Instrumented LittleFS access. Everything the firmware writes goes through
+// these so /metrics can show the bytes written per file and the flash wear they
+// cause; the web UI files served straight from LittleFS are not counted.
+void fsRecordWrite(const char *path, size_t bytes, uint32_t us) {
+  portENTER_CRITICAL(&fsStatsMux);
+  fsStats.recordWrite(path, bytes, us);
+  portEXIT_CRITICAL(&fsStatsMux);
+}
+
+// Replace a file's content; the latency covers open, write and close
+bool fsWriteFile(const char *path, const uint8_t *data, size_t length) {
+  int64_t start = esp_timer_get_time();
+  File file = LittleFS.open(path, "w");
+  if (!file) {
+    return false;
+  }
+  size_t written = file.write(data, length);
+  file.close();
+  fsRecordWrite(path, written, (uint32_t)(esp_timer_get_time() - start));
+  return written == length;
+}
+
+// Read up to capacity bytes; returns 0 if the file cannot be opened
+size_t fsReadFile(const char *path, uint8_t *buffer, size_t capacity) {
+  File file = LittleFS.open(path, "r");
+  if (!file) {
+    return 0;
+  }
+  size_t length = file.read(buffer, capacity);
+  file.close();
+  portENTER_CRITICAL(&fsStatsMux);
+  fsStats.recordRead(path, length);
+  portEXIT_CRITICAL(&fsStatsMux);
+  return length;
+}
+
+// Read the rest of an open file and close it
+String fsReadString(File &file, const char *path) {
+  String content = file.readString();
+  file.close();
+  portENTER_CRITICAL(&fsStatsMux);
+  fsStats.recordRead(path, content.length());
+  portEXIT_CRITICAL(&fsStatsMux);
+  return content;
+}
+
+// Append to a file (created if missing); the latency covers open, write and close
+bool fsAppendFile(const char *path, const uint8_t *data, size_t length) {
+  int64_t start = esp_timer_get_time();
+  File file = LittleFS.open(path, "a");
+  if (!file) {
+    return false;
+  }
+  size_t written = file.write(data, length);
+  file.close();
+  fsRecordWrite(path, written, (uint32_t)(esp_timer_get_time() - start));
+  return written == length;
+}
+
+bool fsRename(const char *from, const char *to) {
+  bool ok = LittleFS.rename(from, to);
+  portENTER_CRITICAL(&fsStatsMux);
+  fsStats.recordMetadata(to);
+  portEXIT_CRITICAL(&fsStatsMux);
+  return ok;
+}
+
+bool fsRemove(const char *path) {
+  bool ok = LittleFS.remove(path);
+  portENTER_CRITICAL(&fsStatsMux);
+  fsStats.recordMetadata(path);
+  portEXIT_CRITICAL(&fsStatsMux);
+  return ok;
+}
+
+// Per-file I/O and the flash lifetime projected from the write rate since boot
+String buildFsStatsJson() {
+  portENTER_CRITICAL(&fsStatsMux);
+  FsStatsTable<FS_STATS_FILES> stats = fsStats;
+  portEXIT_CRITICAL(&fsStatsMux);
+  double uptimeSeconds = esp_timer_get_time() / 1000000.0;
+  uint32_t blocks = LittleFS.totalBytes() / FS_BLOCK_SIZE;
+
+  JSONVar response;
+  response["action"] = "fs_stats";
+  JSONVar filesArray;
+  for (size_t i = 0; i < stats.size(); i++) {
+    const FsFileStats &file = stats.file(i);
+    JSONVar fileObj;
+    fileObj["path"] = file.path;
+    fileObj["writes"] = (double)file.writes;
+    fileObj["bytesWritten"] = (double)file.bytesWritten;
+    fileObj["reads"] = (double)file.reads;
+    fileObj["bytesRead"] = (double)file.bytesRead;
+    fileObj["metadataOps"] = (double)file.metadataOps;
+    fileObj["erases"] = stats.erases(file);
+    fileObj["writeP50Us"] = (double)file.writeLatency.percentileUs(50);
+    fileObj["writeP99Us"] = (double)file.writeLatency.percentileUs(99);
+    fileObj["writeMaxUs"] = (double)file.writeLatency.maxUs();
+    filesArray[(int)i] = fileObj;
+  }
+  response["files"] = filesArray;
+  response["erases"] = stats.totalErases();
+  response["erasesPerHour"] = uptimeSeconds > 0 ? stats.totalErases() * 3600 / uptimeSeconds : 0;
+  response["lifetimeYears"] = stats.lifetimeYears(blocks, FLASH_ERASE_ENDURANCE, uptimeSeconds);
+  response["usedBytes"] = (double)LittleFS.usedBytes();
+  response["totalBytes"] = (double)LittleFS.totalBytes();
+  return JSON.stringify(response);
+}
+
+void eventSegmentPath(char *path, size_t size, uint32_t segment) {
+  snprintf(path, size, EVENT_LOG_DIR "/%06lu.bin", (unsigned long)segment);
+}
+
+// Seconds on the log's clock, which continues from the newest stored record
+uint32_t eventLogTime() {
+  return eventTimeBase + (uint32_t)(esp_timer_get_time() / 1000000);
+}
+
+// Find the segments, rebuild the sparse index and resume the log clock
+void initEventLog() {
+  if (!LittleFS.exists(EVENT_LOG_DIR)) {
+    LittleFS.mkdir(EVENT_LOG_DIR);
+  }
+  uint32_t first = UINT32_MAX;
+  uint32_t last = 0;
+  File dir = LittleFS.open(EVENT_LOG_DIR);
+  File entry = dir.openNextFile();
+  while (entry) {
+    uint32_t segment = strtoul(entry.name(), nullptr, 10);
+    if (segment > 0) {
+      first = min(first, segment);
+      last = max(last, segment);
+    }
+    entry = dir.openNextFile();
+  }
+  dir.close();
+
+  xSemaphoreTake(eventLogMutex, portMAX_DELAY);
+  char path[24];
+  if (last > 0) {
+    eventFirstSegment = max(first, last >= EVENT_LOG_SEGMENTS ? last - (uint32_t)EVENT_LOG_SEGMENTS + 1 : 1);
+    eventLastSegment = last;
+    // Segments left over from a larger EVENT_LOG_SEGMENTS
+    for (uint32_t segment = first; segment < eventFirstSegment; segment++) {
+      eventSegmentPath(path, sizeof(path), segment);
+      fsRemove(path);
+    }
+  }
+  for (uint32_t segment = eventFirstSegment; last > 0 && segment <= eventLastSegment; segment++) {
+    eventSegmentPath(path, sizeof(path), segment);
+    File file = LittleFS.open(path, "r");
+    if (!file) {
+      continue;
+    }
+    size_t records = file.size() / sizeof(EventRecord);
+    EventRecord record;
+    for (size_t i = 0; i < records; i += EVENT_LOG_INDEX_STRIDE) {
+      file.seek(i * sizeof(EventRecord));
+      if (file.read((uint8_t *)&record, sizeof(record)) == sizeof(record)) {
+        eventIndex.add(record.time, segment, i);
+      }
+    }
+    if (segment == eventLastSegment && records > 0) {
+      file.seek((records - 1) * sizeof(EventRecord));
+      if (file.read((uint8_t *)&record, sizeof(record)) == sizeof(record)) {
+        eventTimeBase = record.time + 1;
+      }
+      eventLastSegmentRecords = records;
+    }
+    file.close();
+  }
+  xSemaphoreGive(eventLogMutex);
+
+  for (int i = 0; i < 4; i++) {
+    eventLoggedCounts[i] = systemStatus.counters[i].count;
+  }
+  lastEventFlush = millis();
+  eventLogReady = true;
+  logEvent(EVENT_BOOT, 0, (uint32_t)esp_reset_reason(), 0);
+  Serial.printf("Event log: segments %lu-%lu, %u index entries, log time %lu\n", (unsigned long)eventFirstSegment,
+                (unsigned long)eventLastSegment, (unsigned)eventIndex.size(), (unsigned long)eventLogTime());
+}
+
+// Queue an event; it reaches flash with the next flushEventLog()
+void logEvent(uint8_t type, uint8_t subject, uint32_t value, uint32_t previous) {
+  if (!eventLogReady) {
+    return;
+  }
+  EventRecord record = {eventLogTime(), type, subject, 0, value, previous};
+  portENTER_CRITICAL(&eventBufferMux);
+  if (eventBufferCount < EVENT_LOG_BUFFER) {
+    eventBuffer[eventBufferCount++] = record;
+  } else {
+    eventsDropped++;
+  }
+  portEXIT_CRITICAL(&eventBufferMux);
+}
+
+// Append records to the newest segment, starting a new one when it is full and
+// deleting the oldest beyond EVENT_LOG_SEGMENTS. Caller holds eventLogMutex.
+void appendEventRecords(const EventRecord *records, size_t count) {
+  char path[24];
+  while (count > 0) {
+    if (eventLastSegmentRecords == EVENT_LOG_SEGMENT_RECORDS) {
+      eventLastSegment++;
+      eventLastSegmentRecords = 0;
+      if (eventLastSegment - eventFirstSegment + 1 > EVENT_LOG_SEGMENTS) {
+        eventSegmentPath(path, sizeof(path), eventFirstSegment);
+        fsRemove(path);
+        eventFirstSegment++;
+        eventIndex.dropBefore(eventFirstSegment);
+      }
+    }
+    size_t chunk = min(count, EVENT_LOG_SEGMENT_RECORDS - eventLastSegmentRecords);
+    eventSegmentPath(path, sizeof(path), eventLastSegment);
+    if (!fsAppendFile(path, (const uint8_t *)records, chunk * sizeof(EventRecord))) {
+      Serial.println("Failed to append to the event log");
       return;
+    }
+    for (size_t i = 0; i < chunk; i++) {
+      size_t position = eventLastSegmentRecords + i;
+      if (position % EVENT_LOG_INDEX_STRIDE == 0) {
+        eventIndex.add(records[i].time, eventLastSegment, position);
+      }
+    }
+    eventLastSegmentRecords += chunk;
+    records += chunk;
+    count -= chunk;
+  }
+}
+
+// Once per EVENT_LOG_FLUSH_INTERVAL (or when the buffer is half full) add a
+// count record for each counter that moved and append the buffer to flash
+void flushEventLog(bool force) {
+  if (!eventLogReady) {
+    return;
+  }
+  xSemaphoreTake(eventLogMutex, portMAX_DELAY);
+  bool intervalDue = millis() - lastEventFlush >= EVENT_LOG_FLUSH_INTERVAL;
+  if (intervalDue) {
+    lastEventFlush = millis();
+    for (int i = 0; i < 4; i++) {
+      uint32_t count = systemStatus.counters[i].count;
+      if (count != eventLoggedCounts[i]) {
+        logEvent(EVENT_COUNT, i, count, eventLoggedCounts[i]);
+        eventLoggedCounts[i] = count;
+      }
+    }
+  }
+  EventRecord records[EVENT_LOG_BUFFER];
+  portENTER_CRITICAL(&eventBufferMux);
+  size_t count = eventBufferCount;
+  bool due = count > 0 && (force || intervalDue || count >= EVENT_LOG_BUFFER / 2);
+  if (due) {
+    memcpy(records, eventBuffer, count * sizeof(EventRecord));
+    eventBufferCount = 0;
+  }
+  portEXIT_CRITICAL(&eventBufferMux);
+  if (due) {
+    appendEventRecords(records, count);
+  }
+  xSemaphoreGive(eventLogMutex);
+}
+
+// Visit up to `limit` records with from <= time <= to, oldest first: seek via the
+// sparse index, scan forward through the segments, then the records still in RAM.
+// Returns the number visited; *more is set when records past the limit remain.
+template <typename Visit>
+size_t forEachEvent(uint32_t from, uint32_t to, size_t limit, bool *more, Visit visit) {
+  size_t visited = 0;
+  *more = false;
+  auto offer = [&](const EventRecord &record) -> bool {
+    if (record.time > to) {
+      return false;
+    }
+    if (record.time >= from) {
+      if (visited == limit) {
+        *more = true;
+        return false;
+      }
+      visit(record);
+      visited++;
+    }
+    return true;
+  };
+
+  bool scanning = true;
+  xSemaphoreTake(eventLogMutex, portMAX_DELAY);
+  EventLogPosition start;
+  if (eventIndex.seek(from, &start)) {
+    char path[24];
+    EventRecord chunk[16];
+    for (uint32_t segment = start.segment; scanning && segment <= eventLastSegment; segment++) {
+      eventSegmentPath(path, sizeof(path), segment);
+      File file = LittleFS.open(path, "r");
+      if (!file) {
+        continue;
+      }
+      file.seek(segment == start.segment ? start.record * sizeof(EventRecord) : 0);
+      size_t bytes;
+      while (scanning && (bytes = file.read((uint8_t *)chunk, sizeof(chunk))) >= sizeof(EventRecord)) {
+        for (size_t i = 0; scanning && i < bytes / sizeof(EventRecord); i++) {
+          scanning = offer(chunk[i]);
+        }
+      }
+      file.close();
+    }
+  }
+  xSemaphoreGive(eventLogMutex);
+
+  if (scanning) {
+    EventRecord pending[EVENT_LOG_BUFFER];
+    portENTER_CRITICAL(&eventBufferMux);
+    size_t count = eventBufferCount;
+    memcpy(pending, eventBuffer, count * sizeof(EventRecord));
+    portEXIT_CRITICAL(&eventBufferMux);
+    for (size_t i = 0; scanning && i < count; i++) {
+      scanning = offer(pending[i]);
+    }
+  }
+  return visited;
+}
+
+// GET /api/events?from=&to= (log seconds): matching EventRecords as raw binary.
+// X-Log-Time maps log time to the device clock; when the response hit
+// EVENT_LOG_QUERY_MAX, X-Next-From is where to continue (that second's
+// records may repeat).
+void handleEventsRequest(AsyncWebServerRequest *request) {
+  uint32_t from = request->hasParam("from") ? strtoul(request->getParam("from")->value().c_str(), nullptr, 10) : 0;
+  uint32_t to = request->hasParam("to") ? strtoul(request->getParam("to")->value().c_str(), nullptr, 10) : UINT32_MAX;
+
+  AsyncResponseStream *response = request->beginResponseStream("application/octet-stream");
+  bool more;
+  uint32_t lastTime = from;
+  size_t count = forEachEvent(from, to, EVENT_LOG_QUERY_MAX, &more, [&](const EventRecord &record) {
+    response->write((const uint8_t *)&record, sizeof(record));
+    lastTime = record.time;
+  });
+  response->addHeader("X-Record-Size", String(sizeof(EventRecord)));
+  response->addHeader("X-Record-Count", String(count));
+  response->addHeader("X-Log-Time", String(eventLogTime()));
+  if (more) {
+    response->addHeader("X-Next-From", String(lastTime));
+  }
+  response->addHeader("Cache-Control", "no-store");
+  request->send(response);
+}
+
+// One /api/export response in progress. Rows are produced one at a time into
+// `row` and copied out as the chunk callbacks ask for bytes, so the RAM used is
+// the same whatever the time range.
+struct ExportCursor {
+  ExportFormat format;
+  uint32_t from;
+  uint32_t to;
+  // History ring (uptime seconds, mapped to log time with historyTimeBase):
+  // record numbers still to read, and a copy of the next one
+  uint32_t historyTimeBase;
+  uint32_t historyNext;
+  uint32_t historyEnd;
+  HistoryRecord history;
+  // Event log: next record to read, and a small read-ahead batch. The files are
+  // read up to where they ended when the export started; the records then still
+  // in RAM were copied into `tail` and follow them.
+  uint32_t eventSegment;
+  uint32_t eventRecord;
+  uint32_t eventEndSegment;
+  uint32_t eventEndRecord;
+  EventRecord events[16];
+  size_t eventCount;
+  size_t eventNext;
+  bool eventFilesDone;
+  bool eventsDone;
+  bool eventsBusy;  // eventLogMutex was busy, the chunk callback tries again later
+  EventRecord tail[EVENT_LOG_BUFFER];
+  size_t tailCount;
+  // Current row
+  bool headerDone;
+  char row[EXPORT_ROW_MAX];
+  size_t rowLength;
+  size_t rowSent;
+  // Throughput
+  int64_t startUs;
+  uint32_t bytes;
+  uint32_t rows;
+  bool finished;
+};
+
+// Next history record in range, copied into the cursor, or nullptr. Records the
+// sampler overwrote during the export are skipped, so rows stay in time order.
+const HistoryRecord *peekExportHistory(ExportCursor &cursor) {
+  while ((int32_t)(cursor.historyEnd - cursor.historyNext) > 0) {
+    if (!copyHistoryRecord(cursor.historyNext, &cursor.history)) {
+      uint32_t end;
+      historyRange(&cursor.historyNext, &end);  // Jump to the oldest record left
+      continue;
+    }
+    uint32_t time = cursor.historyTimeBase + cursor.history.uptimeSeconds;
+    if (time > cursor.to) {
+      cursor.historyNext = cursor.historyEnd;
+    } else if (time < cursor.from) {
+      cursor.historyNext++;
+    } else {
+      return &cursor.history;
+    }
+  }
+  return nullptr;
+}
+
+// Next event in range, or nullptr; refills the batch from the segment files,
+// then serves the RAM tail. Sets eventsBusy instead of waiting on eventLogMutex.
+const EventRecord *peekExportEvent(ExportCursor &cursor) {
+  while (!cursor.eventsDone) {
+    if (cursor.eventNext == cursor.eventCount && cursor.eventFilesDone) {
+      cursor.eventsDone = true;  // Tail served as the last batch
+      break;
+    }
+    if (cursor.eventNext == cursor.eventCount) {
+      cursor.eventCount = 0;
+      cursor.eventNext = 0;
+      if (xSemaphoreTake(eventLogMutex, pdMS_TO_TICKS(EVENT_LOG_EXPORT_WAIT)) != pdTRUE) {
+        cursor.eventsBusy = true;
+        return nullptr;
+      }
+      if (cursor.eventSegment < eventFirstSegment) {
+        cursor.eventSegment = eventFirstSegment;  // Rotated away during the export
+        cursor.eventRecord = 0;
+      }
+      while (cursor.eventCount == 0 && cursor.eventSegment <= cursor.eventEndSegment) {
+        size_t wanted = sizeof(cursor.events) / sizeof(EventRecord);
+        if (cursor.eventSegment == cursor.eventEndSegment) {
+          wanted = min(wanted, (size_t)(cursor.eventEndRecord - min(cursor.eventRecord, cursor.eventEndRecord)));
+        }
+        char path[24];
+        eventSegmentPath(path, sizeof(path), cursor.eventSegment);
+        File file = wanted > 0 ? LittleFS.open(path, "r") : File();
+        if (file) {
+          file.seek(cursor.eventRecord * sizeof(EventRecord));
+          cursor.eventCount = file.read((uint8_t *)cursor.events, wanted * sizeof(EventRecord)) / sizeof(EventRecord);
+          file.close();
+        }
+        if (cursor.eventCount == 0) {
+          cursor.eventSegment++;
+          cursor.eventRecord = 0;
+        }
+      }
+      xSemaphoreGive(eventLogMutex);
+      cursor.eventRecord += cursor.eventCount;
+      if (cursor.eventCount == 0) {
+        cursor.eventFilesDone = true;
+        memcpy(cursor.events, cursor.tail, cursor.tailCount * sizeof(EventRecord));
+        cursor.eventCount = cursor.tailCount;
+        continue;
+      }
+    }
+    const EventRecord &record = cursor.events[cursor.eventNext];
+    if (record.time > cursor.to) {
+      cursor.eventsDone = true;
+    } else if (record.time < cursor.from) {
+      cursor.eventNext++;
+    } else {
+      return &record;
+    }
+  }
+  return nullptr;
+}
+
+// Format the next row, history and events merged in time order; false when done
+bool nextExportRow(ExportCursor &cursor) {
+  cursor.rowSent = 0;
+  cursor.rowLength = 0;
+  if (!cursor.headerDone) {
+    cursor.headerDone = true;
+    cursor.rowLength = formatExportHeader(cursor.row, sizeof(cursor.row), cursor.format);
+    if (cursor.rowLength > 0) {
+      return true;
+    }
+  }
+  const HistoryRecord *history = peekExportHistory(cursor);
+  const EventRecord *event = peekExportEvent(cursor);
+  if (cursor.eventsBusy) {
+    return false;  // Without the next event the merge order is unknown
+  }
+  if (history != nullptr && (event == nullptr || cursor.historyTimeBase + history->uptimeSeconds <= event->time)) {
+    cursor.rowLength = formatHistoryRow(cursor.row, sizeof(cursor.row), cursor.format,
+                                        cursor.historyTimeBase + history->uptimeSeconds, history->counts);
+    cursor.historyNext++;
+  } else if (event != nullptr) {
+    cursor.rowLength = formatEventRow(cursor.row, sizeof(cursor.row), cursor.format, *event);
+    cursor.eventNext++;
+  } else {
+    return false;
+  }
+  cursor.rows++;
+  return true;
+}
+
+// GET /api/export?from=&to=&format=csv|ndjson (log seconds, as /api/events):
+// history samples and event log records merged by time, as a chunked response
+void handleExportRequest(AsyncWebServerRequest *request) {
+  String format = request->hasParam("format") ? request->getParam("format")->value() : "csv";
+  if (format != "csv" && format != "ndjson") {
+    request->send(400, "text/plain", "format must be csv or ndjson");
+    return;
+  }
+  std::shared_ptr<ExportCursor> cursor(new ExportCursor());
+  cursor->format = format == "csv" ? EXPORT_CSV : EXPORT_NDJSON;
+  cursor->from = request->hasParam("from") ? strtoul(request->getParam("from")->value().c_str(), nullptr, 10) : 0;
+  cursor->to = request->hasParam("to") ? strtoul(request->getParam("to")->value().c_str(), nullptr, 10) : UINT32_MAX;
+  cursor->historyTimeBase = eventTimeBase + bootTime / 1000;
+  historyRange(&cursor->historyNext, &cursor->historyEnd);
+
+  // No flush here: the export reads the files up to their current end and then
+  // the RAM buffer as it is now. flushEventLog() moves the buffer to flash under
+  // eventLogMutex, so holding it keeps the two halves from overlapping.
+  if (xSemaphoreTake(eventLogMutex, pdMS_TO_TICKS(EVENT_LOG_EXPORT_WAIT)) != pdTRUE) {
+    exportLockRetries++;
+    AsyncWebServerResponse *busy = request->beginResponse(503, "text/plain", "Event log busy, try again");
+    busy->addHeader("Retry-After", "1");
+    request->send(busy);
+    return;
+  }
+  EventLogPosition start;
+  if (eventIndex.seek(cursor->from, &start)) {
+    cursor->eventSegment = start.segment;
+    cursor->eventRecord = start.record;
+    cursor->eventEndSegment = eventLastSegment;
+    cursor->eventEndRecord = eventLastSegmentRecords;
+  } else {
+    cursor->eventFilesDone = true;
+  }
+  portENTER_CRITICAL(&eventBufferMux);
+  cursor->tailCount = eventBufferCount;
+  memcpy(cursor->tail, eventBuffer, eventBufferCount * sizeof(EventRecord));
+  portEXIT_CRITICAL(&eventBufferMux);
+  xSemaphoreGive(eventLogMutex);
+  if (cursor->eventFilesDone) {
+    memcpy(cursor->events, cursor->tail, cursor->tailCount * sizeof(EventRecord));
+    cursor->eventCount = cursor->tailCount;
+  }
+  cursor->startUs = esp_timer_get_time();
+
+  AsyncWebServerResponse *response = request->beginChunkedResponse(
+    cursor->format == EXPORT_CSV ? "text/csv" : "application/x-ndjson",
+    [cursor](uint8_t *buffer, size_t maxLen, size_t index) -> size_t {
+      size_t written = 0;
+      while (written < maxLen) {
+        if (cursor->rowSent == cursor->rowLength && !nextExportRow(*cursor)) {
+          break;
+        }
+        size_t chunk = min(cursor->rowLength - cursor->rowSent, maxLen - written);
+        memcpy(buffer + written, cursor->row + cursor->rowSent, chunk);
+        cursor->rowSent += chunk;
+        written += chunk;
+      }
+      cursor->bytes += written;
+      if (cursor->eventsBusy) {
+        cursor->eventsBusy = false;
+        if (written == 0) {
+          exportLockRetries++;
+          return RESPONSE_TRY_AGAIN;
+        }
+        return written;
+      }
+      if (written == 0 && !cursor->finished) {
+        cursor->finished = true;
+        exportsCompleted++;
+        exportLastBytes = cursor->bytes;
+        exportLastRows = cursor->rows;
+        exportLastUs = (uint32_t)(esp_timer_get_time() - cursor->startUs);
+        exportTotalBytes += cursor->bytes;
+        exportTotalUs += exportLastUs;
+        Serial.printf("Export: %lu rows, %lu bytes in %lu ms\n", (unsigned long)exportLastRows,
+                      (unsigned long)exportLastBytes, (unsigned long)(exportLastUs / 1000));
+      }
+      return written;
+    });
+  response->addHeader("X-Log-Time", String(eventLogTime()));
+  response->addHeader("Cache-Control", "no-store");
+  request->send(response);
+}
+
+// Counter values changed. Unlike markConfigDirty() this does not restart the
+// timer, so a steady stream of counts still gets checkpointed
+void markCountsDirty() {
+  portENTER_CRITICAL(&configDirtyMux);
+  if (!(configDirtyMask & CONFIG_DIRTY_COUNTS)) {
+    configDirtyMask |= CONFIG_DIRTY_COUNTS;
+    countsDirtyTime = millis();
+  }
+  portEXIT_CRITICAL(&configDirtyMux);
+}
+
+// Write dirty config sections once they have been quiet for CONFIG_SAVE_DEBOUNCE;
+// counts alone wait for COUNTER_CHECKPOINT_INTERVAL since the RTC cache covers resets
+void flushConfigStore(bool force) {
+  if (!fsMounted) {
+    return;  // Running on defaults, see initLittleFS()
+  }
+  portENTER_CRITICAL(&configDirtyMux);
+  uint8_t mask = configDirtyMask;
+  unsigned long now = millis();
+  bool settingsDue = (mask & ~CONFIG_DIRTY_COUNTS) && now - configDirtyTime >= CONFIG_SAVE_DEBOUNCE;
+  bool countsDue = (mask & CONFIG_DIRTY_COUNTS) && now - countsDirtyTime >= COUNTER_CHECKPOINT_INTERVAL;
+  bool due = mask != 0 && (force || settingsDue || countsDue);
+  if (due) {
+    configDirtyMask = 0;
+  }
+  portEXIT_CRITICAL(&configDirtyMux);
+  if (!due) {
+    return;
+  }
+  // Every section lives in the same image, so any dirty section means one commit
+  if (!commitConfigStore()) {
+    // Retry after the next debounce period. Not markConfigDirty(): nothing
+    // changed, so there is no EVENT_CONFIG_CHANGE to log.
+    portENTER_CRITICAL(&configDirtyMux);
+    configDirtyMask |= mask;
+    configDirtyTime = millis();
+    portEXIT_CRITICAL(&configDirtyMux);
+  }
+}
+
+// Mirror the live counts into RTC memory. Cheap enough to run on every count.
+void saveCounterRtcCache() {
+  portENTER_CRITICAL(&counterRtcMux);
+  counterRtcCache.magic = COUNTER_RTC_MAGIC;
+  counterRtcCache.epoch = counterEpoch;
+  for (int i = 0; i < 4; i++) {
+    counterRtcCache.counts[i] = systemStatus.counters[i].count;
+  }
+  counterRtcCache.crc = crc32Update(0, (const uint8_t *)&counterRtcCache, offsetof(CounterRtcCache, crc));
+  portEXIT_CRITICAL(&counterRtcMux);
+}
+
+// After a soft reset the RTC cache is newer than the last flash checkpoint, so
+// its counts win; after power loss or for a cache from another store the
+// checkpoint is used. Either way the cache is reseeded.
+void restoreCounterRtcCache() {
+  esp_reset_reason_t reason = esp_reset_reason();
+  bool softReset = reason == ESP_RST_SW || reason == ESP_RST_PANIC || reason == ESP_RST_INT_WDT ||
+                   reason == ESP_RST_TASK_WDT || reason == ESP_RST_WDT || reason == ESP_RST_DEEPSLEEP ||
+                   reason == ESP_RST_BROWNOUT;  // A brown-out usually leaves RTC memory intact; the CRC decides
+  bool valid = counterRtcCache.magic == COUNTER_RTC_MAGIC && counterRtcCache.epoch == counterEpoch &&
+               counterRtcCache.crc == crc32Update(0, (const uint8_t *)&counterRtcCache, offsetof(CounterRtcCache, crc));
+  if (softReset && valid) {
+    uint32_t recovered = 0;
+    for (int i = 0; i < 4; i++) {
+      recovered += counterRtcCache.counts[i] - (uint32_t)systemStatus.counters[i].count;
+      systemStatus.counters[i].count = counterRtcCache.counts[i];
+    }
+    counterRestoreSource = "rtc";
+    if (recovered != 0) {
+      markCountsDirty();
+    }
+    Serial.printf("Counters restored from RTC memory (reset reason %d, %lu counts since last checkpoint)\n",
+                  (int)reason, (unsigned long)recovered);
+  } else if (softReset) {
+    Serial.println("RTC counter cache invalid, using the flash checkpoint");
+  }
+  saveCounterRtcCache();
+}
+
+// Counts written by the power-fail path are newer than the flash checkpoint
+// unless a checkpoint was committed after them
+void restorePowerFailRecord() {
+  PowerFailRecord record;
+  bool valid = fsReadFile(POWER_FAIL_RECORD_PATH, (uint8_t *)&record, sizeof(record)) == sizeof(record) &&
+               record.magic == POWER_FAIL_MAGIC &&
+               record.crc == crc32Update(0, (const uint8_t *)&record, offsetof(PowerFailRecord, crc));
+  if (!valid) {
+    return;
+  }
+  powerFailWorstUs = record.worstFlushUs;
+  if (record.epoch != counterEpoch || record.checkpoint < counterCheckpoint) {
+    return;
+  }
+  for (int i = 0; i < 4; i++) {
+    systemStatus.counters[i].count = record.counts[i];
+  }
+  counterRestoreSource = "power_fail";
+  markCountsDirty();
+  Serial.println("Counters restored from the power-fail record");
+}
+
+// Fixed-size record, so the flush is one write of sizeof(PowerFailRecord) to an open file
+void writePowerFailRecord() {
+  powerFailRecord.magic = POWER_FAIL_MAGIC;
+  powerFailRecord.epoch = counterEpoch;
+  powerFailRecord.checkpoint = counterCheckpoint;
+  for (int i = 0; i < 4; i++) {
+    powerFailRecord.counts[i] = systemStatus.counters[i].count;
+  }
+  powerFailRecord.worstFlushUs = powerFailWorstUs;
+  powerFailRecord.crc = crc32Update(0, (const uint8_t *)&powerFailRecord, offsetof(PowerFailRecord, crc));
+  int64_t start = esp_timer_get_time();
+  powerFailFile.seek(0);
+  powerFailFile.write((const uint8_t *)&powerFailRecord, sizeof(powerFailRecord));
+  powerFailFile.flush();
+  fsRecordWrite(POWER_FAIL_RECORD_PATH, sizeof(powerFailRecord), (uint32_t)(esp_timer_get_time() - start));
+}
+
+void IRAM_ATTR onPowerFail() {
+  BaseType_t woken = pdFALSE;
+  powerFailEdgeUs = esp_timer_get_time();
+  vTaskNotifyGiveFromISR(powerFailTaskHandle, &woken);
+  portYIELD_FROM_ISR(woken);
+}
+
+// Highest-priority task so the flush only waits for a LittleFS operation that
+// is already running, never for other work
+void powerFailTask(void *pvParameters) {
+  while (1) {
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    writePowerFailRecord();
+    uint32_t elapsed = (uint32_t)(esp_timer_get_time() - powerFailEdgeUs);
+    powerFailFlushes++;
+    powerFailLastUs = elapsed;
+    if (elapsed > powerFailWorstUs) {
+      powerFailWorstUs = elapsed;
+    }
+    if (elapsed > POWER_FAIL_BUDGET_US) {
+      powerFailOverruns++;
+    }
+    Serial.printf("Power-fail flush took %lu us (worst %lu us)\n", (unsigned long)elapsed,
+                  (unsigned long)powerFailWorstUs);
+  }
+}
+
+// Keep the record file open and sized, and arm the supply-sense input
+void initPowerFailFlush() {
+  if (!LittleFS.exists(POWER_FAIL_RECORD_PATH)) {
+    PowerFailRecord empty = {};
+    fsWriteFile(POWER_FAIL_RECORD_PATH, (const uint8_t *)&empty, sizeof(empty));
+  }
+  powerFailFile = LittleFS.open(POWER_FAIL_RECORD_PATH, "r+");
+  if (!powerFailFile) {
+    Serial.println("Failed to open the power-fail record");
+    return;
+  }
+  powerFailTaskHandle = startTask(TASK_POWER_FAIL, powerFailTask, NULL);
+  if (POWER_FAIL_PIN >= 0) {
+    pinMode(POWER_FAIL_PIN, INPUT);
+    attachInterrupt(POWER_FAIL_PIN, onPowerFail, POWER_FAIL_ACTIVE_LEVEL == LOW ? FALLING : RISING);
+    Serial.printf("Power-fail flush armed on GPIO %d\n", POWER_FAIL_PIN);
+  }
+}
+
+// Run the flush path without losing power, to measure it on the bench
+void triggerPowerFailFlush() {
+  if (powerFailTaskHandle != NULL) {
+    powerFailEdgeUs = esp_timer_get_time();
+    xTaskNotifyGive(powerFailTaskHandle);
+  }
+}
+
+// The slow case: the flush has to wait for a config commit that holds LittleFS.
+// A timer fires it about halfway through a commit, timed from the previous one.
+void triggerPowerFailFlushDuringCommit() {
+  static esp_timer_handle_t timer = NULL;
+  if (timer == NULL) {
+    esp_timer_create_args_t args = {};
+    args.callback = [](void *) { triggerPowerFailFlush(); };
+    args.name = "PowerFailTest";
+    esp_timer_create(&args, &timer);
+  }
+  esp_timer_start_once(timer, max(configStoreLastUs / 2, (uint32_t)100));
+  commitConfigStore();
+}
+
+// Config store sections. Each subsystem writes its state into its own section
+// and reads it back at boot; a section that is missing or does not decode
+// leaves the subsystem on its defaults.
+struct ConfigSection {
+  uint8_t id;
+  uint8_t version;
+  const char *name;
+  void (*encode)(ConfigImageWriter &writer);
+  bool (*decode)(ConfigSectionReader &reader);
+  void (*defaults)();  // Optional
+};
+
+// Output states as a bitmask (pins are fixed by OUTPUT_PINS)
+void encodeIOSection(ConfigImageWriter &writer) {
+  uint8_t states = 0;
+  for (int i = 0; i < NUM_OUTPUTS; i++) {
+    if (systemStatus.outputs[i].state) {
+      states |= (uint8_t)(1 << i);
+    }
+  }
+  writer.put8(NUM_OUTPUTS);
+  writer.put8(states);
+}
+
+bool decodeIOSection(ConfigSectionReader &reader) {
+  uint8_t count = reader.get8();
+  uint8_t states = reader.get8();
+  if (!reader.ok()) {
+    return false;
+  }
+  for (int i = 0; i < NUM_OUTPUTS && i < count; i++) {
+    bool state = (states >> i) & 0x01;
+    systemStatus.outputs[i].state = state;
+    systemStatus.outputs[i].stateStr = state ? "HIGH" : "LOW";
+  }
+  return true;
+}
+
+// Mode and role, a flag, then the radio registers in E32 order (ADDH, ADDL, SPED,
+// CHAN, OPTION). Written from loraStoredConfig so a trial configuration is never
+// saved; the flag is clear until a configuration has been stored, so the module
+// keeps its own registers.
+void encodeLoRaSection(ConfigImageWriter &writer) {
+  const LoRaE32Config &lora = loraStoredConfig;
+  writer.put8(lora.operatingMode);
+  writer.put8(lora.role);
+  writer.put8(loraStoredConfigLoaded ? 1 : 0);
+  writer.put8(lora.addh);
+  writer.put8(lora.addl);
+  writer.put8((uint8_t)((lora.uartParity << 6) | (lora.uartBaudRate << 3) | lora.airDataRate));
+  writer.put8(lora.chan);
+  writer.put8((uint8_t)((lora.fixedTransmission << 7) | (lora.ioDriveMode << 6) | (lora.wirelessWakeupTime << 3) |
+                        (lora.fec << 2) | lora.transmissionPower));
+}
+
+bool decodeLoRaSection(ConfigSectionReader &reader) {
+  LoRaE32Config lora;
+  lora.operatingMode = reader.get8() & 0x03;
+  lora.role = reader.get8() == LORA_ROLE_GATEWAY ? LORA_ROLE_GATEWAY : LORA_ROLE_NODE;
+  bool registersStored = reader.get8() != 0;
+  lora.addh = reader.get8();
+  lora.addl = reader.get8();
+  uint8_t sped = reader.get8();
+  lora.chan = reader.get8();
+  uint8_t option = reader.get8();
+  if (!reader.ok()) {
+    return false;
+  }
+  lora.uartParity = sped >> 6;
+  lora.uartBaudRate = (sped >> 3) & 0x07;
+  lora.airDataRate = sped & 0x07;
+  lora.fixedTransmission = option >> 7;
+  lora.ioDriveMode = (option >> 6) & 0x01;
+  lora.wirelessWakeupTime = (option >> 3) & 0x07;
+  lora.fec = (option >> 2) & 0x01;
+  lora.transmissionPower = option & 0x03;
+  loraStoredConfig = lora;
+  loraStoredConfigLoaded = registersStored;
+  return true;
+}
+
+void captureCounterSection(CounterSectionState &state) {
+  memset(&state, 0, sizeof(state));  // Padding too, the states are compared with memcmp
+  state.planDisplay = systemStatus.planDisplay;
+  for (int i = 0; i < 4; i++) {
+    state.pins[i] = (uint8_t)systemStatus.counters[i].pin;
+    state.filters[i] = systemStatus.counters[i].delayFilter;
+    state.counts[i] = systemStatus.counters[i].count;
+  }
+}
+
+// Writes the snapshot commitConfigStore() took; the checkpoint only moves once
+// the image is on flash
+void encodeCounterSection(ConfigImageWriter &writer) {
+  const CounterSectionState &state = counterSectionToWrite;
+  writer.put32((uint32_t)state.planDisplay);
+  writer.put8(4);
+  for (int i = 0; i < 4; i++) {
+    writer.put8(state.pins[i]);
+    writer.put32(state.filters[i]);
+    writer.put32(state.counts[i]);
+  }
+  writer.put32(counterEpoch);
+  writer.put32(counterCheckpointToWrite);
+}
+
+bool decodeCounterSection(ConfigSectionReader &reader) {
+  int planDisplay = (int32_t)reader.get32();
+  uint8_t count = reader.get8();
+  if (count < 4) {
+    return false;
+  }
+  int pins[4];
+  uint32_t filters[4];
+  uint32_t counts[4];
+  for (int i = 0; i < 4; i++) {
+    pins[i] = reader.get8();
+    filters[i] = reader.get32();
+    counts[i] = reader.get32();
+  }
+  reader.skip((size_t)(count - 4) * 9);  // Counters a newer image has and this board does not
+  uint32_t epoch = reader.remaining() >= 4 ? reader.get32() : 0;
+  uint32_t checkpoint = reader.remaining() >= 4 ? reader.get32() : 0;
+  if (!reader.ok()) {
+    return false;
+  }
+  systemStatus.planDisplay = planDisplay;
+  for (int i = 0; i < 4; i++) {
+    // Kiểm tra pin hợp lệ
+    systemStatus.counters[i].pin = (pins[i] > 0 && pins[i] <= 48) ? pins[i] : DEFAULT_COUNTER_PINS[i];
+    systemStatus.counters[i].delayFilter = filters[i];
+    systemStatus.counters[i].count = counts[i];
+  }
+  counterEpoch = epoch;
+  counterCheckpoint = checkpoint;
+  captureCounterSection(committedCounterSection);
+  return true;
+}
+
+void encodeAdminSection(ConfigImageWriter &writer) {
+  const AdminCredentials &admin = systemStatus.adminCredentials;
+  writer.putString(admin.username.c_str(), min((size_t)admin.username.length(), ADMIN_CREDENTIAL_MAX));
+  writer.putString(admin.password.c_str(), min((size_t)admin.password.length(), ADMIN_CREDENTIAL_MAX));
+}
+
+bool decodeAdminSection(ConfigSectionReader &reader) {
+  char username[ADMIN_CREDENTIAL_MAX + 1];
+  char password[ADMIN_CREDENTIAL_MAX + 1];
+  reader.getString(username, sizeof(username));
+  reader.getString(password, sizeof(password));
+  if (!reader.ok()) {
+    return false;
+  }
+  systemStatus.adminCredentials.username = username;
+  systemStatus.adminCredentials.password = password;
+  return true;
+}
+
+const ConfigSection configSections[] = {
+  {CONFIG_SECTION_IO, 1, "io", encodeIOSection, decodeIOSection, nullptr},
+  {CONFIG_SECTION_LORA, 1, "lora", encodeLoRaSection, decodeLoRaSection, nullptr},
+  {CONFIG_SECTION_COUNTER, 1, "counter", encodeCounterSection, decodeCounterSection, applyDefaultCounterConfig},
+  {CONFIG_SECTION_ADMIN, 1, "admin", encodeAdminSection, decodeAdminSection, nullptr},
+};
+const size_t CONFIG_SECTION_COUNT = sizeof(configSections) / sizeof(configSections[0]);
+
+// Read the whole image with one read, verify it and hand each section to its owner.
+// Returns false if there is no valid image.
+bool loadConfigStore() {
+  if (!LittleFS.exists(CONFIG_STORE_PATH)) {
+    return false;
+  }
+  xSemaphoreTake(configStoreMutex, portMAX_DELAY);
+  int64_t start = esp_timer_get_time();
+  size_t length = fsReadFile(CONFIG_STORE_PATH, configImage, sizeof(configImage));
+  int64_t mark = recordFsBootStep("store_read", start);
+  ConfigImageReader reader;
+  bool valid = reader.open(configImage, length);
+  mark = recordFsBootStep("store_verify", mark);
+  if (valid) {
+    for (size_t i = 0; i < CONFIG_SECTION_COUNT; i++) {
+      const ConfigSection &section = configSections[i];
+      ConfigSectionReader sectionReader;
+      uint8_t version;
+      if (!reader.find(section.id, &sectionReader, &version) || version != section.version ||
+          !section.decode(sectionReader)) {
+        Serial.printf("Config section '%s' missing or unreadable, using defaults\n", section.name);
+        if (section.defaults != nullptr) {
+          section.defaults();
+        }
+      }
+    }
+    recordFsBootStep("store_decode", mark);
+    configStoreLoadUs = esp_timer_get_time() - start;
+    configStoreBytes = length;
+    configStoreSource = "store";
+  }
+  xSemaphoreGive(configStoreMutex);
+  if (!valid) {
+    Serial.println("Config store failed its integrity check, ignoring it");
+    sendDebugMessage("Config store failed its integrity check");
+    return false;
+  }
+  Serial.printf("Config store loaded: %u bytes, %u sections in %lld us\n", (unsigned)length, reader.sections(),
+                configStoreLoadUs);
+  return true;
+}
+
+// Serialize every section and replace the store atomically: the image goes to a
+// temporary file first and is renamed over the old one, so a power cut leaves
+// either the old or the new image, never a truncated one
+bool commitConfigStore() {
+  if (!fsMounted) {
+    sendDebugMessage("LittleFS is not mounted, configuration not saved");
+    return false;
+  }
+  xSemaphoreTake(configStoreMutex, portMAX_DELAY);
+  unsigned long start = micros();
+  captureCounterSection(counterSectionToWrite);
+  bool countersChanged = memcmp(&counterSectionToWrite, &committedCounterSection, sizeof(CounterSectionState)) != 0;
+  counterCheckpointToWrite = counterCheckpoint + (countersChanged ? 1 : 0);
+  ConfigImageWriter writer(configImage, sizeof(configImage));
+  for (size_t i = 0; i < CONFIG_SECTION_COUNT; i++) {
+    writer.beginSection(configSections[i].id, configSections[i].version);
+    configSections[i].encode(writer);
+    writer.endSection();
+  }
+  size_t length = writer.finish();
+  bool ok = false;
+  if (length > 0) {
+    ok = fsWriteFile(CONFIG_STORE_TEMP_PATH, configImage, length) && fsRename(CONFIG_STORE_TEMP_PATH, CONFIG_STORE_PATH);
+  }
+  if (ok) {
+    counterCheckpoint = counterCheckpointToWrite;
+    committedCounterSection = counterSectionToWrite;
+    configStoreCommits++;
+    configStoreBytes = length;
+    configStoreLastUs = micros() - start;
+  }
+  xSemaphoreGive(configStoreMutex);
+  if (!ok) {
+    Serial.println(length == 0 ? "Config image larger than CONFIG_STORE_MAX_SIZE" : "Failed to save configuration");
+    sendDebugMessage("Failed to save configuration");
+    return false;
+  }
+  if (DEBUG_MODE) {
+    Serial.printf("Configuration saved: %u bytes in %lu us\n", (unsigned)length, micros() - start);
+  }
+  return true;
+}
+
+// The JSON files are only read once, to seed the store. Returns how many were removed.
+int removeLegacyConfigFiles() {
+  const char *paths[] = {"/io_config.json", "/lora_config.json", "/counter_config.json", "/admin_credentials.json"};
+  int removed = 0;
+  for (size_t i = 0; i < sizeof(paths) / sizeof(paths[0]); i++) {
+    if (LittleFS.exists(paths[i]) && fsRemove(paths[i])) {
+      removed++;
+    }
+  }
+  return removed;
+}
+
+// Remember the running LoRa settings as the ones to restore at boot. While a
+// trial configuration runs (or the module was never read) only mode and role
+// are taken over; the stored registers stay as they are.
+void storeLoRaConfig() {
+  if (systemStatus.loraE32.initialized && !loraTrialActive) {
+    loraStoredConfig = systemStatus.loraE32;
+    loraStoredConfigLoaded = true;
+  } else {
+    loraStoredConfig.operatingMode = systemStatus.loraE32.operatingMode;
+    loraStoredConfig.role = systemStatus.loraE32.role;
+  }
+  markConfigDirty(CONFIG_DIRTY_LORA);
+}
+
+// Input levels in bits 0-7, output levels in bits 8-15
+uint16_t currentIoState() {
+  uint16_t state = 0;
+  for (int i = 0; i < NUM_INPUTS && i < 8; i++) {
+    state |= systemStatus.inputs[i].state ? (1 << i) : 0;
+  }
+  for (int i = 0; i < NUM_OUTPUTS && i < 8; i++) {
+    state |= systemStatus.outputs[i].state ? (1 << (8 + i)) : 0;
+  }
+  return state;
+}
+
+// Put a link frame on air if the duty-cycle budget allows; target is only used with fixed transmission
+bool transmitLoRaFrame(uint16_t target, const uint8_t *frame, size_t length) {
+  bool fixed = systemStatus.loraE32.fixedTransmission;
+  uint8_t chan = systemStatus.loraE32.chan;
+  // Fixed transmission also puts the 3-byte address/channel header on air
+  uint32_t airTime = estimateAirTimeMs(systemStatus.loraE32.airDataRate, systemStatus.loraE32.fec,
+                                       length + (fixed ? 3 : 0));
+  portENTER_CRITICAL(&dutyLedgerMux);
+  bool allowed = loraDutyLedger.canTransmit(chan, airTime, LORA_DUTY_CYCLE_PERCENT, millis());
+  if (!allowed) {
+    loraDutyDeferred++;
+  }
+  portEXIT_CRITICAL(&dutyLedgerMux);
+  if (!allowed) {
+    return false;
+  }
+
+  if (xSemaphoreTake(loraMutex, pdMS_TO_TICKS(1000)) != pdTRUE) {
+    return false;
+  }
+  unsigned long sendStart = micros();
+  ResponseStatus rs = fixed
+    ? e32ttl100.sendFixedMessage(target >> 8, target & 0xFF, chan, (void *)frame, length)
+    : e32ttl100.sendMessage((void *)frame, length);
+  uint32_t sendUs = micros() - sendStart;
+  uint8_t baudIndex = loraUartBaudIndex();
+  xSemaphoreGive(loraMutex);
+
+  if (rs.code != SUCCESS) {
+    portENTER_CRITICAL(&linkStatsMux);
+    loraTxStats.failures++;
+    portEXIT_CRITICAL(&linkStatsMux);
+    Serial.print("LoRa transmit failed: ");
+    Serial.println(rs.getResponseDescription());
+    return false;
+  }
+  portENTER_CRITICAL(&dutyLedgerMux);
+  loraDutyLedger.recordTransmit(chan, airTime, millis());
+  portEXIT_CRITICAL(&dutyLedgerMux);
+  portENTER_CRITICAL(&linkStatsMux);
+  loraTxStats.frames++;
+  loraTxStats.bytes += length + (fixed ? 3 : 0);
+  LoRaBaudLatency &baud = loraBaudLatency[baudIndex];
+  baud.txFrames++;
+  baud.txTotalUs += sendUs;
+  baud.txMaxUs = max(baud.txMaxUs, sendUs);
+  portEXIT_CRITICAL(&linkStatsMux);
+  if (DEBUG_MODE) {
+    Serial.printf("LoRa frame type %u sent: %u bytes, ~%u ms on air\n", frame[1], (unsigned)length, airTime);
+  }
+  return true;
+}
+
+// Send accumulated counter deltas to the gateway. With reliable delivery the
+// report is queued for loraUplinkTask, otherwise it goes out once, best effort.
+bool sendLoRaCounterReport() {
+  if (!systemStatus.loraE32.initialized || systemStatus.loraE32.operatingMode > 1) {
+    return false; // Radio can only transmit in Normal or Wake-Up mode
+  }
+  if (systemStatus.loraE32.role == LORA_ROLE_GATEWAY) {
+    return false;
+  }
+  uint32_t snapshot[LORA_REPORT_COUNTERS];
+  CounterReport report;
+  report.address = (uint16_t)((systemStatus.loraE32.addh << 8) | systemStatus.loraE32.addl);
+  report.session = loraSession;
+  report.sequence = loraUplinkSequence;
+  for (int i = 0; i < LORA_REPORT_COUNTERS; i++) {
+    snapshot[i] = systemStatus.counters[i].count;
+  }
+  uint16_t ioState = currentIoState();
+  if (!loraReportBase.diff(snapshot, ioState, &report)) {
+    return false;
+  }
+
+  uint8_t payload[LORA_REPORT_MAX_SIZE];
+  size_t payloadLength = packCounterReport(payload, report);
+  bool accepted;
+  if (LORA_RELIABLE_DELIVERY) {
+    // Deltas are relative to the previous queued report; the gateway applies each
+    // exactly once, and a report the sender gives up on is folded into the next
+    xSemaphoreTake(reliableMutex, portMAX_DELAY);
+    loraSender.setSource(report.address);
+    accepted = loraSender.queue(LORA_FRAME_COUNTER_REPORT, payload, payloadLength, millis());
+    publishReliableStats();
+    xSemaphoreGive(reliableMutex);
+  } else {
+    uint8_t frame[LORA_MAX_PACKET_SIZE];
+    size_t length = encodeLoRaFrame(frame, LORA_FRAME_COUNTER_REPORT, payload, payloadLength);
+    accepted = transmitLoRaFrame((LORA_GATEWAY_ADDH << 8) | LORA_GATEWAY_ADDL, frame, length);
+  }
+  if (!accepted) {
+    return false; // Window full or budget spent: deltas go out with a later report
+  }
+  loraReportBase.commit(snapshot, ioState);
+  loraUplinkSequence++;
+  return true;
+}
+
+// UART event callback (runs in the HardwareSerial event task): hand off to loraRxTask
+void onLoRaUartReceive() {
+  loraRxEventMicros = micros();
+  if (loraRxTaskHandle != NULL) {
+    xTaskNotifyGive(loraRxTaskHandle);
+  }
+}
+
+void registerLoRaFrameHandler(uint8_t type, LoRaFrameHandler handler) {
+  if (type < LORA_FRAME_TYPE_COUNT) {
+    loraFrameHandlers[type] = handler;
+  }
+}
+
+// Route a validated frame to its handler; the payload points into the parser ring
+void dispatchLoRaFrame(uint8_t type, const uint8_t *payload, uint8_t length, void *context) {
+  // Every frame heard occupied our channel, whoever it was addressed to
+  uint32_t airTime = estimateAirTimeMs(systemStatus.loraE32.airDataRate, systemStatus.loraE32.fec,
+                                       length + LORA_FRAME_OVERHEAD + (systemStatus.loraE32.fixedTransmission ? 3 : 0));
+  portENTER_CRITICAL(&dutyLedgerMux);
+  loraDutyLedger.recordHeard(systemStatus.loraE32.chan, airTime, millis());
+  portEXIT_CRITICAL(&dutyLedgerMux);
+  if (type < LORA_FRAME_TYPE_COUNT && loraFrameHandlers[type] != nullptr) {
+    loraFrameHandlers[type](payload, length);
+  }
+}
+
+// Gateway side of reliable delivery: deliver new frames once, owe the sender an ACK either way
+void handleReliableFrame(const uint8_t *payload, uint8_t length) {
+  if (systemStatus.loraE32.role != LORA_ROLE_GATEWAY) {
+    return; // In transparent mode nodes hear each other's reports
+  }
+  uint8_t innerType;
+  const uint8_t *inner;
+  uint8_t innerLength;
+  LoRaAck ack;
+  uint16_t self = (uint16_t)((systemStatus.loraE32.addh << 8) | systemStatus.loraE32.addl);
+  LoRaReliableResult result = loraReceiver.accept(payload, length, self, &innerType, &inner, &innerLength, &ack);
+  if (result == LORA_RELIABLE_REJECTED) {
+    return;
+  }
+  recordLoRaPeer(ack.destination, length);
+  if (result == LORA_RELIABLE_DUPLICATE) {
+    loraReliableDuplicates++;
+  } else if (innerType < LORA_FRAME_TYPE_COUNT && innerType != LORA_FRAME_RELIABLE &&
+             loraFrameHandlers[innerType] != nullptr) {
+    loraDeliveringReliable = true; // Peer contact is already recorded for the wrapper
+    loraFrameHandlers[innerType](inner, innerLength);
+    loraDeliveringReliable = false;
+  }
+  // Keep only the latest ACK per sender, it covers the earlier ones
+  size_t slot = 0;
+  while (slot < loraPendingAckCount && loraPendingAcks[slot].destination != ack.destination) {
+    slot++;
+  }
+  if (slot < LORA_PENDING_ACKS) {
+    loraPendingAcks[slot] = ack;
+    loraPendingAckCount = max(loraPendingAckCount, slot + 1);
+  }
+  loraLastFrameTime = millis();
+}
+
+// Note contact with a radio peer; payload length excludes link framing
+void recordLoRaPeer(uint16_t address, uint8_t length) {
+  portENTER_CRITICAL(&linkStatsMux);
+  loraPeers.seen(address, length + LORA_FRAME_OVERHEAD, millis());
+  portEXIT_CRITICAL(&linkStatsMux);
+}
+
+// Refresh the copy the web handlers read. Caller holds reliableMutex.
+void publishReliableStats() {
+  size_t inFlight = loraSender.inFlight();
+  portENTER_CRITICAL(&linkStatsMux);
+  loraReliableSnapshot = loraSender.stats;
+  loraInFlightSnapshot = inFlight;
+  portEXIT_CRITICAL(&linkStatsMux);
+}
+
+// Node side of reliable delivery: release acknowledged reports
+void handleAckFrame(const uint8_t *payload, uint8_t length) {
+  LoRaAck ack;
+  if (!unpackLoRaAck(payload, length, &ack)) {
+    return;
+  }
+  recordLoRaPeer(ack.source, length);
+  xSemaphoreTake(reliableMutex, portMAX_DELAY);
+  loraSender.onAck(ack, millis());
+  publishReliableStats();
+  xSemaphoreGive(reliableMutex);
+}
+
+// ACKs wait until the channel has been quiet for one full packet, so they do not
+// talk over the rest of a sender's burst (the E32 is half duplex)
+unsigned long loraAckDelay() {
+  return estimateAirTimeMs(systemStatus.loraE32.airDataRate, systemStatus.loraE32.fec, LORA_AIR_MAX_BYTES) + 20;
+}
+
+void flushLoRaAcks() {
+  if (loraPendingAckCount == 0 || millis() - loraLastFrameTime < loraAckDelay()) {
+    return;
+  }
+  for (size_t i = 0; i < loraPendingAckCount; i++) {
+    uint8_t body[LORA_ACK_SIZE];
+    uint8_t frame[LORA_MAX_PACKET_SIZE];
+    size_t length = encodeLoRaFrame(frame, LORA_FRAME_ACK, body, packLoRaAck(body, loraPendingAcks[i]));
+    if (transmitLoRaFrame(loraPendingAcks[i].destination, frame, length)) {
+      loraAcksSent++;
+    }
+  }
+  loraPendingAckCount = 0; // An ACK that could not go out is repeated after the next retransmission
+}
+
+// Apply counter reports from remote nodes to the gateway node table
+void handleCounterReportFrame(const uint8_t *payload, uint8_t length) {
+  CounterReport report;
+  if (!unpackCounterReport(payload, length, &report)) {
+    return;
+  }
+  if (!loraDeliveringReliable) {
+    recordLoRaPeer(report.address, length);
+  }
+  if (systemStatus.loraE32.role != LORA_ROLE_GATEWAY) {
+    return;
+  }
+  portENTER_CRITICAL(&nodeTableMux);
+  // Reliable frames were already deduplicated by loraReceiver, possibly out of order
+  LoRaReportResult result = loraNodeTable.applyReport(report, millis(), loraDeliveringReliable);
+  if (result == LORA_REPORT_TABLE_FULL) {
+    nodeTableRejected++;
+  }
+  portEXIT_CRITICAL(&nodeTableMux);
+  if (result == LORA_REPORT_APPLIED) {
+    nodeTableChanged = true;
+  }
+  if (DEBUG_MODE) {
+    Serial.printf("LoRa report from %04X seq %u: %s\n", report.address, report.sequence,
+                  result == LORA_REPORT_APPLIED ? "applied" : result == LORA_REPORT_DUPLICATE ? "duplicate" : "table full");
+  }
+}
+
+// Serialize the gateway node table
+String buildNodeTableJson() {
+  JSONVar response;
+  response["action"] = "node_table";
+  response["role"] = systemStatus.loraE32.role == LORA_ROLE_GATEWAY ? "gateway" : "node";
+  response["capacity"] = (int)loraNodeTable.capacity();
+  response["rejected"] = (double)nodeTableRejected;
+  JSONVar nodesArray;
+  int n = 0;
+  unsigned long now = millis();
+  for (size_t i = 0; i < loraNodeTable.capacity(); i++) {
+    // Copy each slot under the lock so the receive task never waits long
+    portENTER_CRITICAL(&nodeTableMux);
+    LoRaNodeEntry entry = loraNodeTable.slot(i);
+    portEXIT_CRITICAL(&nodeTableMux);
+    if (!entry.used) {
+      continue;
+    }
+    JSONVar nodeObj;
+    nodeObj["addh"] = entry.address >> 8;
+    nodeObj["addl"] = entry.address & 0xFF;
+    nodeObj["lastSeenMs"] = (double)(now - entry.lastSeen);
+    nodeObj["sequence"] = entry.lastSequence;
+    nodeObj["frames"] = (double)entry.frames;
+    nodeObj["duplicates"] = (double)entry.duplicates;
+    JSONVar countsArray;
+    JSONVar ratesArray;
+    for (int c = 0; c < LORA_REPORT_COUNTERS; c++) {
+      countsArray[c] = (double)entry.counts[c];
+      ratesArray[c] = entry.rates[c];
+    }
+    nodeObj["counts"] = countsArray;
+    nodeObj["rates"] = ratesArray;
+    if (entry.hasIo) {
+      nodeObj["io"] = entry.ioState;
+    }
+    nodesArray[n++] = nodeObj;
+  }
+  response["nodes"] = nodesArray;
+  return JSON.stringify(response);
+}
+
+// Broadcast the node table
+void sendNodeTable() {
+  String jsonString = buildNodeTableJson();
+  storeSnapshot(nodeTableSnapshot, jsonString);
+  if (ws.count() > 0) {
+    ws.textAll(jsonString);
+  }
+}
+
+// LoRa receive task: drains Serial1 when the UART driver reports data or an RX timeout
+void loraRxTask(void *pvParameters) {
+  uint8_t chunk[64];
+  while (1) {
+    // Wake up on our own while ACKs are waiting for a quiet channel
+    TickType_t timeout = loraPendingAckCount > 0 ? pdMS_TO_TICKS(loraAckDelay()) : portMAX_DELAY;
+    if (ulTaskNotifyTake(pdTRUE, timeout) == 0) {
+      flushLoRaAcks();
+      continue;
+    }
+    if (loraReprobeRequested) {
+      loraReprobeRequested = false;
+      initLoRaE32();
+      sendSystemStatus();
+      continue;
+    }
+    // Program mode responses belong to the E32 library calls holding loraMutex
+    if (systemStatus.loraE32.operatingMode == 3) {
+      continue;
+    }
+    if (xSemaphoreTake(loraMutex, pdMS_TO_TICKS(2000)) != pdTRUE) {
+      continue;
+    }
+    unsigned long eventMicros = loraRxEventMicros;
+    int available;
+    while ((available = Serial1.available()) > 0) {
+      size_t n = Serial1.read(chunk, min((size_t)available, sizeof(chunk)));
+      loraRxParser.push(chunk, n);
+    }
+    xSemaphoreGive(loraMutex);
+
+    uint32_t framesBefore = loraRxParser.stats.frames;
+    loraRxParser.parse(dispatchLoRaFrame, nullptr);
+    if (loraRxParser.stats.frames != framesBefore) {
+      unsigned long latency = micros() - eventMicros;
+      portENTER_CRITICAL(&linkStatsMux);
+      loraRxLatencyTotal += latency;
+      loraRxLatencyMax = max(loraRxLatencyMax, latency);
+      loraRxBursts++;
+      LoRaBaudLatency &baud = loraBaudLatency[loraUartBaudIndex()];
+      baud.rxBursts++;
+      baud.rxTotalUs += latency;
+      baud.rxMaxUs = max(baud.rxMaxUs, (uint32_t)latency);
+      portEXIT_CRITICAL(&linkStatsMux);
+    }
+  }
+}
+
+// LoRa uplink task: batches counter deltas every LORA_REPORT_INTERVAL and
+// drives retransmissions of unacknowledged reports
+void loraUplinkTask(void *pvParameters) {
+  for (int i = 0; i < LORA_REPORT_COUNTERS; i++) {
+    loraReportBase.counts[i] = systemStatus.counters[i].count;
+  }
+  // New session per boot so the gateway restarts our receive window and node table entry
+  loraSession = (uint8_t)esp_random();
+  uint16_t address = (uint16_t)((systemStatus.loraE32.addh << 8) | systemStatus.loraE32.addl);
+  loraSender = LoRaReliableSender<LORA_RELIABLE_WINDOW>(address, loraSession,
+                                                        {LORA_RETRY_MIN, LORA_RETRY_MAX, LORA_RETRY_ATTEMPTS});
+  const uint16_t gateway = (LORA_GATEWAY_ADDH << 8) | LORA_GATEWAY_ADDL;
+  unsigned long lastReport = millis();
+  while (1) {
+    vTaskDelay(pdMS_TO_TICKS(LORA_UPLINK_POLL));
+    if (millis() - lastReport >= LORA_REPORT_INTERVAL) {
+      lastReport = millis();
+      sendLoRaCounterReport();
+    }
+    if (!LORA_RELIABLE_DELIVERY || systemStatus.loraE32.operatingMode > 1) {
+      continue;
+    }
+    xSemaphoreTake(reliableMutex, portMAX_DELAY);
+    loraSender.poll(millis(), [gateway](const uint8_t *frame, uint8_t length) {
+      return transmitLoRaFrame(gateway, frame, length);
+    }, [](uint8_t type, const uint8_t *payload, uint8_t length) {
+      // Out of retries: resend the counts with the next report rather than lose them
+      CounterReport dropped;
+      if (type == LORA_FRAME_COUNTER_REPORT && unpackCounterReport(payload, length, &dropped)) {
+        loraReportBase.fold(dropped);
+      }
+    });
+    publishReliableStats();
+    xSemaphoreGive(reliableMutex);
   }
-  saveLoRaConfig(); // Lưu chế độ vào LittleFS
-  vTaskDelay(pdMS_TO_TICKS(100));// Đợi module ổn định
 }
 
 // Print module information
@@ -537,39 +2391,12 @@ void printParameters(struct Configuration configuration) {
   Serial.println("===================================");
 }
 
-// Save I/O configuration to JSON
-void saveIOConfig() {
-  JSONVar config;
-  
-  // Save output states
-  JSONVar outputsArray;
-  for (int i = 0; i < NUM_OUTPUTS; i++) {
-    JSONVar outputObj;
-    outputObj["pin"] = systemStatus.outputs[i].pin;
-    outputObj["state"] = systemStatus.outputs[i].state;
-    outputsArray[i] = outputObj;
-  }
-  config["outputs"] = outputsArray;
-  
-  String jsonString = JSON.stringify(config);
-  
-  File file = LittleFS.open("/io_config.json", "w");
-  if (file) {
-    file.print(jsonString);
-    file.close();
-    Serial.println("I/O configuration saved");
-  } else {
-    Serial.println("Failed to save I/O configuration");
-  }
-}
-
-// Load I/O configuration from JSON
+// Import the I/O configuration from the pre-store JSON file
 void loadIOConfig() {
   if (LittleFS.exists("/io_config.json")) {
     File file = LittleFS.open("/io_config.json", "r");
     if (file) {
-      String jsonString = file.readString();
-      file.close();
+      String jsonString = fsReadString(file, "/io_config.json");
       
       JSONVar config = JSON.parse(jsonString);
       
@@ -584,10 +2411,8 @@ void loadIOConfig() {
         for (int i = 0; i < NUM_OUTPUTS; i++) {
           if (outputsArray.hasOwnProperty(String(i))) {
             JSONVar outputObj = outputsArray[i];
-            int pin = (int)outputObj["pin"];
             bool state = (bool)outputObj["state"];
             
-            digitalWrite(pin, state ? HIGH : LOW);
             systemStatus.outputs[i].state = state;
             systemStatus.outputs[i].stateStr = state ? "HIGH" : "LOW";
           }
@@ -620,8 +2445,13 @@ void initCounters() {
 // Reset a specific counter
 void resetCounter(int counterIndex) {
   if (counterIndex >= 0 && counterIndex < 4) {
+    xSemaphoreTake(eventLogMutex, portMAX_DELAY);
+    logEvent(EVENT_COUNTER_RESET, counterIndex, 0, systemStatus.counters[counterIndex].count);
     systemStatus.counters[counterIndex].count = 0;
-    saveCounterConfig();
+    eventLoggedCounts[counterIndex] = 0;
+    xSemaphoreGive(eventLogMutex);
+    saveCounterRtcCache();
+    markConfigDirty(CONFIG_DIRTY_COUNTER);
     sendCounterStatus();
     sendDebugMessage("Counter " + String(counterIndex + 1) + " reset");
   }
@@ -629,51 +2459,27 @@ void resetCounter(int counterIndex) {
 
 // Reset all counters
 void resetAllCounters() {
+  xSemaphoreTake(eventLogMutex, portMAX_DELAY);
   for (int i = 0; i < 4; i++) {
+    logEvent(EVENT_COUNTER_RESET, i, 0, systemStatus.counters[i].count);
     systemStatus.counters[i].count = 0;
+    eventLoggedCounts[i] = 0;
   }
-  saveCounterConfig();
+  xSemaphoreGive(eventLogMutex);
+  saveCounterRtcCache();
+  markConfigDirty(CONFIG_DIRTY_COUNTER);
   sendCounterStatus();
   sendDebugMessage("All counters reset");
 }
 
-// Save counter configuration to JSON
-void saveCounterConfig() {
-  JSONVar config;
-  config["planDisplay"] = systemStatus.planDisplay;
-  JSONVar countersArray;
-  for (int i = 0; i < 4; i++) {
-    JSONVar counterObj;
-    counterObj["pin"] = systemStatus.counters[i].pin;
-    counterObj["delayFilter"] = systemStatus.counters[i].delayFilter;
-    counterObj["count"] = systemStatus.counters[i].count;
-    countersArray[i] = counterObj;
-  }
-  config["counters"] = countersArray;
-
-  String jsonString = JSON.stringify(config);
-  
-  File file = LittleFS.open("/counter_config.json", "w");
-  if (file) {
-    file.print(jsonString);
-    file.close();
-    Serial.println("Counter configuration saved");
-    sendDebugMessage("Counter configuration saved to LittleFS");
-  } else {
-    Serial.println("Failed to save counter configuration");
-    sendDebugMessage("Failed to save counter configuration");
-  }
-}
-// Load counter configuration from JSON
+// Import the counter configuration from the pre-store JSON file
 void loadCounterConfig() {
-  const int DEFAULT_COUNTER_PINS[4] = {37, 38, 39, 40};
   bool useDefaultConfig = false;
 
   if (LittleFS.exists("/counter_config.json")) {
     File file = LittleFS.open("/counter_config.json", "r");
     if (file) {
-      String jsonString = file.readString();
-      file.close();
+      String jsonString = fsReadString(file, "/counter_config.json");
       
       JSONVar config = JSON.parse(jsonString);
       
@@ -719,51 +2525,30 @@ void loadCounterConfig() {
   }
 
   if (useDefaultConfig) {
-    Serial.println("Using default counter configuration");
-    for (int i = 0; i < 4; i++) {
-      systemStatus.counters[i].pin = DEFAULT_COUNTER_PINS[i];
-      systemStatus.counters[i].delayFilter = 50; // Mặc định 50ms
-      systemStatus.counters[i].count = 0;
-      systemStatus.counters[i].lastState = digitalRead(systemStatus.counters[i].pin);
-      systemStatus.counters[i].stableState = systemStatus.counters[i].lastState;
-      systemStatus.counters[i].lastDebounceTime = 0;
-    }
-    saveCounterConfig();
+    applyDefaultCounterConfig();
   }
 
-  initCounters();
-  
   Serial.println("Counter configuration loaded");
   sendDebugMessage("Counter configuration loaded from LittleFS");
 }
 
-
-// Save admin credentials to JSON
-void saveAdminCredentials() {
-  JSONVar config;
-  config["username"] = systemStatus.adminCredentials.username;
-  config["password"] = systemStatus.adminCredentials.password; // Should be hashed in production
-
-  String jsonString = JSON.stringify(config);
-  
-  File file = LittleFS.open("/admin_credentials.json", "w");
-  if (file) {
-    file.print(jsonString);
-    file.close();
-    Serial.println("Admin credentials saved");
-    sendDebugMessage("Admin credentials saved to LittleFS");
-  } else {
-    Serial.println("Failed to save admin credentials");
-    sendDebugMessage("Failed to save admin credentials");
+// Factory counter setup; initCounters() samples the pins afterwards
+void applyDefaultCounterConfig() {
+  Serial.println("Using default counter configuration");
+  for (int i = 0; i < 4; i++) {
+    systemStatus.counters[i].pin = DEFAULT_COUNTER_PINS[i];
+    systemStatus.counters[i].delayFilter = 50; // Mặc định 50ms
+    systemStatus.counters[i].count = 0;
   }
 }
-// Load admin credentials from JSON
+
+
+// Import admin credentials from the pre-store JSON file (the defaults stay otherwise)
 void loadAdminCredentials() {
   if (LittleFS.exists("/admin_credentials.json")) {
     File file = LittleFS.open("/admin_credentials.json", "r");
     if (file) {
-      String jsonString = file.readString();
-      file.close();
+      String jsonString = fsReadString(file, "/admin_credentials.json");
       
       JSONVar config = JSON.parse(jsonString);
       
@@ -773,18 +2558,23 @@ void loadAdminCredentials() {
         return;
       }
       
-      systemStatus.adminCredentials.username = (const char*)config["username"];
-      systemStatus.adminCredentials.password = (const char*)config["password"];
+      String username = (const char*)config["username"];
+      String password = (const char*)config["password"];
+      if (username.length() > ADMIN_CREDENTIAL_MAX || password.length() > ADMIN_CREDENTIAL_MAX) {
+        Serial.println("Admin credentials too long for the config store, keeping the defaults");
+        sendDebugMessage("Admin credentials too long for the config store, keeping the defaults");
+        return;
+      }
+      systemStatus.adminCredentials.username = username;
+      systemStatus.adminCredentials.password = password;
       
       Serial.println("Admin credentials loaded");
       sendDebugMessage("Admin credentials loaded from LittleFS");
     }
-  } else {
-    saveAdminCredentials();
   }
 }
-// Send counter status via WebSocket
-void sendCounterStatus() {
+// Serialize counter status message
+String buildCounterStatusJson() {
   JSONVar counterStatus;
   counterStatus["action"] = "counter_status";
   counterStatus["planDisplay"] = systemStatus.planDisplay;
@@ -799,7 +2589,51 @@ void sendCounterStatus() {
     countersArray[i] = counterObj;
   }
   counterStatus["counters"] = countersArray;
-  String jsonString = JSON.stringify(counterStatus);
+  return JSON.stringify(counterStatus);
+}
+
+// Replace a cached topic snapshot
+void storeSnapshot(String &snapshot, const String &jsonString) {
+  if (xSemaphoreTake(snapshotMutex, portMAX_DELAY) == pdTRUE) {
+    snapshot = jsonString;
+    xSemaphoreGive(snapshotMutex);
+  }
+}
+
+// Copy a cached topic snapshot
+String readSnapshot(const String &snapshot) {
+  String copy;
+  if (xSemaphoreTake(snapshotMutex, portMAX_DELAY) == pdTRUE) {
+    copy = snapshot;
+    xSemaphoreGive(snapshotMutex);
+  }
+  return copy;
+}
+
+// Send the cached snapshots to a single client instead of broadcasting
+void sendSnapshots(AsyncWebSocketClient *client) {
+  String systemJson = readSnapshot(systemStatusSnapshot);
+  if (systemJson.length() == 0) {
+    systemJson = buildSystemStatusJson();
+    storeSnapshot(systemStatusSnapshot, systemJson);
+  }
+  String counterJson = readSnapshot(counterStatusSnapshot);
+  if (counterJson.length() == 0) {
+    counterJson = buildCounterStatusJson();
+    storeSnapshot(counterStatusSnapshot, counterJson);
+  }
+  client->text(systemJson);
+  client->text(counterJson);
+  if (systemStatus.loraE32.role == LORA_ROLE_GATEWAY) {
+    String nodeJson = readSnapshot(nodeTableSnapshot);
+    client->text(nodeJson.length() > 0 ? nodeJson : buildNodeTableJson());
+  }
+}
+
+// Send counter status via WebSocket
+void sendCounterStatus() {
+  String jsonString = buildCounterStatusJson();
+  storeSnapshot(counterStatusSnapshot, jsonString);
   ws.textAll(jsonString);
   if (DEBUG_MODE) {
     Serial.println("Counter Status:\n" + jsonString);
@@ -807,13 +2641,10 @@ void sendCounterStatus() {
 }
 
 // Update counter status with debounce
+// Runs only in the counter task, which sets the 10ms pace; publishing is handed
+// to CounterPublish so nothing here blocks on the network or JSON
 void updateCounterStatus() {
-  static unsigned long lastCheckTime = 0;
   unsigned long currentTime = millis();
-  
-  // Chỉ kiểm tra mỗi 10ms
-  if (currentTime - lastCheckTime < 10) return;
-  lastCheckTime = currentTime;
 
   for (int i = 0; i < 4; i++) {
     bool currentState = digitalRead(systemStatus.counters[i].pin);
@@ -830,8 +2661,12 @@ void updateCounterStatus() {
         // Đếm sườn xuống (HIGH -> LOW) với INPUT_PULLUP
         if (systemStatus.counters[i].stableState == HIGH && currentState == LOW) {
           systemStatus.counters[i].count++;
-          saveCounterConfig();
-          sendCounterStatus();
+          if (bootFirstCountUs == 0) {
+            bootFirstCountUs = esp_timer_get_time();
+          }
+          saveCounterRtcCache();
+          markCountsDirty();
+          requestCounterPublish();
         }
         systemStatus.counters[i].stableState = currentState;
       }
@@ -839,6 +2674,95 @@ void updateCounterStatus() {
   }
 }
 
+// Append the current counter values to the history ring buffer
+void recordHistorySample() {
+  HistoryRecord record;
+  record.uptimeSeconds = (millis() - bootTime) / 1000;
+  for (int i = 0; i < 4; i++) {
+    record.counts[i] = systemStatus.counters[i].count;
+  }
+  portENTER_CRITICAL(&historyMux);
+  historyBuffer[historyHead] = record;
+  historyHead = (historyHead + 1) % HISTORY_CAPACITY;
+  if (historyCount < HISTORY_CAPACITY) {
+    historyCount++;
+  }
+  historyWritten++;
+  portEXIT_CRITICAL(&historyMux);
+}
+
+// Records still in the ring, as record numbers [*first, *end)
+void historyRange(uint32_t *first, uint32_t *end) {
+  portENTER_CRITICAL(&historyMux);
+  *end = historyWritten;
+  *first = historyWritten - historyCount;
+  portEXIT_CRITICAL(&historyMux);
+}
+
+// Copy record number `sequence` out of the ring; false once the writer has overwritten it
+bool copyHistoryRecord(uint32_t sequence, HistoryRecord *out) {
+  portENTER_CRITICAL(&historyMux);
+  bool valid = historyWritten - sequence - 1 < (uint32_t)historyCount;
+  if (valid) {
+    *out = historyBuffer[sequence % HISTORY_CAPACITY];
+  }
+  portEXIT_CRITICAL(&historyMux);
+  return valid;
+}
+
+// One /api/history response in progress: the next record number to send and the
+// copy of the record being sent
+struct HistoryStream {
+  uint32_t next;
+  uint32_t end;
+  HistoryRecord record;
+  size_t recordSent;
+};
+
+// Serve history as raw HistoryRecord structs, optionally only records newer than ?since=<seconds>
+void handleHistoryRequest(AsyncWebServerRequest *request) {
+  uint32_t since = 0;
+  if (request->hasParam("since")) {
+    since = request->getParam("since")->value().toInt();
+  }
+
+  std::shared_ptr<HistoryStream> stream(new HistoryStream());
+  historyRange(&stream->next, &stream->end);
+  stream->recordSent = sizeof(HistoryRecord);
+
+  // Records are in time order, so skip the prefix older than "since"
+  HistoryRecord record;
+  while (since > 0 && stream->next != stream->end && copyHistoryRecord(stream->next, &record) &&
+         record.uptimeSeconds <= since) {
+    stream->next++;
+  }
+
+  // Chunked: the sampler may overwrite records the client has not received yet,
+  // and the response then ends early instead of sending newer records out of order
+  AsyncWebServerResponse *response = request->beginChunkedResponse("application/octet-stream",
+    [stream](uint8_t *buffer, size_t maxLen, size_t index) -> size_t {
+      size_t written = 0;
+      while (written < maxLen) {
+        if (stream->recordSent == sizeof(HistoryRecord)) {
+          if (stream->next == stream->end || !copyHistoryRecord(stream->next, &stream->record)) {
+            break;
+          }
+          stream->next++;
+          stream->recordSent = 0;
+        }
+        size_t chunk = min(sizeof(HistoryRecord) - stream->recordSent, maxLen - written);
+        memcpy(buffer + written, (const uint8_t *)&stream->record + stream->recordSent, chunk);
+        stream->recordSent += chunk;
+        written += chunk;
+      }
+      return written;
+    });
+  response->addHeader("X-Record-Size", String(sizeof(HistoryRecord)));
+  response->addHeader("X-Device-Uptime", String((millis() - bootTime) / 1000));
+  response->addHeader("Cache-Control", "no-store");
+  request->send(response);
+}
+
 // Check admin session timeout
 void checkAdminTimeout() {
   if (systemStatus.adminMode && (millis() - lastAdminActivity) > ADMIN_TIMEOUT) {
@@ -853,6 +2777,7 @@ void controlOutput(int pin, bool state) {
   // Update system status
   for (int i = 0; i < NUM_OUTPUTS; i++) {
     if (OUTPUT_PINS[i] == pin) {
+      logEvent(EVENT_OUTPUT, pin, state, systemStatus.outputs[i].state);
       systemStatus.outputs[i].state = state;
       systemStatus.outputs[i].stateStr = state ? "HIGH" : "LOW";
       break;
@@ -860,7 +2785,7 @@ void controlOutput(int pin, bool state) {
   }
   
   // Save configuration
-  saveIOConfig();
+  markConfigDirty(CONFIG_DIRTY_IO);
   
   Serial.printf("Output pin %d set to %s\n", pin, state ? "HIGH" : "LOW");
 }
@@ -879,58 +2804,290 @@ void sendDebugMessage(const String& message) {
   }
 }
 
+// Serialize system status message
+String buildSystemStatusJson() {
+  JSONVar response;
+  response["action"] = "system_status";
+  response["reset_count"] = systemStatus.resetCount;
+  response["free_heap"] = (int)systemStatus.freeHeap;
+  response["free_psram"] = (int)systemStatus.freePsram;
+  response["temperature"] = systemStatus.temperature;
+  response["ip_address"] = systemStatus.ipAddress;
+  response["uptime"] = (int)systemStatus.uptime;
+
+  // Add input states
+  JSONVar inputsArray;
+  for (int i = 0; i < NUM_INPUTS; i++) {
+    JSONVar inputObj;
+    inputObj["pin"] = systemStatus.inputs[i].pin;
+    inputObj["state"] = systemStatus.inputs[i].stateStr;
+    inputsArray[i] = inputObj;
+  }
+  response["inputs"] = inputsArray;
+
+  // Add output states
+  JSONVar outputsArray;
+  for (int i = 0; i < NUM_OUTPUTS; i++) {
+    JSONVar outputObj;
+    outputObj["pin"] = systemStatus.outputs[i].pin;
+    outputObj["state"] = systemStatus.outputs[i].stateStr;
+    outputsArray[i] = outputObj;
+  }
+  response["outputs"] = outputsArray;
+
+  // Add LoRa E32 information
+  JSONVar loraE32Obj;
+  const LoRaE32Config &lora = systemStatus.loraE32;
+  loraE32Obj["initialized"] = lora.initialized;
+  if (lora.initialized) {
+    char moduleInfo[48];
+    snprintf(moduleInfo, sizeof(moduleInfo), "HEAD: %x, Freq: %x, Ver: %x, Features: %x",
+             systemStatus.loraModule.head, systemStatus.loraModule.frequency,
+             systemStatus.loraModule.version, systemStatus.loraModule.features);
+    loraE32Obj["moduleInfo"] = moduleInfo;
+    loraE32Obj["frequency"] = String(loraChannelMHz(lora.chan)) + "MHz";
+    loraE32Obj["airDataRate"] = loraAirDataRateNames[lora.airDataRate];
+    loraE32Obj["uartBaudRate"] = loraUartBaudRateNames[lora.uartBaudRate];
+    loraE32Obj["transmissionPower"] = loraTransmissionPowerNames[lora.transmissionPower];
+    loraE32Obj["parityBit"] = loraUartParityNames[lora.uartParity];
+    loraE32Obj["wirelessWakeupTime"] = loraWakeUpTimeNames[lora.wirelessWakeupTime];
+    loraE32Obj["fec"] = loraFecNames[lora.fec];
+    loraE32Obj["fixedTransmission"] = loraFixedTransmissionNames[lora.fixedTransmission];
+    loraE32Obj["ioDriveMode"] = loraIoDriveModeNames[lora.ioDriveMode];
+  }
+  loraE32Obj["addh"] = lora.addh;
+  loraE32Obj["addl"] = lora.addl;
+  loraE32Obj["chan"] = lora.chan;
+  loraE32Obj["uartLinkBaud"] = (double)loraUartBaud;
+  loraE32Obj["uartErrors"] = (double)loraUartErrors;
+  loraE32Obj["operatingMode"] = systemStatus.loraE32.operatingMode;
+  loraE32Obj["role"] = systemStatus.loraE32.role;
+  response["loraE32"] = loraE32Obj;
+
+  // LoRa receive statistics
+  JSONVar loraRxObj;
+  loraRxObj["bytes"] = (double)loraRxParser.stats.bytes;
+  loraRxObj["frames"] = (double)loraRxParser.stats.frames;
+  loraRxObj["skippedBytes"] = (double)loraRxParser.stats.skippedBytes;
+  loraRxObj["crcErrors"] = (double)loraRxParser.stats.crcErrors;
+  loraRxObj["overflows"] = (double)loraRxParser.stats.overflows;
+  loraRxObj["bytesPerSecond"] = systemStatus.uptime > 0 ? loraRxParser.stats.bytes * 1000.0 / systemStatus.uptime : 0.0;
+  portENTER_CRITICAL(&linkStatsMux);
+  unsigned long rxBursts = loraRxBursts;
+  unsigned long rxLatencyTotal = loraRxLatencyTotal;
+  unsigned long rxLatencyMax = loraRxLatencyMax;
+  portEXIT_CRITICAL(&linkStatsMux);
+  loraRxObj["latencyAvgUs"] = rxBursts > 0 ? (double)(rxLatencyTotal / rxBursts) : 0.0;
+  loraRxObj["latencyMaxUs"] = (double)rxLatencyMax;
+  response["loraRx"] = loraRxObj;
+
+  // Air-time ledger: how busy each channel is over the duty window
+  LoRaChannelUsage usage[LORA_DUTY_CHANNELS];
+  portENTER_CRITICAL(&dutyLedgerMux);
+  size_t channelCount = loraDutyLedger.snapshot(usage, millis());
+  portEXIT_CRITICAL(&dutyLedgerMux);
+  JSONVar loraAirObj;
+  loraAirObj["windowMs"] = (double)loraDutyLedger.windowMs();
+  loraAirObj["budgetPercent"] = LORA_DUTY_CYCLE_PERCENT;
+  loraAirObj["deferred"] = (double)loraDutyDeferred;
+  loraAirObj["packetAirTimeMs"] = (double)estimateAirTimeMs(systemStatus.loraE32.airDataRate, systemStatus.loraE32.fec,
+                                                            LORA_MAX_PACKET_SIZE);
+  JSONVar channelsArray;
+  for (size_t i = 0; i < channelCount; i++) {
+    JSONVar channelObj;
+    channelObj["chan"] = usage[i].chan;
+    channelObj["ownMs"] = (double)usage[i].ownMs;
+    channelObj["heardMs"] = (double)usage[i].heardMs;
+    channelObj["ownPercent"] = usage[i].ownMs * 100.0 / loraDutyLedger.windowMs();
+    channelObj["occupancyPercent"] = (usage[i].ownMs + usage[i].heardMs) * 100.0 / loraDutyLedger.windowMs();
+    channelsArray[(int)i] = channelObj;
+  }
+  loraAirObj["channels"] = channelsArray;
+  response["loraAir"] = loraAirObj;
+
+  // Reliable delivery counters (sender side on nodes, ACK side on gateways)
+  portENTER_CRITICAL(&linkStatsMux);
+  LoRaReliableStats reliableStats = loraReliableSnapshot;
+  size_t inFlight = loraInFlightSnapshot;
+  portEXIT_CRITICAL(&linkStatsMux);
+  JSONVar loraReliableObj;
+  loraReliableObj["enabled"] = LORA_RELIABLE_DELIVERY;
+  loraReliableObj["window"] = (int)LORA_RELIABLE_WINDOW;
+  loraReliableObj["inFlight"] = (int)inFlight;
+  loraReliableObj["queued"] = (double)reliableStats.queued;
+  loraReliableObj["transmissions"] = (double)reliableStats.transmissions;
+  loraReliableObj["retransmissions"] = (double)reliableStats.retransmissions;
+  loraReliableObj["acked"] = (double)reliableStats.acked;
+  loraReliableObj["dropped"] = (double)reliableStats.dropped;
+  loraReliableObj["srttMs"] = (double)reliableStats.srttMs;
+  loraReliableObj["acksSent"] = (double)loraAcksSent;
+  loraReliableObj["duplicates"] = (double)loraReliableDuplicates;
+  response["loraReliable"] = loraReliableObj;
+
+  // Link quality: traffic both ways, failures, ACK round trips and last contact per peer
+  portENTER_CRITICAL(&linkStatsMux);
+  LoRaTxStats txStats = loraTxStats;
+  portEXIT_CRITICAL(&linkStatsMux);
+  JSONVar loraLinkObj;
+  loraLinkObj["framesSent"] = (double)txStats.frames;
+  loraLinkObj["bytesSent"] = (double)txStats.bytes;
+  loraLinkObj["sendFailures"] = (double)txStats.failures;
+  loraLinkObj["framesReceived"] = (double)loraRxParser.stats.frames;
+  loraLinkObj["bytesReceived"] = (double)loraRxParser.stats.bytes;
+  loraLinkObj["crcErrors"] = (double)loraRxParser.stats.crcErrors;
+  loraLinkObj["retransmissions"] = (double)reliableStats.retransmissions;
+  loraLinkObj["rttSamples"] = (double)reliableStats.rtt.count();
+  loraLinkObj["rttMeanMs"] = (double)reliableStats.rtt.meanMs();
+  loraLinkObj["rttP99Ms"] = (double)reliableStats.rtt.percentileMs(99);
+  JSONVar peersArray;
+  int peerCount = 0;
+  unsigned long now = millis();
+  for (size_t i = 0; i < loraPeers.capacity(); i++) {
+    portENTER_CRITICAL(&linkStatsMux);
+    LoRaPeerEntry peer = loraPeers.slot(i);
+    portEXIT_CRITICAL(&linkStatsMux);
+    if (!peer.used) {
+      continue;
+    }
+    JSONVar peerObj;
+    peerObj["address"] = peer.address;
+    peerObj["lastSeenMs"] = (double)(now - peer.lastSeen);
+    peerObj["frames"] = (double)peer.frames;
+    peerObj["bytes"] = (double)peer.bytes;
+    peersArray[peerCount++] = peerObj;
+  }
+  loraLinkObj["peers"] = peersArray;
+  response["loraLink"] = loraLinkObj;
+
+  return JSON.stringify(response);
+}
+
+// Prometheus text exposition of the radio link counters
+String buildMetrics() {
+  portENTER_CRITICAL(&linkStatsMux);
+  LoRaTxStats txStats = loraTxStats;
+  LoRaReliableStats reliableStats = loraReliableSnapshot;
+  portEXIT_CRITICAL(&linkStatsMux);
+  portENTER_CRITICAL(&dutyLedgerMux);
+  LoRaChannelUsage usage = loraDutyLedger.usage(systemStatus.loraE32.chan, millis());
+  portEXIT_CRITICAL(&dutyLedgerMux);
+
+  String out;
+  out.reserve(2560);
+  auto metric = [&out](const char *name, const char *type, double value) {
+    out += String("# TYPE ") + name + " " + type + "\n" + name + " " + String(value, 0) + "\n";
+  };
+  metric("e32_up", "gauge", systemStatus.loraE32.initialized ? 1 : 0);
+  metric("e32_frames_sent_total", "counter", txStats.frames);
+  metric("e32_bytes_sent_total", "counter", txStats.bytes);
+  metric("e32_send_failures_total", "counter", txStats.failures);
+  metric("e32_frames_received_total", "counter", loraRxParser.stats.frames);
+  metric("e32_bytes_received_total", "counter", loraRxParser.stats.bytes);
+  metric("e32_crc_errors_total", "counter", loraRxParser.stats.crcErrors);
+  metric("e32_skipped_bytes_total", "counter", loraRxParser.stats.skippedBytes);
+  metric("e32_retransmissions_total", "counter", reliableStats.retransmissions);
+  metric("e32_dropped_total", "counter", reliableStats.dropped);
+  metric("e32_duty_deferred_total", "counter", loraDutyDeferred);
+  metric("e32_uart_baud", "gauge", loraUartBaud);
+  metric("e32_uart_errors_total", "counter", loraUartErrors);
+  metric("e32_rtt_mean_ms", "gauge", reliableStats.rtt.meanMs());
+  metric("e32_rtt_p99_ms", "gauge", reliableStats.rtt.percentileMs(99));
+  metric("e32_channel_own_ms", "gauge", usage.ownMs);
+  metric("e32_channel_heard_ms", "gauge", usage.heardMs);
+  metric("power_fail_flushes_total", "counter", powerFailFlushes);
+  metric("power_fail_flush_last_us", "gauge", powerFailLastUs);
+  metric("power_fail_flush_worst_us", "gauge", powerFailWorstUs);
+  metric("power_fail_overruns_total", "counter", powerFailOverruns);
+  if (POWER_FAIL_BOARD_MA > 0 && POWER_FAIL_DROOP_MV > 0) {
+    // C >= I * t / dV; mA * us / mV comes out in uF
+    metric("power_fail_holdup_uf", "gauge", (double)POWER_FAIL_BOARD_MA * powerFailWorstUs / POWER_FAIL_DROOP_MV);
+  }
+  metric("export_completed_total", "counter", exportsCompleted);
+  metric("export_last_bytes", "gauge", exportLastBytes);
+  metric("export_last_rows", "gauge", exportLastRows);
+  metric("export_last_bytes_per_second", "gauge", exportLastUs > 0 ? exportLastBytes * 1e6 / exportLastUs : 0);
+  // Sustained rate: every completed export start to finish, lock retries included
+  metric("export_bytes_total", "counter", (double)exportTotalBytes);
+  metric("export_us_total", "counter", (double)exportTotalUs);
+  metric("export_bytes_per_second", "gauge", exportTotalUs > 0 ? exportTotalBytes * 1e6 / exportTotalUs : 0);
+  metric("export_lock_retries_total", "counter", exportLockRetries);
+#ifdef EMBED_WEB_ASSETS
+  const char *pageSource = "flash";
+#else
+  const char *pageSource = "littlefs";
+#endif
+  out += String("# TYPE web_first_byte_info gauge\nweb_first_byte_info{source=\"") + pageSource + "\"} 1\n";
+  metric("web_first_byte_pages_total", "counter", firstByteStats.count);
+  metric("web_first_byte_last_us", "gauge", firstByteStats.lastUs);
+  metric("web_first_byte_max_us", "gauge", firstByteStats.maxUs);
+  metric("web_first_byte_mean_us", "gauge",
+         firstByteStats.count > 0 ? (double)firstByteStats.totalUs / firstByteStats.count : 0);
+
+  out += "# TYPE e32_peer_last_seen_seconds gauge\n";
+  unsigned long now = millis();
+  for (size_t i = 0; i < loraPeers.capacity(); i++) {
+    portENTER_CRITICAL(&linkStatsMux);
+    LoRaPeerEntry peer = loraPeers.slot(i);
+    portEXIT_CRITICAL(&linkStatsMux);
+    if (!peer.used) {
+      continue;
+    }
+    char line[80];
+    snprintf(line, sizeof(line), "e32_peer_last_seen_seconds{address=\"%04X\"} %lu\n", peer.address,
+             (now - peer.lastSeen) / 1000);
+    out += line;
+  }
+
+  portENTER_CRITICAL(&fsStatsMux);
+  FsStatsTable<FS_STATS_FILES> fs = fsStats;
+  portEXIT_CRITICAL(&fsStatsMux);
+  LoRaBaudLatency baudLatency[8];
+  portENTER_CRITICAL(&linkStatsMux);
+  memcpy(baudLatency, loraBaudLatency, sizeof(baudLatency));
+  portEXIT_CRITICAL(&linkStatsMux);
+  out += "# TYPE e32_tx_mean_us gauge\n# TYPE e32_tx_max_us gauge\n"
+         "# TYPE e32_rx_latency_mean_us gauge\n# TYPE e32_rx_latency_max_us gauge\n";
+  for (uint8_t i = 0; i < 8; i++) {
+    const LoRaBaudLatency &baud = baudLatency[i];
+    if (baud.txFrames == 0 && baud.rxBursts == 0) {
+      continue;
+    }
+    char line[320];
+    unsigned long rate = uartBaudRateTable[i];
+    snprintf(line, sizeof(line),
+             "e32_tx_mean_us{baud=\"%lu\"} %lu\ne32_tx_max_us{baud=\"%lu\"} %lu\n"
+             "e32_rx_latency_mean_us{baud=\"%lu\"} %lu\ne32_rx_latency_max_us{baud=\"%lu\"} %lu\n",
+             rate, (unsigned long)(baud.txFrames > 0 ? baud.txTotalUs / baud.txFrames : 0), rate,
+             (unsigned long)baud.txMaxUs, rate, (unsigned long)(baud.rxBursts > 0 ? baud.rxTotalUs / baud.rxBursts : 0),
+             rate, (unsigned long)baud.rxMaxUs);
+    out += line;
+  }
+
+  out += "# TYPE fs_writes_total counter\n# TYPE fs_written_bytes_total counter\n"
+         "# TYPE fs_write_p99_us gauge\n# TYPE fs_erases_estimated gauge\n";
+  for (size_t i = 0; i < fs.size(); i++) {
+    const FsFileStats &file = fs.file(i);
+    char line[256];
+    snprintf(line, sizeof(line),
+             "fs_writes_total{file=\"%s\"} %lu\nfs_written_bytes_total{file=\"%s\"} %llu\n"
+             "fs_write_p99_us{file=\"%s\"} %lu\nfs_erases_estimated{file=\"%s\"} %.2f\n",
+             file.path, (unsigned long)file.writes, file.path, (unsigned long long)file.bytesWritten, file.path,
+             (unsigned long)file.writeLatency.percentileUs(99), file.path, fs.erases(file));
+    out += line;
+  }
+  double uptimeSeconds = esp_timer_get_time() / 1000000.0;
+  out += "# TYPE fs_flash_lifetime_years gauge\nfs_flash_lifetime_years " +
+         String(fs.lifetimeYears(LittleFS.totalBytes() / FS_BLOCK_SIZE, FLASH_ERASE_ENDURANCE, uptimeSeconds), 1) +
+         "\n";
+  return out;
+}
+
 // Send system status via WebSocket
 void sendSystemStatus() {
+  // Keep the snapshot current even without clients so new connections get fresh data
+  String jsonString = buildSystemStatusJson();
+  storeSnapshot(systemStatusSnapshot, jsonString);
   if (ws.count() > 0) {
-    JSONVar response;
-    response["action"] = "system_status";
-    response["reset_count"] = systemStatus.resetCount;
-    response["free_heap"] = (int)systemStatus.freeHeap;
-    response["free_psram"] = (int)systemStatus.freePsram;
-    response["temperature"] = systemStatus.temperature;
-    response["ip_address"] = systemStatus.ipAddress;
-    response["uptime"] = (int)systemStatus.uptime;
-
-    // Add input states
-    JSONVar inputsArray;
-    for (int i = 0; i < NUM_INPUTS; i++) {
-      JSONVar inputObj;
-      inputObj["pin"] = systemStatus.inputs[i].pin;
-      inputObj["state"] = systemStatus.inputs[i].stateStr;
-      inputsArray[i] = inputObj;
-    }
-    response["inputs"] = inputsArray;
-
-    // Add output states
-    JSONVar outputsArray;
-    for (int i = 0; i < NUM_OUTPUTS; i++) {
-      JSONVar outputObj;
-      outputObj["pin"] = systemStatus.outputs[i].pin;
-      outputObj["state"] = systemStatus.outputs[i].stateStr;
-      outputsArray[i] = outputObj;
-    }
-    response["outputs"] = outputsArray;
-
-    // Add LoRa E32 information
-    JSONVar loraE32Obj;
-    loraE32Obj["initialized"] = systemStatus.loraE32.initialized;
-    loraE32Obj["moduleInfo"] = systemStatus.loraE32.moduleInfo;
-    loraE32Obj["addh"] = systemStatus.loraE32.addh;
-    loraE32Obj["addl"] = systemStatus.loraE32.addl;
-    loraE32Obj["chan"] = systemStatus.loraE32.chan;
-    loraE32Obj["frequency"] = systemStatus.loraE32.frequency;
-    loraE32Obj["airDataRate"] = systemStatus.loraE32.airDataRateStr;
-    loraE32Obj["uartBaudRate"] = systemStatus.loraE32.uartBaudRateStr;
-    loraE32Obj["transmissionPower"] = systemStatus.loraE32.transmissionPowerStr;
-    loraE32Obj["parityBit"] = systemStatus.loraE32.parityBit;
-    loraE32Obj["wirelessWakeupTime"] = systemStatus.loraE32.wirelessWakeupTimeStr;
-    loraE32Obj["fec"] = systemStatus.loraE32.fecStr;
-    loraE32Obj["fixedTransmission"] = systemStatus.loraE32.fixedTransmissionStr;
-    loraE32Obj["ioDriveMode"] = systemStatus.loraE32.ioDriveModeStr;
-    loraE32Obj["operatingMode"] = systemStatus.loraE32.operatingMode;
-    response["loraE32"] = loraE32Obj;
-
-    String jsonString = JSON.stringify(response);
     ws.textAll(jsonString);
 
     if (DEBUG_MODE) {
@@ -939,20 +3096,43 @@ void sendSystemStatus() {
   }
 }
 
+// Parameters handed to setLoRaConfigTask
+struct LoRaConfigRequest {
+  LoRaE32Config config;
+  bool persist;
+};
+
 void setLoRaConfigTask(void *pvParameters) {
-  LoRaE32Config *config = (LoRaE32Config *)pvParameters;
-  setLoRaConfig(*config);
+  LoRaConfigRequest *request = (LoRaConfigRequest *)pvParameters;
+  setLoRaConfig(request->config, request->persist);
   sendSystemStatus();
   if (DEBUG_MODE) {
     Serial.printf("SetLoRaConfigTask Stack High Water Mark: %d bytes\n", uxTaskGetStackHighWaterMark(NULL));
   }
-  delete config; // Free dynamic memory
+  delete request; // Free dynamic memory
   vTaskDelay(pdMS_TO_TICKS(100));
   vTaskDelete(NULL);
 }
 
+// Operating mode change, off async_tcp since loraMutex may be held by a
+// configuration write. The mode is passed as the task parameter.
+void setLoRaModeTask(void *pvParameters) {
+  uint8_t mode = (uint8_t)(uintptr_t)pvParameters;
+  // Entering or leaving program mode reopens Serial1 under the receive task
+  if (xSemaphoreTake(loraMutex, pdMS_TO_TICKS(1000)) == pdTRUE) {
+    setLoRaOperatingMode(mode);
+    xSemaphoreGive(loraMutex);
+    storeLoRaConfig();
+    sendDebugMessage(String("LoRa E32 set to ") + loraModeName(mode) + " Mode");
+    sendSystemStatus();
+  } else {
+    sendDebugMessage("Failed to acquire LoRa mutex");
+  }
+  vTaskDelete(NULL);
+}
+
 // Handle WebSocket messages
-void handleWebSocketMessage(void *arg, uint8_t *data, size_t len) {
+void handleWebSocketMessage(AsyncWebSocketClient *client, void *arg, uint8_t *data, size_t len) {
   AwsFrameInfo *info = (AwsFrameInfo*)arg;
   if (info->final && info->index == 0 && info->len == len && info->opcode == WS_TEXT) {
     data[len] = 0;
@@ -975,12 +3155,20 @@ void handleWebSocketMessage(void *arg, uint8_t *data, size_t len) {
       controlOutput(pin, state);
     }
     else if (action == "get_lora_e32_config" || action == "get_counter_config") {
-      sendSystemStatus();
-      sendCounterStatus();
+      sendSnapshots(client);
+    }
+    else if (action == "get_fs_stats") {
+      client->text(buildFsStatsJson());
     }
     else if (action == "refresh_lora_e32") {
-      initLoRaE32();
-      sendSystemStatus();
+      // Re-probing reopens Serial1 and waits for the module, so it runs in the
+      // task that owns the UART instead of here on async_tcp
+      if (loraRxTaskHandle == NULL) {
+        sendDebugMessage("LoRa E32 not started yet");
+        return;
+      }
+      loraReprobeRequested = true;
+      xTaskNotifyGive(loraRxTaskHandle);
     }
     else if (action == "set_lora_e32_config") {
       if (!json.hasOwnProperty("addh") || !json.hasOwnProperty("addl") || !json.hasOwnProperty("chan") ||
@@ -992,7 +3180,10 @@ void handleWebSocketMessage(void *arg, uint8_t *data, size_t len) {
         return;
       }
       
-      LoRaE32Config *config = new LoRaE32Config();
+      LoRaConfigRequest *request = new LoRaConfigRequest();
+      LoRaE32Config *config = &request->config;
+      // "trial": true writes a temporary configuration that is neither saved in the module nor in LittleFS
+      request->persist = !(json.hasOwnProperty("trial") && (bool)json["trial"]);
       config->addh = (int)json["addh"];
       config->addl = (int)json["addl"];
       config->chan = (int)json["chan"];
@@ -1005,21 +3196,22 @@ void handleWebSocketMessage(void *arg, uint8_t *data, size_t len) {
       config->fec = (int)json["fec"];
       config->transmissionPower = (int)json["transmissionPower"];
       config->operatingMode = systemStatus.loraE32.operatingMode;
+      if (json.hasOwnProperty("role")) {
+        // Role is local behaviour, not a radio register, so it applies even without the module
+        systemStatus.loraE32.role = (int)json["role"] == LORA_ROLE_GATEWAY ? LORA_ROLE_GATEWAY : LORA_ROLE_NODE;
+        storeLoRaConfig();
+      }
+      config->role = systemStatus.loraE32.role;
       
-      xTaskCreatePinnedToCore(
-        setLoRaConfigTask,
-        "SetLoRaConfigTask",
-        4096,
-        config,
-        2,
-        NULL,
-        1
-      );
+      startTask(TASK_LORA_CONFIG, setLoRaConfigTask, request);
     }
     else if (action == "set_lora_operating_mode") {
-      uint8_t mode = (int)json["mode"];
-      setLoRaOperatingMode(mode);
-      sendSystemStatus();
+      int mode = (int)json["mode"];
+      if (mode < 0 || mode > 3) {
+        sendDebugMessage("Invalid LoRa E32 operating mode");
+        return;
+      }
+      startTask(TASK_LORA_MODE, setLoRaModeTask, (void *)(uintptr_t)mode);
     }
     else if (action == "reset_counter") {
       int counterIndex = (int)json["index"]; // 0-3
@@ -1038,7 +3230,7 @@ void handleWebSocketMessage(void *arg, uint8_t *data, size_t len) {
         systemStatus.counters[i].lastDebounceTime = 0;
       }
       initCounters();
-      saveCounterConfig();
+      markConfigDirty(CONFIG_DIRTY_COUNTER);
       sendCounterStatus();
     }
     else if (action == "admin_login") {
@@ -1058,18 +3250,53 @@ void handleWebSocketMessage(void *arg, uint8_t *data, size_t len) {
         response["success"] = false;
         sendDebugMessage("Admin login failed");
       }
-      ws.textAll(JSON.stringify(response));
+      client->text(JSON.stringify(response));
+    }
+    else if (action == "run_task_benchmark" && systemStatus.adminMode) {
+      bool sweep = json.hasOwnProperty("sweep") && (bool)json["sweep"];
+      startTaskBenchmark(sweep);
+      sendDebugMessage(sweep ? "Task benchmark sweep started, the device restarts between layouts"
+                             : "Task benchmark started");
+    }
+    else if (action == "set_task_layout" && systemStatus.adminMode) {
+      int layout = (int)json["layout"];
+      if (layout >= 0 && layout < (int)TASK_LAYOUT_COUNT && layout != taskLayout) {
+        restartWithTaskLayout(layout);
+      }
+    }
+    else if (action == "test_power_fail_flush" && systemStatus.adminMode) {
+      // "duringCommit": true overlaps the flush with a config commit
+      if (json.hasOwnProperty("duringCommit") && (bool)json["duringCommit"]) {
+        triggerPowerFailFlushDuringCommit();
+      } else {
+        triggerPowerFailFlush();
+      }
+      sendDebugMessage(POWER_FAIL_BOARD_MA > 0 && POWER_FAIL_DROOP_MV > 0
+                           ? "Power-fail flush triggered, see /metrics for its latency and hold-up"
+                           : "Power-fail flush triggered, see /metrics for its latency");
     }
     else if (action == "change_admin_credentials" && systemStatus.adminMode) {
       String newUsername = JSON.stringify(json["username"]);
       String newPassword = JSON.stringify(json["password"]);
       newUsername.replace("\"", "");
       newPassword.replace("\"", "");
+      // The config store keeps at most ADMIN_CREDENTIAL_MAX bytes of each
+      if (newUsername.length() == 0 || newUsername.length() > ADMIN_CREDENTIAL_MAX ||
+          newPassword.length() == 0 || newPassword.length() > ADMIN_CREDENTIAL_MAX) {
+        sendDebugMessage("Admin username and password must be 1-" + String(ADMIN_CREDENTIAL_MAX) + " characters");
+        return;
+      }
       
       systemStatus.adminCredentials.username = newUsername;
       systemStatus.adminCredentials.password = newPassword;
-      saveAdminCredentials();
-      sendDebugMessage("Admin credentials updated");
+      logEvent(EVENT_CONFIG_CHANGE, CONFIG_DIRTY_ADMIN, 0, 0);
+      // Saved right away rather than through markConfigDirty(): the admin has to
+      // know whether the new password survives a restart before relying on it
+      if (commitConfigStore()) {
+        sendDebugMessage("Admin credentials updated");
+      } else {
+        sendDebugMessage("Admin credentials changed for this session only, saving them failed");
+      }
     }
   }
 }
@@ -1079,13 +3306,16 @@ void onWebSocketEvent(AsyncWebSocket *server, AsyncWebSocketClient *client, AwsE
   switch (type) {
     case WS_EVT_CONNECT:
       Serial.printf("WebSocket client #%u connected from %s\n", client->id(), client->remoteIP().toString().c_str());
-      sendSystemStatus();
+      if (bootFirstClientUs == 0) {
+        bootFirstClientUs = esp_timer_get_time();
+      }
+      sendSnapshots(client);
       break;
     case WS_EVT_DISCONNECT:
       Serial.printf("WebSocket client #%u disconnected\n", client->id());
       break;
     case WS_EVT_DATA:
-      handleWebSocketMessage(arg, data, len);
+      handleWebSocketMessage(client, arg, data, len);
       break;
     case WS_EVT_PONG:
     case WS_EVT_ERROR:
@@ -1093,23 +3323,174 @@ void onWebSocketEvent(AsyncWebSocket *server, AsyncWebSocketClient *client, AwsE
   }
 }
 
+// Called from a response filler when the first body chunk is produced, i.e.
+// once the headers are out and the body starts (for a bodyless 304, when it is
+// handed to the server). Every page and asset goes through here, from flash or
+// LittleFS. Network time is not included;
+// from a client: curl -o /dev/null -w '%{time_starttransfer}\n' http://<ip>/
+void recordFirstByte(const char* path, const char* source, unsigned long startMicros) {
+  uint32_t us = micros() - startMicros;
+  firstByteStats.count++;
+  firstByteStats.lastUs = us;
+  firstByteStats.maxUs = max(firstByteStats.maxUs, us);
+  firstByteStats.totalUs += us;
+  if (DEBUG_MODE) {
+    Serial.printf("First byte of %s from %s after %lu us\n", path, source, (unsigned long)us);
+  }
+}
+
+#ifdef EMBED_WEB_ASSETS
+// Find an embedded asset by URL path
+const WebAsset* findEmbeddedAsset(const char* path) {
+  for (size_t i = 0; i < WEB_ASSET_COUNT; i++) {
+    if (strcmp(WEB_ASSETS[i].path, path) == 0) {
+      return &WEB_ASSETS[i];
+    }
+  }
+  return nullptr;
+}
+
+// Serve a gzipped asset straight from flash, answering 304 when the browser copy is current
+void sendEmbeddedAsset(AsyncWebServerRequest *request, const WebAsset &asset) {
+  unsigned long start = micros();
+  AsyncWebServerResponse *response;
+  if (request->hasHeader("If-None-Match") && request->header("If-None-Match") == asset.etag) {
+    response = request->beginResponse(304);
+    recordFirstByte(asset.path, "flash", start);
+  } else {
+    const WebAsset *body = &asset;
+    response = request->beginResponse(asset.contentType, asset.length,
+      [body, start](uint8_t *buffer, size_t maxLen, size_t index) -> size_t {
+        if (index == 0) {
+          recordFirstByte(body->path, "flash", start);
+        }
+        size_t chunk = min(maxLen, body->length - index);
+        memcpy(buffer, body->data + index, chunk);
+        return chunk;
+      });
+    response->addHeader("Content-Encoding", "gzip");
+  }
+  response->addHeader("ETag", asset.etag);
+  response->addHeader("Cache-Control", "no-cache");
+  request->send(response);
+}
+
+// Register one GET handler per embedded asset
+void initEmbeddedAssets() {
+  for (size_t i = 0; i < WEB_ASSET_COUNT; i++) {
+    const WebAsset *asset = &WEB_ASSETS[i];
+    if (strcmp(asset->path, "/index.html") == 0) {
+      continue; // Guarded by the admin check in initWebSocket()
+    }
+    server.on(asset->path, HTTP_GET, [asset](AsyncWebServerRequest *request) {
+      sendEmbeddedAsset(request, *asset);
+    });
+  }
+  Serial.printf("Serving %u embedded web assets from flash\n", (unsigned)WEB_ASSET_COUNT);
+}
+#endif
+
+#ifndef EMBED_WEB_ASSETS
+// MIME type of a UI file, the same table scripts/embed_web_assets.py uses.
+// nullptr for anything else: the config store and event log share LittleFS and
+// are not served.
+const char* webContentType(const char* path) {
+  static const struct {
+    const char *extension;
+    const char *type;
+  } types[] = {
+    {".html", "text/html"}, {".js", "application/javascript"}, {".css", "text/css"},
+    {".json", "application/json"}, {".png", "image/png"}, {".ico", "image/x-icon"},
+    {".svg", "image/svg+xml"},
+  };
+  const char *extension = strrchr(path, '.');
+  for (size_t i = 0; extension != nullptr && i < sizeof(types) / sizeof(types[0]); i++) {
+    if (strcasecmp(extension, types[i].extension) == 0) {
+      return types[i].type;
+    }
+  }
+  return nullptr;
+}
+
+// Stream a file from LittleFS
+void sendFsFile(AsyncWebServerRequest *request, const char* path, const char* contentType) {
+  unsigned long start = micros();
+  File file = LittleFS.open(path, "r");
+  if (!file || file.isDirectory()) {
+    request->send(404, "text/plain", "Not found");
+    return;
+  }
+  // The filler owns the file; it is closed when the response is freed
+  AsyncWebServerResponse *response = request->beginResponse(contentType, file.size(),
+    [file, start](uint8_t *buffer, size_t maxLen, size_t index) mutable -> size_t {
+      if (index == 0) {
+        recordFirstByte(file.path(), "LittleFS", start);
+      }
+      return file.read(buffer, maxLen);
+    });
+  request->send(response);
+}
+#endif
+
+// Send a UI page from flash or LittleFS depending on the build
+void sendPage(AsyncWebServerRequest *request, const char* path) {
+#ifdef EMBED_WEB_ASSETS
+  const WebAsset *asset = findEmbeddedAsset(path);
+  if (asset != nullptr) {
+    sendEmbeddedAsset(request, *asset);
+  } else {
+    request->send(404, "text/plain", "Not found");
+  }
+#else
+  sendFsFile(request, path, "text/html");
+#endif
+}
+
 // Initialize WebSocket
-void initWebSocket() {
+bool initWebSocket() {
   ws.onEvent(onWebSocketEvent);
   server.addHandler(&ws);
   server.on("/", HTTP_GET, [](AsyncWebServerRequest *request) {
-    request->send(LittleFS, "/dashboard.html", "text/html");
+    sendPage(request, "/dashboard.html");
+  });
+  server.on("/api/history", HTTP_GET, handleHistoryRequest);
+  server.on("/api/events", HTTP_GET, handleEventsRequest);
+  server.on("/api/export", HTTP_GET, handleExportRequest);
+  server.on("/api/tasks", HTTP_GET, [](AsyncWebServerRequest *request) {
+    request->send(200, "application/json", buildTaskTableJson());
+  });
+  server.on("/api/nodes", HTTP_GET, [](AsyncWebServerRequest *request) {
+    request->send(200, "application/json", buildNodeTableJson());
+  });
+  server.on("/api/boot", HTTP_GET, [](AsyncWebServerRequest *request) {
+    request->send(200, "application/json", buildBootTimelineJson());
+  });
+  server.on("/metrics", HTTP_GET, [](AsyncWebServerRequest *request) {
+    request->send(200, "text/plain; version=0.0.4", buildMetrics());
   });
   server.on("/index.html", HTTP_GET, [](AsyncWebServerRequest *request) {
     if (systemStatus.adminMode) {
-      request->send(LittleFS, "/index.html", "text/html");
+      sendPage(request, "/index.html");
     } else {
       request->send(403, "text/plain", "Access denied. Please login as admin.");
     }
   });
-  server.serveStatic("/", LittleFS, "/");
+#ifdef EMBED_WEB_ASSETS
+  initEmbeddedAssets();
+#else
+  // Instead of serveStatic(), so static files are timed like the pages
+  server.onNotFound([](AsyncWebServerRequest *request) {
+    const char *contentType = webContentType(request->url().c_str());
+    if (request->method() != HTTP_GET || contentType == nullptr) {
+      request->send(404, "text/plain", "Not found");
+      return;
+    }
+    sendFsFile(request, request->url().c_str(), contentType);
+  });
+#endif
   server.begin();
   Serial.println("WebSocket server started");
+  return true;
 }
 
 // Get ESP32 temperature
@@ -1151,8 +3532,6 @@ void updateSystemStatus() {
     }
   }
 
-  updateCounterStatus();
-
   size_t newFreeHeap = ESP.getFreeHeap();
   size_t newFreePsram = ESP.getFreePsram();
   
@@ -1212,6 +3591,32 @@ void updateSystemStatus() {
   statusMessage += String("LoRa E32 Operating Mode: ") + (systemStatus.loraE32.operatingMode == 0 ? "Normal" : 
                                                            systemStatus.loraE32.operatingMode == 1 ? "Wake-Up" : 
                                                            systemStatus.loraE32.operatingMode == 2 ? "Power-Saving" : "Sleep") + "\n";
+  // Same locking as buildSystemStatusJson(): copy the link counters, never read them in place
+  portENTER_CRITICAL(&linkStatsMux);
+  LoRaTxStats txStats = loraTxStats;
+  LoRaReliableStats reliableStats = loraReliableSnapshot;
+  unsigned long rxBursts = loraRxBursts;
+  unsigned long rxLatencyTotal = loraRxLatencyTotal;
+  unsigned long rxLatencyMax = loraRxLatencyMax;
+  portEXIT_CRITICAL(&linkStatsMux);
+  statusMessage += String("LoRa RX: ") + loraRxParser.stats.frames + " frames, " + loraRxParser.stats.bytes + " bytes, " +
+                   loraRxParser.stats.skippedBytes + " bytes skipped, " + loraRxParser.stats.crcErrors + " CRC errors, " +
+                   "latency avg/max " + (rxBursts > 0 ? rxLatencyTotal / rxBursts : 0) + "/" + rxLatencyMax + " us\n";
+  statusMessage += String("LoRa TX: ") + txStats.frames + " frames, " + txStats.bytes + " bytes, " +
+                   txStats.failures + " failures, " + reliableStats.retransmissions + " retransmits, RTT mean/p99 " +
+                   reliableStats.rtt.meanMs() + "/" + reliableStats.rtt.percentileMs(99) + " ms\n";
+  statusMessage += "LoRa peers (last seen): ";
+  for (size_t i = 0; i < loraPeers.capacity(); i++) {
+    portENTER_CRITICAL(&linkStatsMux);
+    LoRaPeerEntry peer = loraPeers.slot(i);
+    portEXIT_CRITICAL(&linkStatsMux);
+    if (peer.used) {
+      char entry[24];
+      snprintf(entry, sizeof(entry), "%04X %lus ", peer.address, (millis() - peer.lastSeen) / 1000);
+      statusMessage += entry;
+    }
+  }
+  statusMessage += "\n";
   statusMessage += String("Admin Mode: ") + (systemStatus.adminMode ? "Active" : "Inactive") + "\n";
   statusMessage += "====================";
 
@@ -1230,8 +3635,21 @@ void updateSystemStatus() {
 // System monitor task
 void systemMonitorTask(void *pvParameters) {
   const TickType_t monitorPeriod = pdMS_TO_TICKS(MONITOR_INTERVAL);
+  unsigned long lastHistorySample = 0;
+  // Counters and config are only meaningful once LittleFS has been loaded
+  xEventGroupWaitBits(bootEvents, BOOT_FS_READY, pdFALSE, pdTRUE, portMAX_DELAY);
   while (1) {
     updateSystemStatus();
+    if (historyCount == 0 || millis() - lastHistorySample >= HISTORY_SAMPLE_INTERVAL) {
+      recordHistorySample();
+      lastHistorySample = millis();
+    }
+    if (nodeTableChanged) {
+      nodeTableChanged = false;
+      sendNodeTable();
+    }
+    flushConfigStore(false);
+    flushEventLog(false);
         // Kiểm tra WiFi status
     static int lastWifiStatus = WL_CONNECTED;
     int currentWifiStatus = WiFi.status();
@@ -1249,19 +3667,229 @@ void systemMonitorTask(void *pvParameters) {
     vTaskDelay(monitorPeriod);
   }
 }
-// Counter monitor task
+// Counter monitor task: fixed-rate sampling; during a benchmark it also
+// measures how late each pass starts
 void counterMonitorTask(void *pvParameters) {
-  const TickType_t counterPeriod = pdMS_TO_TICKS(10); // 10ms
+  const TickType_t counterPeriod = pdMS_TO_TICKS(COUNTER_UPDATE_INTERVAL);
+  TickType_t lastWake = xTaskGetTickCount();
+  int64_t lastRunUs = 0;
   while (1) {
+    vTaskDelayUntil(&lastWake, counterPeriod);
+    int64_t now = esp_timer_get_time();
+    if (benchRunning && lastRunUs != 0) {
+      int64_t late = now - lastRunUs - (int64_t)COUNTER_UPDATE_INTERVAL * 1000;
+      benchJitter.record((uint32_t)(late < 0 ? -late : late));
+    }
+    lastRunUs = now;
     updateCounterStatus();
-    vTaskDelay(counterPeriod);
+    if (benchPulse) {
+      benchPulse = false;
+      requestCounterPublish();
+    }
+  }
+}
+
+// Ask CounterPublish to send the counter status
+void requestCounterPublish() {
+  counterPublishRequestUs = esp_timer_get_time();
+  if (counterPublishTaskHandle != NULL) {
+    xTaskNotifyGive(counterPublishTaskHandle);
+  }
+}
+
+// Serializes and sends counter status off the counting core; counts that
+// arrive while a message is being built are covered by the next one
+void counterPublishTask(void *pvParameters) {
+  while (1) {
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    int64_t requestedUs = counterPublishRequestUs;
+    sendCounterStatus();
+    if (benchRunning) {
+      benchWsLatency.record((uint32_t)(esp_timer_get_time() - requestedUs));
+    }
+  }
+}
+
+// Create a long-running task where the active layout places it
+TaskHandle_t startTask(TaskId id, TaskFunction_t task, void *param) {
+  const TaskPlacement &placement = TASK_LAYOUTS[taskLayout][id];
+  TaskHandle_t handle = NULL;
+  xTaskCreatePinnedToCore(task, placement.name, placement.stackSize, param, placement.priority, &handle,
+                          placement.core);
+  return handle;
+}
+
+// Pick the layout chosen before the last restart (DEFAULT_TASK_LAYOUT after power-up)
+void loadTaskBenchState() {
+  bool valid = taskBenchState.magic == TASK_BENCH_MAGIC && taskBenchState.layout < TASK_LAYOUT_COUNT &&
+               taskBenchState.crc == crc32Update(0, (const uint8_t *)&taskBenchState, offsetof(TaskBenchState, crc));
+  if (!valid) {
+    memset(&taskBenchState, 0, sizeof(taskBenchState));
+    taskBenchState.layout = DEFAULT_TASK_LAYOUT;
+    saveTaskBenchState();
+  }
+  taskLayout = taskBenchState.layout;
+  Serial.printf("Task layout: %s\n", TASK_LAYOUT_NAMES[taskLayout]);
+}
+
+void saveTaskBenchState() {
+  taskBenchState.magic = TASK_BENCH_MAGIC;
+  taskBenchState.crc = crc32Update(0, (const uint8_t *)&taskBenchState, offsetof(TaskBenchState, crc));
+}
+
+// Task placement is fixed at creation, so a layout change means a restart
+void restartWithTaskLayout(uint8_t layout) {
+  static bool restartPending = false;
+  if (restartPending) {
+    return;
+  }
+  restartPending = true;
+  taskBenchState.layout = layout;
+  saveTaskBenchState();
+  // The flushes write to flash and the serial output needs time to drain, so
+  // none of it runs on the caller (the WebSocket handler runs on async_tcp)
+  startTask(TASK_RESTART, restartTask, NULL);
+}
+
+// TASK_RESTART: save what is pending, then restart into taskBenchState.layout
+void restartTask(void *pvParameters) {
+  flushConfigStore(true);
+  flushEventLog(true);
+  Serial.printf("Restarting with task layout %s\n", TASK_LAYOUT_NAMES[taskBenchState.layout]);
+  vTaskDelay(pdMS_TO_TICKS(100));
+  ESP.restart();
+}
+
+// Keeps SystemMonitor's core busy the way it is in production, only harder:
+// status JSON back to back and a flash write every TASK_BENCH_FS_WRITE_MS
+void taskBenchLoadTask(void *pvParameters) {
+  unsigned long lastWrite = 0;
+  while (benchRunning) {
+    String json = buildSystemStatusJson();
+    if (millis() - lastWrite >= TASK_BENCH_FS_WRITE_MS) {
+      fsWriteFile("/bench.tmp", (const uint8_t *)json.c_str(), json.length());
+      lastWrite = millis();
+    }
+    vTaskDelay(1);
+  }
+  fsRemove("/bench.tmp");
+  vTaskDelete(NULL);
+}
+
+// Measure the active layout for TASK_BENCH_DURATION_MS, store the result and,
+// during a sweep, restart into the next layout
+void taskBenchTask(void *pvParameters) {
+  if (taskBenchState.sweepActive) {
+    vTaskDelay(pdMS_TO_TICKS(TASK_BENCH_SETTLE_MS));
+  }
+  benchJitter = FsLatencyHistogram();
+  benchWsLatency = FsLatencyHistogram();
+  benchRunning = true;
+  startTask(TASK_BENCH_LOAD, taskBenchLoadTask, NULL);
+  unsigned long start = millis();
+  while (millis() - start < TASK_BENCH_DURATION_MS) {
+    benchPulse = true;
+    vTaskDelay(pdMS_TO_TICKS(TASK_BENCH_PULSE_MS));
+  }
+  benchRunning = false;
+  vTaskDelay(pdMS_TO_TICKS(100));  // Let the load task and the last publish finish
+
+  TaskBenchResult &result = taskBenchState.results[taskLayout];
+  result.valid = 1;
+  result.jitterSamples = benchJitter.count();
+  result.jitterP50Us = benchJitter.percentileUs(50);
+  result.jitterP99Us = benchJitter.percentileUs(99);
+  result.jitterMaxUs = benchJitter.maxUs();
+  result.wsSamples = benchWsLatency.count();
+  result.wsP50Us = benchWsLatency.percentileUs(50);
+  result.wsP99Us = benchWsLatency.percentileUs(99);
+  result.wsMaxUs = benchWsLatency.maxUs();
+  saveTaskBenchState();
+  Serial.printf("Task benchmark (%s): jitter p99 %lu us max %lu us, WS p99 %lu us max %lu us\n",
+                TASK_LAYOUT_NAMES[taskLayout], (unsigned long)result.jitterP99Us, (unsigned long)result.jitterMaxUs,
+                (unsigned long)result.wsP99Us, (unsigned long)result.wsMaxUs);
+  sendDebugMessage(String("Task benchmark done for layout ") + TASK_LAYOUT_NAMES[taskLayout] + ", see /api/tasks");
+
+  if (taskBenchState.sweepActive) {
+    uint8_t next = taskLayout + 1;
+    if (next >= TASK_LAYOUT_COUNT) {
+      taskBenchState.sweepActive = 0;
+      next = taskBenchState.sweepOrigin;
+    }
+    if (next != taskLayout) {
+      restartWithTaskLayout(next);
+    }
+    saveTaskBenchState();
+  }
+  vTaskDelete(NULL);
+}
+
+// Benchmark the active layout, or with sweep every layout in turn (restarting between them)
+void startTaskBenchmark(bool sweep) {
+  if (xTaskGetHandle(TASK_LAYOUTS[taskLayout][TASK_BENCH].name) != NULL) {
+    return;  // Already running
+  }
+  if (sweep) {
+    taskBenchState.sweepActive = 1;
+    taskBenchState.sweepOrigin = taskLayout;
+    saveTaskBenchState();
+    if (taskLayout != 0) {
+      restartWithTaskLayout(0);
+      return;
+    }
   }
+  startTask(TASK_BENCH, taskBenchTask, NULL);
+}
+
+// Active layout, its tasks and the benchmark results of every layout, for /api/tasks
+String buildTaskTableJson() {
+  JSONVar response;
+  response["layout"] = TASK_LAYOUT_NAMES[taskLayout];
+  response["benchmarkRunning"] = (bool)benchRunning;
+  response["sweepActive"] = taskBenchState.sweepActive != 0;
+  JSONVar tasksArray;
+  for (int i = 0; i < TASK_COUNT; i++) {
+    const TaskPlacement &placement = TASK_LAYOUTS[taskLayout][i];
+    JSONVar taskObj;
+    taskObj["name"] = placement.name;
+    taskObj["core"] = (int)placement.core;
+    taskObj["priority"] = (int)placement.priority;
+    taskObj["stackSize"] = (int)placement.stackSize;
+    TaskHandle_t handle = xTaskGetHandle(placement.name);
+    taskObj["running"] = handle != NULL;
+    if (handle != NULL) {
+      taskObj["stackFree"] = (int)uxTaskGetStackHighWaterMark(handle);
+    }
+    tasksArray[i] = taskObj;
+  }
+  response["tasks"] = tasksArray;
+  JSONVar resultsArray;
+  for (size_t i = 0; i < TASK_LAYOUT_COUNT; i++) {
+    const TaskBenchResult &result = taskBenchState.results[i];
+    JSONVar resultObj;
+    resultObj["layout"] = TASK_LAYOUT_NAMES[i];
+    resultObj["measured"] = result.valid != 0;
+    resultObj["jitterSamples"] = (double)result.jitterSamples;
+    resultObj["jitterP50Us"] = (double)result.jitterP50Us;
+    resultObj["jitterP99Us"] = (double)result.jitterP99Us;
+    resultObj["jitterMaxUs"] = (double)result.jitterMaxUs;
+    resultObj["wsSamples"] = (double)result.wsSamples;
+    resultObj["wsP50Us"] = (double)result.wsP50Us;
+    resultObj["wsP99Us"] = (double)result.wsP99Us;
+    resultObj["wsMaxUs"] = (double)result.wsMaxUs;
+    resultsArray[(int)i] = resultObj;
+  }
+  response["benchmark"] = resultsArray;
+  return JSON.stringify(response);
 }
 // WiFi monitoring task
 void wifiMonitorTask(void *pvParameters) {
   const TickType_t wifiCheckPeriod = pdMS_TO_TICKS(WIFI_RECONNECT_INTERVAL);
   
+  // Give the first connection attempt a full period before stepping in
+  xEventGroupWaitBits(bootEvents, BOOT_NET_STARTED, pdFALSE, pdTRUE, portMAX_DELAY);
   while (1) {
+    vTaskDelay(wifiCheckPeriod);
     if (WiFi.status() != WL_CONNECTED) {
       Serial.println("WiFi disconnected! Attempting to reconnect...");
       WiFi.disconnect();
@@ -1277,7 +3905,6 @@ void wifiMonitorTask(void *pvParameters) {
         Serial.println("WiFi reconnected! IP: " + systemStatus.ipAddress);
       }
     }
-    vTaskDelay(wifiCheckPeriod);
   }
 }
 // WebSocket task
@@ -1293,14 +3920,110 @@ void webSocketTask(void *pvParameters) {
 }
 
 
-void initTask(void *pvParameters) {
-  initWiFi();
-  initLoRaE32();
-  initWebSocket();
-  sendDebugMessage("System initialization complete!");
-  sendDebugMessage("Tasks created and running on Core 1");
+// Boot stage: program the stored radio settings and start the LoRa tasks
+bool startLoRa() {
+  applyStoredLoRaConfig();
+  registerLoRaFrameHandler(LORA_FRAME_COUNTER_REPORT, handleCounterReportFrame);
+  registerLoRaFrameHandler(LORA_FRAME_RELIABLE, handleReliableFrame);
+  registerLoRaFrameHandler(LORA_FRAME_ACK, handleAckFrame);
+  loraRxTaskHandle = startTask(TASK_LORA_RX, loraRxTask, NULL);
+  if (LORA_UPLINK_ENABLED) {
+    startTask(TASK_LORA_UPLINK, loraUplinkTask, NULL);
+  }
+  return true;
+}
+
+// Boot stage: start counting once the counter config (pins, filters, counts) is loaded
+bool startCounters() {
+  counterPublishTaskHandle = startTask(TASK_COUNTER_PUBLISH, counterPublishTask, NULL);
+  startTask(TASK_COUNTER, counterMonitorTask, NULL);
+  return true;
+}
+
+// Runs one boot stage: wait for its dependencies, run it, signal readiness
+void bootStageTask(void *pvParameters) {
+  BootStage *stage = (BootStage *)pvParameters;
+  if (stage->waitFor != 0) {
+    xEventGroupWaitBits(bootEvents, stage->waitFor, pdFALSE, pdTRUE, portMAX_DELAY);
+  }
+  stage->record.startUs = esp_timer_get_time();
+  stage->record.failed = !stage->run();
+  stage->record.endUs = esp_timer_get_time();
+  xEventGroupSetBits(bootEvents, stage->ready);
+
+  portENTER_CRITICAL(&bootMux);
+  bool last = --bootStagesPending == 0;
+  portEXIT_CRITICAL(&bootMux);
+  if (last) {
+    bootCompleteUs = esp_timer_get_time();
+    Serial.println("=== Boot timeline (ms since reset: wait -> start -> end) ===");
+    for (size_t i = 0; i < BOOT_STAGE_COUNT; i++) {
+      const BootStageRecord &r = bootStages[i].record;
+      Serial.printf("  %-12s %8.1f %8.1f %8.1f%s\n", bootStages[i].name,
+                    r.queuedUs / 1000.0, r.startUs / 1000.0, r.endUs / 1000.0, r.failed ? "  FAILED" : "");
+    }
+    Serial.printf("Boot complete in %.1f ms\n", bootCompleteUs / 1000.0);
+    sendDebugMessage("System initialization complete!");
+    if (taskBenchState.sweepActive) {
+      startTaskBenchmark(false);  // Continue the sweep in this layout
+    }
+  }
   vTaskDelete(NULL);
 }
+
+// Create one task per boot stage; the event group orders them. Each stage's
+// TASK_LAYOUTS entry puts it on the core of the task it hands over to, so the
+// layout's core split holds from boot.
+void startBootStages() {
+  for (size_t i = 0; i < BOOT_STAGE_COUNT; i++) {
+    BootStage &stage = bootStages[i];
+    stage.record.queuedUs = esp_timer_get_time();
+    startTask(stage.task, bootStageTask, &stage);
+  }
+}
+
+// Serialize the boot timeline for /api/boot
+String buildBootTimelineJson() {
+  JSONVar response;
+  JSONVar stagesArray;
+  for (size_t i = 0; i < BOOT_STAGE_COUNT; i++) {
+    const BootStage &stage = bootStages[i];
+    JSONVar stageObj;
+    stageObj["name"] = stage.name;
+    stageObj["core"] = (int)TASK_LAYOUTS[taskLayout][stage.task].core;
+    stageObj["queuedUs"] = (double)stage.record.queuedUs;
+    stageObj["startUs"] = (double)stage.record.startUs;
+    stageObj["endUs"] = (double)stage.record.endUs;
+    stageObj["done"] = stage.record.endUs != 0;
+    stageObj["failed"] = stage.record.failed;
+    stagesArray[(int)i] = stageObj;
+  }
+  response["stages"] = stagesArray;
+  // Milestones are 0 until reached
+  JSONVar milestones;
+  milestones["bootCompleteUs"] = (double)bootCompleteUs;
+  milestones["wifiConnectedUs"] = (double)bootWifiConnectedUs;
+  milestones["firstCountUs"] = (double)bootFirstCountUs;
+  milestones["firstClientUs"] = (double)bootFirstClientUs;
+  response["milestones"] = milestones;
+  JSONVar stepsArray;
+  for (size_t i = 0; i < fsBootStepCount; i++) {
+    JSONVar stepObj;
+    stepObj["name"] = fsBootSteps[i].name;
+    stepObj["us"] = (double)fsBootSteps[i].us;
+    stepsArray[(int)i] = stepObj;
+  }
+  response["fsSteps"] = stepsArray;
+  JSONVar configStore;
+  configStore["source"] = configStoreSource;
+  configStore["loadUs"] = (double)configStoreLoadUs;
+  configStore["bytes"] = (int)configStoreBytes;
+  configStore["commits"] = (double)configStoreCommits;
+  configStore["counterSource"] = counterRestoreSource;
+  response["configStore"] = configStore;
+  return JSON.stringify(response);
+}
+
 // void testCounterPins() {
 //   Serial.println("=== Testing Counter Pins ===");
 //   for (int i = 0; i < 4; i++) {
@@ -1318,58 +4041,14 @@ void setup() {
   reset_counter++;
   bootTime = millis();
 
+  loadTaskBenchState();
   initInputs();
   initOutputs();
-  initLittleFS();
-    // Thêm task này
-  xTaskCreatePinnedToCore(
-    wifiMonitorTask,
-    "WiFiMonitor",
-    2048,
-    NULL,
-    1,
-    NULL,
-    1
-  );
-
-  xTaskCreatePinnedToCore(
-    initTask,
-    "InitTask",
-    4096,
-    NULL,
-    2,
-    NULL,
-    1 //code 1
-  );
-
-  xTaskCreatePinnedToCore(
-    systemMonitorTask,
-    "SystemMonitor",
-    4096,
-    NULL,
-    2,
-    NULL,
-    1 //core 1
-  );
-
-  xTaskCreatePinnedToCore(
-    webSocketTask,
-    "WebSocketTask",
-    4096,
-    NULL,
-    1,
-    NULL,
-    0 // core 0
-  );
-  xTaskCreatePinnedToCore(
-    counterMonitorTask,
-    "CounterMonitor",
-    3072,  
-    NULL,
-    3,     
-    NULL,
-    1      
-  );
+  // FS, WiFi, radio, web server and counters come up concurrently (see bootStages)
+  startBootStages();
+  startTask(TASK_WIFI_MONITOR, wifiMonitorTask, NULL);
+  startTask(TASK_SYSTEM_MONITOR, systemMonitorTask, NULL);
+  startTask(TASK_WEBSOCKET, webSocketTask, NULL);
 }
 
 
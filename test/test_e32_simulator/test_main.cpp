@@ -0,0 +1,244 @@
+// E32 simulator contract: the mode/AUX timing, program-mode replies and UART
+// behaviour that initLoRaE32(), setLoRaConfig() and syncLoRaUart() rely on.
+#include <unity.h>
+#include "E32Simulator.h"
+
+static const uint8_t READ_CONFIG[3] = {0xC1, 0xC1, 0xC1};
+static const uint8_t READ_INFO[3] = {0xC3, 0xC3, 0xC3};
+
+void setUp() {}
+void tearDown() {}
+
+// Run the simulation until `count` bytes can be read or the timeout expires
+static bool waitForBytes(E32SimAir &air, E32SimModule &module, int count, uint64_t timeoutUs) {
+  uint64_t deadline = air.now() + timeoutUs;
+  while (module.available() < count) {
+    if (air.now() >= deadline) {
+      return false;
+    }
+    air.advance(100);
+  }
+  return true;
+}
+
+static size_t readAll(E32SimModule &module, uint8_t *out, size_t capacity) {
+  size_t n = 0;
+  while (module.available() > 0 && n < capacity) {
+    out[n++] = (uint8_t)module.read();
+  }
+  return n;
+}
+
+// Same order as the firmware: M0/M1 to program mode, host UART to 9600, wait for AUX
+static void enterProgramMode(E32SimAir &air, E32SimModule &module, uint32_t hostBaud = 9600) {
+  module.setMode(3);
+  module.setHostBaud(hostBaud);
+  air.advance(60000);
+}
+
+// Back to normal mode, host UART following the module's configured rate
+static void enterNormalMode(E32SimAir &air, E32SimModule &module) {
+  module.setMode(0);
+  module.setHostBaud(module.registers().uartBaud());
+  air.advance(60000);
+}
+
+void test_mode_switch_holds_aux_low() {
+  E32SimAir air;
+  E32SimModule module(air);
+  TEST_ASSERT_TRUE(module.aux());
+
+  module.setMode(3);
+  TEST_ASSERT_EQUAL(3, module.mode());
+  TEST_ASSERT_FALSE(module.aux());
+  air.advance(9000);
+  TEST_ASSERT_FALSE(module.aux());
+  air.advance(1000);
+  TEST_ASSERT_TRUE(module.aux());
+
+  // Leaving program mode runs the module self-check, which takes longer
+  module.setMode(0);
+  air.advance(59000);
+  TEST_ASSERT_FALSE(module.aux());
+  air.advance(1000);
+  TEST_ASSERT_TRUE(module.aux());
+}
+
+void test_c1_returns_register_image() {
+  E32SimAir air;
+  E32SimModule module(air);
+  enterProgramMode(air, module);
+  module.write(READ_CONFIG, sizeof(READ_CONFIG));
+  TEST_ASSERT_TRUE(waitForBytes(air, module, 6, 100000));
+
+  uint8_t reply[8];
+  TEST_ASSERT_EQUAL(6, readAll(module, reply, sizeof(reply)));
+  const uint8_t expected[6] = {0xC0, 0x00, 0x00, 0x1A, 0x17, 0x44};
+  TEST_ASSERT_EQUAL_UINT8_ARRAY(expected, reply, 6);
+}
+
+void test_c3_returns_module_information() {
+  E32SimAir air;
+  E32SimModule module(air);
+  enterProgramMode(air, module);
+  module.write(READ_INFO, sizeof(READ_INFO));
+  TEST_ASSERT_TRUE(waitForBytes(air, module, 4, 100000));
+
+  uint8_t reply[8];
+  TEST_ASSERT_EQUAL(4, readAll(module, reply, sizeof(reply)));
+  TEST_ASSERT_EQUAL_HEX8(0xC3, reply[0]);
+}
+
+void test_incomplete_command_gets_no_reply() {
+  E32SimAir air;
+  E32SimModule module(air);
+  enterProgramMode(air, module);
+  const uint8_t broken[3] = {0xC1, 0xC1, 0x00};
+  module.write(broken, sizeof(broken));
+  air.advance(100000);
+  TEST_ASSERT_EQUAL(0, module.available());
+}
+
+void test_c2_is_temporary_and_c0_is_saved() {
+  E32SimAir air;
+  E32SimModule module(air);
+  enterProgramMode(air, module);
+
+  const uint8_t temporary[6] = {0xC2, 0x00, 0x05, 0x1A, 0x17, 0x44};
+  module.write(temporary, sizeof(temporary));
+  TEST_ASSERT_TRUE(waitForBytes(air, module, 6, 200000));
+  uint8_t reply[8];
+  readAll(module, reply, sizeof(reply));
+  TEST_ASSERT_EQUAL_UINT8_ARRAY(temporary, reply, 6);
+  TEST_ASSERT_EQUAL_HEX8(0x05, module.registers().addl);
+  TEST_ASSERT_EQUAL_HEX8(0x00, module.savedRegisters().addl);
+  TEST_ASSERT_EQUAL_UINT32(0, module.stats.eepromWrites);
+
+  module.powerCycle();
+  TEST_ASSERT_EQUAL_HEX8(0x00, module.registers().addl);
+
+  air.advance(60000);
+  const uint8_t saved[6] = {0xC0, 0x00, 0x07, 0x1A, 0x17, 0x44};
+  module.write(saved, sizeof(saved));
+  // The echo only comes once the EEPROM write is done, and AUX stays low until then
+  air.advance(6 * 1042 + 1000);
+  TEST_ASSERT_FALSE(module.aux());
+  TEST_ASSERT_EQUAL(0, module.available());
+  TEST_ASSERT_TRUE(waitForBytes(air, module, 6, 200000));
+  TEST_ASSERT_TRUE(module.aux());
+  TEST_ASSERT_EQUAL_HEX8(0x07, module.savedRegisters().addl);
+  TEST_ASSERT_EQUAL_UINT32(1, module.stats.eepromWrites);
+  TEST_ASSERT_EQUAL_UINT32(2, module.stats.configWrites);
+}
+
+void test_program_mode_only_answers_at_9600() {
+  E32SimAir air;
+  E32SimModule module(air);
+  enterProgramMode(air, module, 115200);
+  module.write(READ_CONFIG, sizeof(READ_CONFIG));
+  air.advance(200000);
+  TEST_ASSERT_EQUAL(0, module.available());
+  TEST_ASSERT_EQUAL_UINT32(3, module.stats.uartErrors);
+}
+
+void test_host_must_follow_configured_baud() {
+  E32SimAir air;
+  E32SimModule node(air, "node");
+  E32SimModule gateway(air, "gateway");
+  // SPED 0x3A: 8N1, 115200 baud, 2.4k air rate, written to both modules the way setLoRaConfig() does
+  const uint8_t command[6] = {0xC0, 0x00, 0x00, 0x3A, 0x17, 0x44};
+  E32SimModule *modules[2] = {&node, &gateway};
+  for (E32SimModule *module : modules) {
+    enterProgramMode(air, *module);
+    module->write(command, sizeof(command));
+    TEST_ASSERT_TRUE(waitForBytes(air, *module, 6, 200000));
+    uint8_t reply[8];
+    readAll(*module, reply, sizeof(reply));
+    TEST_ASSERT_EQUAL_UINT32(115200, module->registers().uartBaud());
+  }
+
+  // Still at the program-mode rate: the module cannot read the host
+  node.setMode(0);
+  gateway.setMode(0);
+  gateway.setHostBaud(115200);
+  air.advance(60000);
+  const uint8_t payload[10] = {1, 2, 3, 4, 5, 6, 7, 8, 9, 10};
+  node.write(payload, sizeof(payload));
+  air.advance(1000000);
+  TEST_ASSERT_EQUAL_UINT32(10, node.stats.uartErrors);
+  TEST_ASSERT_EQUAL_UINT32(0, node.stats.packetsSent);
+  TEST_ASSERT_EQUAL(0, gateway.available());
+
+  enterNormalMode(air, node);
+  node.write(payload, sizeof(payload));
+  TEST_ASSERT_TRUE(waitForBytes(air, gateway, sizeof(payload), 1000000));
+  uint8_t received[16];
+  TEST_ASSERT_EQUAL(sizeof(payload), readAll(gateway, received, sizeof(received)));
+  TEST_ASSERT_EQUAL_UINT8_ARRAY(payload, received, sizeof(payload));
+}
+
+void test_overlapping_packets_collide() {
+  E32SimAir air;
+  E32SimModule a(air, "a");
+  E32SimModule b(air, "b");
+  E32SimModule gateway(air, "gateway");
+  const uint8_t payload[10] = {0};
+
+  a.write(payload, sizeof(payload));
+  b.write(payload, sizeof(payload));
+  air.advance(1000000);
+  TEST_ASSERT_EQUAL_UINT32(1, a.stats.packetsSent);
+  TEST_ASSERT_EQUAL_UINT32(1, b.stats.packetsSent);
+  TEST_ASSERT_EQUAL_UINT32(0, gateway.stats.packetsReceived);
+  TEST_ASSERT_EQUAL(0, gateway.available());
+  TEST_ASSERT_GREATER_THAN_UINT32(0, a.stats.packetsLost);
+
+  // The same packets one after the other both arrive
+  a.write(payload, sizeof(payload));
+  air.advance(1000000);
+  b.write(payload, sizeof(payload));
+  air.advance(1000000);
+  TEST_ASSERT_EQUAL_UINT32(2, gateway.stats.packetsReceived);
+  TEST_ASSERT_EQUAL(2 * sizeof(payload), gateway.available());
+}
+
+void test_fixed_transmission_reaches_only_the_target() {
+  E32SimAir air;
+  E32SimModule node(air, "node");
+  E32SimModule gateway(air, "gateway");
+  E32SimModule other(air, "other");
+  const uint8_t addresses[3] = {0x02, 0x01, 0x03};
+  E32SimModule *modules[3] = {&node, &gateway, &other};
+  for (int i = 0; i < 3; i++) {
+    // OPTION 0xC4: fixed transmission
+    const uint8_t command[6] = {0xC0, 0x00, addresses[i], 0x1A, 0x17, 0xC4};
+    enterProgramMode(air, *modules[i]);
+    modules[i]->write(command, sizeof(command));
+    TEST_ASSERT_TRUE(waitForBytes(air, *modules[i], 6, 200000));
+    uint8_t reply[8];
+    readAll(*modules[i], reply, sizeof(reply));
+    enterNormalMode(air, *modules[i]);
+  }
+
+  const uint8_t frame[8] = {0x00, 0x01, 0x17, 0xA5, 0x01, 0x02, 0x03, 0x04};
+  node.write(frame, sizeof(frame));
+  TEST_ASSERT_TRUE(waitForBytes(air, gateway, 5, 1000000));
+  uint8_t received[8];
+  TEST_ASSERT_EQUAL(5, readAll(gateway, received, sizeof(received)));
+  TEST_ASSERT_EQUAL_UINT8_ARRAY(frame + 3, received, 5);  // Address header stripped
+  TEST_ASSERT_EQUAL(0, other.available());
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_mode_switch_holds_aux_low);
+  RUN_TEST(test_c1_returns_register_image);
+  RUN_TEST(test_c3_returns_module_information);
+  RUN_TEST(test_incomplete_command_gets_no_reply);
+  RUN_TEST(test_c2_is_temporary_and_c0_is_saved);
+  RUN_TEST(test_program_mode_only_answers_at_9600);
+  RUN_TEST(test_host_must_follow_configured_baud);
+  RUN_TEST(test_overlapping_packets_collide);
+  RUN_TEST(test_fixed_transmission_reaches_only_the_target);
+  return UNITY_END();
+}
@@ -0,0 +1,213 @@
+// LoRa link framing (lora_link.h): frames have to survive the byte stream the
+// UART task hands over, including noise, cut-off frames and corruption.
+#include <unity.h>
+#include "lora_link.h"
+
+struct Received {
+  int frames = 0;
+  uint8_t type = 0;
+  uint8_t payload[LORA_MAX_FRAME_PAYLOAD];
+  uint8_t length = 0;
+};
+
+static void collect(uint8_t type, const uint8_t *payload, uint8_t length, void *context) {
+  Received *received = (Received *)context;
+  received->frames++;
+  received->type = type;
+  received->length = length;
+  for (uint8_t i = 0; i < length; i++) {
+    received->payload[i] = payload[i];
+  }
+}
+
+static const uint8_t PAYLOAD[6] = {0x00, 0x02, 0x10, 0x00, 0x01, 0x0A};
+
+static size_t sampleFrame(uint8_t *out) {
+  return encodeLoRaFrame(out, LORA_FRAME_COUNTER_REPORT, PAYLOAD, sizeof(PAYLOAD));
+}
+
+void setUp() {}
+void tearDown() {}
+
+void test_frame_round_trip() {
+  uint8_t frame[LORA_MAX_PACKET_SIZE];
+  size_t length = sampleFrame(frame);
+  TEST_ASSERT_EQUAL(sizeof(PAYLOAD) + LORA_FRAME_OVERHEAD, length);
+
+  LoRaFrameParser<128> parser;
+  Received received;
+  parser.push(frame, length);
+  parser.parse(collect, &received);
+  TEST_ASSERT_EQUAL(1, received.frames);
+  TEST_ASSERT_EQUAL_HEX8(LORA_FRAME_COUNTER_REPORT, received.type);
+  TEST_ASSERT_EQUAL(sizeof(PAYLOAD), received.length);
+  TEST_ASSERT_EQUAL_UINT8_ARRAY(PAYLOAD, received.payload, sizeof(PAYLOAD));
+  TEST_ASSERT_EQUAL(0, parser.pending());
+}
+
+void test_oversized_payload_is_not_encoded() {
+  uint8_t payload[LORA_MAX_FRAME_PAYLOAD + 1] = {0};
+  uint8_t frame[LORA_MAX_PACKET_SIZE + 1];
+  TEST_ASSERT_EQUAL(0, encodeLoRaFrame(frame, LORA_FRAME_COUNTER_REPORT, payload, sizeof(payload)));
+}
+
+void test_resync_after_garbage() {
+  uint8_t frame[LORA_MAX_PACKET_SIZE];
+  size_t length = sampleFrame(frame);
+  const uint8_t garbage[5] = {0x00, 0xFF, 0x13, 0x37, 0x42};
+
+  LoRaFrameParser<128> parser;
+  Received received;
+  parser.push(garbage, sizeof(garbage));
+  parser.push(frame, length);
+  parser.parse(collect, &received);
+  TEST_ASSERT_EQUAL(1, received.frames);
+  TEST_ASSERT_EQUAL_UINT32(sizeof(garbage), parser.stats.skippedBytes);
+  TEST_ASSERT_EQUAL_UINT32(0, parser.stats.crcErrors);
+}
+
+void test_resync_after_false_sync_byte() {
+  uint8_t frame[LORA_MAX_PACKET_SIZE];
+  size_t length = sampleFrame(frame);
+  // A sync byte in the noise whose "frame" overlaps the real one and fails its CRC
+  const uint8_t noise[4] = {0x11, LORA_FRAME_SYNC, 0x01, 0x03};
+
+  LoRaFrameParser<128> parser;
+  Received received;
+  parser.push(noise, sizeof(noise));
+  parser.push(frame, length);
+  parser.parse(collect, &received);
+  TEST_ASSERT_EQUAL(1, received.frames);
+  TEST_ASSERT_EQUAL_UINT8_ARRAY(PAYLOAD, received.payload, sizeof(PAYLOAD));
+  TEST_ASSERT_EQUAL_UINT32(1, parser.stats.crcErrors);
+  TEST_ASSERT_EQUAL_UINT32(3, parser.stats.skippedBytes);
+}
+
+void test_bad_length_is_skipped() {
+  uint8_t frame[LORA_MAX_PACKET_SIZE];
+  size_t length = sampleFrame(frame);
+  const uint8_t bad[3] = {LORA_FRAME_SYNC, LORA_FRAME_COUNTER_REPORT, LORA_MAX_FRAME_PAYLOAD + 1};
+
+  LoRaFrameParser<128> parser;
+  Received received;
+  parser.push(bad, sizeof(bad));
+  parser.push(frame, length);
+  parser.parse(collect, &received);
+  TEST_ASSERT_EQUAL(1, received.frames);
+  TEST_ASSERT_EQUAL_UINT32(sizeof(bad), parser.stats.skippedBytes);
+}
+
+void test_truncated_frame_waits_for_the_rest() {
+  uint8_t frame[LORA_MAX_PACKET_SIZE];
+  size_t length = sampleFrame(frame);
+
+  LoRaFrameParser<128> parser;
+  Received received;
+  parser.push(frame, 4);
+  parser.parse(collect, &received);
+  TEST_ASSERT_EQUAL(0, received.frames);
+  TEST_ASSERT_EQUAL(4, parser.pending());
+
+  parser.push(frame + 4, length - 4);
+  parser.parse(collect, &received);
+  TEST_ASSERT_EQUAL(1, received.frames);
+  TEST_ASSERT_EQUAL(0, parser.pending());
+}
+
+void test_byte_at_a_time() {
+  uint8_t frame[LORA_MAX_PACKET_SIZE];
+  size_t length = sampleFrame(frame);
+
+  LoRaFrameParser<128> parser;
+  Received received;
+  for (int repeat = 0; repeat < 3; repeat++) {
+    for (size_t i = 0; i < length; i++) {
+      parser.push(frame + i, 1);
+      parser.parse(collect, &received);
+    }
+  }
+  TEST_ASSERT_EQUAL(3, received.frames);
+  TEST_ASSERT_EQUAL_UINT32(0, parser.stats.skippedBytes);
+}
+
+void test_cut_off_frame_followed_by_a_new_one() {
+  uint8_t first[LORA_MAX_PACKET_SIZE];
+  uint8_t second[LORA_MAX_PACKET_SIZE];
+  sampleFrame(first);
+  const uint8_t other[3] = {0x00, 0x03, 0x01};
+  size_t secondLength = encodeLoRaFrame(second, LORA_FRAME_ACK, other, sizeof(other));
+
+  // The tail of the first frame was lost on air; the next frame starts right after
+  LoRaFrameParser<128> parser;
+  Received received;
+  parser.push(first, 6);
+  parser.push(second, secondLength);
+  parser.parse(collect, &received);
+  TEST_ASSERT_EQUAL(1, received.frames);
+  TEST_ASSERT_EQUAL_HEX8(LORA_FRAME_ACK, received.type);
+  TEST_ASSERT_EQUAL_UINT8_ARRAY(other, received.payload, sizeof(other));
+  TEST_ASSERT_EQUAL_UINT32(1, parser.stats.crcErrors);
+}
+
+void test_crc_failure_drops_only_the_corrupt_frame() {
+  uint8_t corrupt[LORA_MAX_PACKET_SIZE];
+  uint8_t good[LORA_MAX_PACKET_SIZE];
+  size_t corruptLength = sampleFrame(corrupt);
+  size_t goodLength = sampleFrame(good);
+  corrupt[5] ^= 0x40;
+
+  LoRaFrameParser<128> parser;
+  Received received;
+  parser.push(corrupt, corruptLength);
+  parser.push(good, goodLength);
+  parser.parse(collect, &received);
+  TEST_ASSERT_EQUAL(1, received.frames);
+  TEST_ASSERT_EQUAL_UINT8_ARRAY(PAYLOAD, received.payload, sizeof(PAYLOAD));
+  TEST_ASSERT_EQUAL_UINT32(1, parser.stats.crcErrors);
+  TEST_ASSERT_EQUAL(0, parser.pending());
+}
+
+void test_corrupt_crc_bytes() {
+  uint8_t frame[LORA_MAX_PACKET_SIZE];
+  size_t length = sampleFrame(frame);
+  frame[length - 1] ^= 0x01;
+
+  LoRaFrameParser<128> parser;
+  Received received;
+  parser.push(frame, length);
+  parser.parse(collect, &received);
+  TEST_ASSERT_EQUAL(0, received.frames);
+  TEST_ASSERT_EQUAL_UINT32(1, parser.stats.crcErrors);
+}
+
+void test_full_ring_counts_overflow() {
+  uint8_t frame[LORA_MAX_PACKET_SIZE];
+  size_t length = sampleFrame(frame);
+  const uint8_t noise[40] = {0};
+
+  LoRaFrameParser<32> parser;
+  Received received;
+  parser.push(noise, sizeof(noise));
+  TEST_ASSERT_EQUAL_UINT32(sizeof(noise) - 32, parser.stats.overflows);
+  TEST_ASSERT_EQUAL(32, parser.pending());
+  parser.parse(collect, &received);
+  parser.push(frame, length);
+  parser.parse(collect, &received);
+  TEST_ASSERT_EQUAL(1, received.frames);
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_frame_round_trip);
+  RUN_TEST(test_oversized_payload_is_not_encoded);
+  RUN_TEST(test_resync_after_garbage);
+  RUN_TEST(test_resync_after_false_sync_byte);
+  RUN_TEST(test_bad_length_is_skipped);
+  RUN_TEST(test_truncated_frame_waits_for_the_rest);
+  RUN_TEST(test_byte_at_a_time);
+  RUN_TEST(test_cut_off_frame_followed_by_a_new_one);
+  RUN_TEST(test_crc_failure_drops_only_the_corrupt_frame);
+  RUN_TEST(test_corrupt_crc_bytes);
+  RUN_TEST(test_full_ring_counts_overflow);
+  return UNITY_END();
+}
@@ -0,0 +1,107 @@
+// Gateway node table (lora_node_table.h): per-node totals from counter reports
+#include <unity.h>
+#include "lora_node_table.h"
+
+static CounterReport makeReport(uint16_t address, uint8_t session, uint16_t sequence, int32_t delta) {
+  CounterReport report = {};
+  report.address = address;
+  report.session = session;
+  report.sequence = sequence;
+  report.deltas[0] = delta;
+  return report;
+}
+
+void setUp() {}
+void tearDown() {}
+
+void test_reports_add_up() {
+  LoRaNodeTable<8> table;
+  for (uint16_t seq = 0; seq < 5; seq++) {
+    TEST_ASSERT_EQUAL(LORA_REPORT_APPLIED, table.applyReport(makeReport(0x0002, 0x11, seq, 10), 1000 * seq));
+  }
+  const LoRaNodeEntry *entry = table.find(0x0002);
+  TEST_ASSERT_NOT_NULL(entry);
+  TEST_ASSERT_EQUAL_UINT32(50, entry->counts[0]);
+  TEST_ASSERT_EQUAL_UINT32(5, entry->frames);
+  TEST_ASSERT_EQUAL(1, table.size());
+}
+
+void test_retransmission_is_a_duplicate() {
+  LoRaNodeTable<8> table;
+  table.applyReport(makeReport(0x0002, 0x11, 7, 4), 0);
+  TEST_ASSERT_EQUAL(LORA_REPORT_DUPLICATE, table.applyReport(makeReport(0x0002, 0x11, 7, 4), 100));
+  const LoRaNodeEntry *entry = table.find(0x0002);
+  TEST_ASSERT_EQUAL_UINT32(4, entry->counts[0]);
+  TEST_ASSERT_EQUAL_UINT32(1, entry->duplicates);
+}
+
+void test_late_report_fills_hole() {
+  LoRaNodeTable<8> table;
+  table.applyReport(makeReport(0x0002, 0x11, 0, 5), 0);
+  table.applyReport(makeReport(0x0002, 0x11, 2, 7), 1000);
+  TEST_ASSERT_EQUAL(LORA_REPORT_APPLIED, table.applyReport(makeReport(0x0002, 0x11, 1, 3), 2000));
+  TEST_ASSERT_EQUAL(LORA_REPORT_DUPLICATE, table.applyReport(makeReport(0x0002, 0x11, 1, 3), 3000));
+  TEST_ASSERT_EQUAL(LORA_REPORT_DUPLICATE, table.applyReport(makeReport(0x0002, 0x11, 2, 7), 3000));
+  const LoRaNodeEntry *entry = table.find(0x0002);
+  TEST_ASSERT_EQUAL_UINT32(15, entry->counts[0]);
+  TEST_ASSERT_EQUAL_UINT16(2, entry->lastSequence);
+  TEST_ASSERT_EQUAL_UINT32(2, entry->duplicates);
+}
+
+void test_deduplicated_reports_skip_the_window() {
+  LoRaNodeTable<8> table;
+  // Delivered once each by the reliable layer, the oldest after a full window
+  for (uint16_t seq = 1; seq <= 20; seq++) {
+    table.applyReport(makeReport(0x0002, 0x11, seq, 1), 0, true);
+  }
+  TEST_ASSERT_EQUAL(LORA_REPORT_APPLIED, table.applyReport(makeReport(0x0002, 0x11, 0, 1), 0, true));
+  const LoRaNodeEntry *entry = table.find(0x0002);
+  TEST_ASSERT_EQUAL_UINT32(21, entry->counts[0]);
+  TEST_ASSERT_EQUAL_UINT16(20, entry->lastSequence);
+}
+
+void test_rebooted_node_is_not_dropped() {
+  LoRaNodeTable<8> table;
+  for (uint16_t seq = 0; seq <= 10; seq++) {
+    table.applyReport(makeReport(0x0002, 0x11, seq, 1), 0);
+  }
+  // After a reboot the sequence starts over at 0, inside the old duplicate window
+  for (uint16_t seq = 0; seq < 3; seq++) {
+    TEST_ASSERT_EQUAL(LORA_REPORT_APPLIED, table.applyReport(makeReport(0x0002, 0x22, seq, 1), 1000));
+  }
+  const LoRaNodeEntry *entry = table.find(0x0002);
+  TEST_ASSERT_EQUAL_UINT32(14, entry->counts[0]);
+  TEST_ASSERT_EQUAL_HEX8(0x22, entry->session);
+  TEST_ASSERT_EQUAL_UINT16(2, entry->lastSequence);
+  TEST_ASSERT_EQUAL_UINT32(0, entry->duplicates);
+}
+
+void test_counter_reset_delta() {
+  LoRaNodeTable<8> table;
+  table.applyReport(makeReport(0x0002, 0x11, 0, 1000), 0);
+  // The node counter went from 1000 to 0 and then counted 3
+  table.applyReport(makeReport(0x0002, 0x11, 1, 3 - 1000), 1000);
+  TEST_ASSERT_EQUAL_UINT32(3, table.find(0x0002)->counts[0]);
+}
+
+void test_full_table_rejects_new_nodes() {
+  LoRaNodeTable<4> table;
+  for (uint16_t address = 1; address <= 4; address++) {
+    TEST_ASSERT_EQUAL(LORA_REPORT_APPLIED, table.applyReport(makeReport(address, 0x11, 0, 1), 0));
+  }
+  TEST_ASSERT_EQUAL(LORA_REPORT_TABLE_FULL, table.applyReport(makeReport(5, 0x11, 0, 1), 0));
+  TEST_ASSERT_EQUAL(LORA_REPORT_APPLIED, table.applyReport(makeReport(3, 0x11, 1, 1), 0));
+  TEST_ASSERT_EQUAL(4, table.size());
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_reports_add_up);
+  RUN_TEST(test_retransmission_is_a_duplicate);
+  RUN_TEST(test_late_report_fills_hole);
+  RUN_TEST(test_deduplicated_reports_skip_the_window);
+  RUN_TEST(test_rebooted_node_is_not_dropped);
+  RUN_TEST(test_counter_reset_delta);
+  RUN_TEST(test_full_table_rejects_new_nodes);
+  return UNITY_END();
+}
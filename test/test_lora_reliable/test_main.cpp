@@ -0,0 +1,253 @@
+// Gateway totals through reliable delivery (lora_reliable.h): the node's delta
+// reports, the receiver's window and the node table together must add up to the
+// node's own counts, whatever order frames arrive in.
+#include <string.h>
+#include <unity.h>
+#include "E32Simulator.h"
+#include "lora_node_table.h"
+#include "lora_reliable.h"
+
+const uint16_t NODE_ADDRESS = 0x0002;
+const uint16_t GATEWAY_ADDRESS = 0x0001;
+const uint8_t CHANNEL = 0x17;
+
+struct Captured {
+  uint8_t frame[LORA_MAX_PACKET_SIZE];
+  uint8_t length;
+};
+
+void setUp() {}
+void tearDown() {}
+
+// Queue one report per delta and collect the frames the first poll sends
+static size_t sendReports(LoRaReliableSender<4> &sender, const int32_t *deltas, size_t count, Captured *out) {
+  for (size_t i = 0; i < count; i++) {
+    CounterReport report = {};
+    report.address = NODE_ADDRESS;
+    report.session = 0x11;
+    report.sequence = (uint16_t)i;
+    report.deltas[0] = deltas[i];
+    uint8_t payload[LORA_REPORT_MAX_SIZE];
+    TEST_ASSERT_TRUE(sender.queue(LORA_FRAME_COUNTER_REPORT, payload, packCounterReport(payload, report), 0));
+  }
+  size_t sent = 0;
+  sender.poll(0, [&](const uint8_t *frame, uint8_t length) {
+    memcpy(out[sent].frame, frame, length);
+    out[sent++].length = length;
+    return true;
+  });
+  return sent;
+}
+
+// What handleReliableFrame and handleCounterReportFrame do on the gateway
+static void deliver(LoRaReliableReceiver<8> &receiver, LoRaNodeTable<8> &table, const Captured &captured) {
+  uint8_t innerType;
+  const uint8_t *inner;
+  uint8_t innerLength;
+  LoRaAck ack;
+  if (receiver.accept(captured.frame + 3, captured.frame[2], GATEWAY_ADDRESS, &innerType, &inner, &innerLength,
+                      &ack) != LORA_RELIABLE_NEW) {
+    return;
+  }
+  CounterReport report;
+  TEST_ASSERT_TRUE(unpackCounterReport(inner, innerLength, &report));
+  table.applyReport(report, 0, true);
+}
+
+void test_selective_retransmission_fills_hole() {
+  LoRaReliableSender<4> sender(NODE_ADDRESS, 0x11, {1000, 60000, 6});
+  LoRaReliableReceiver<8> receiver;
+  LoRaNodeTable<8> table;
+  const int32_t deltas[3] = {5, 3, 7};
+  Captured frames[3];
+  TEST_ASSERT_EQUAL(3, sendReports(sender, deltas, 3, frames));
+  // Sequence 1 was lost and comes back after the SACK showed the hole
+  deliver(receiver, table, frames[0]);
+  deliver(receiver, table, frames[2]);
+  deliver(receiver, table, frames[1]);
+  deliver(receiver, table, frames[1]);  // Retransmission whose ACK was lost
+  TEST_ASSERT_EQUAL_UINT32(15, table.find(NODE_ADDRESS)->counts[0]);
+}
+
+void test_dropped_report_is_folded_into_the_next() {
+  LoRaReliableSender<4> sender(NODE_ADDRESS, 0x11, {1000, 60000, 2});
+  CounterReportBase base;
+  uint32_t counts[LORA_REPORT_COUNTERS] = {40, 0, 0, 2};
+  CounterReport report = {};
+  TEST_ASSERT_TRUE(base.diff(counts, 0x0101, &report));
+  uint8_t payload[LORA_REPORT_MAX_SIZE];
+  TEST_ASSERT_TRUE(sender.queue(LORA_FRAME_COUNTER_REPORT, payload, packCounterReport(payload, report), 0));
+  base.commit(counts, 0x0101);
+
+  size_t droppedCount = 0;
+  auto send = [](const uint8_t *, uint8_t) { return true; };  // Never acknowledged
+  auto dropped = [&](uint8_t type, const uint8_t *inner, uint8_t length) {
+    CounterReport lost;
+    TEST_ASSERT_EQUAL_UINT8(LORA_FRAME_COUNTER_REPORT, type);
+    TEST_ASSERT_TRUE(unpackCounterReport(inner, length, &lost));
+    base.fold(lost);
+    droppedCount++;
+  };
+  for (uint32_t now = 0; now <= 10000; now += 100) {
+    sender.poll(now, send, dropped);
+  }
+  TEST_ASSERT_EQUAL(1, droppedCount);
+  TEST_ASSERT_EQUAL_UINT32(1, sender.stats.dropped);
+
+  counts[0] = 45;
+  TEST_ASSERT_TRUE(base.diff(counts, 0x0101, &report));
+  TEST_ASSERT_EQUAL_INT32(45, report.deltas[0]);
+  TEST_ASSERT_EQUAL_INT32(2, report.deltas[3]);
+  TEST_ASSERT_TRUE(report.hasIo);  // The I/O state went out with the lost report
+}
+
+// Switch a module to fixed transmission at 2.4k air rate with the given address
+static void configure(E32SimAir &air, E32SimModule &module, uint16_t address) {
+  module.setMode(3);
+  module.setHostBaud(9600);
+  air.advance(60000);
+  const uint8_t command[6] = {0xC0, (uint8_t)(address >> 8), (uint8_t)(address & 0xFF), 0x1A, CHANNEL, 0xC4};
+  module.write(command, sizeof(command));
+  air.advance(200000);
+  while (module.available() > 0) {
+    module.read();
+  }
+  module.setMode(0);
+  air.advance(60000);
+}
+
+static void sendFixed(E32SimModule &module, uint16_t target, const uint8_t *frame, size_t length) {
+  const uint8_t header[3] = {(uint8_t)(target >> 8), (uint8_t)(target & 0xFF), CHANNEL};
+  module.write(header, sizeof(header));
+  module.write(frame, length);
+}
+
+struct Gateway {
+  LoRaReliableReceiver<8> receiver;
+  LoRaNodeTable<8> table;
+  bool ackPending = false;
+  LoRaAck ack;
+  uint64_t lastFrameUs = 0;
+};
+
+static uint64_t simNowUs;
+
+static void onGatewayFrame(uint8_t type, const uint8_t *payload, uint8_t length, void *context) {
+  Gateway *gateway = (Gateway *)context;
+  uint8_t innerType;
+  const uint8_t *inner;
+  uint8_t innerLength;
+  LoRaAck ack;
+  if (type != LORA_FRAME_RELIABLE) {
+    return;
+  }
+  LoRaReliableResult result = gateway->receiver.accept(payload, length, GATEWAY_ADDRESS, &innerType, &inner,
+                                                        &innerLength, &ack);
+  if (result == LORA_RELIABLE_REJECTED) {
+    return;
+  }
+  CounterReport report;
+  if (result == LORA_RELIABLE_NEW && unpackCounterReport(inner, innerLength, &report)) {
+    gateway->table.applyReport(report, (uint32_t)(simNowUs / 1000), true);
+  }
+  gateway->ack = ack;
+  gateway->ackPending = true;
+  gateway->lastFrameUs = simNowUs;
+}
+
+static void onNodeFrame(uint8_t type, const uint8_t *payload, uint8_t length, void *context) {
+  LoRaReliableSender<4> *sender = (LoRaReliableSender<4> *)context;
+  LoRaAck ack;
+  if (type == LORA_FRAME_ACK && unpackLoRaAck(payload, length, &ack)) {
+    sender->onAck(ack, (uint32_t)(simNowUs / 1000));
+  }
+}
+
+static void drain(E32SimModule &module, LoRaFrameParser<256> &parser, LoRaFrameParser<256>::Handler handler,
+                  void *context) {
+  uint8_t chunk[64];
+  while (module.available() > 0) {
+    size_t n = module.readBytes(chunk, sizeof(chunk));
+    parser.push(chunk, n);
+  }
+  parser.parse(handler, context);
+}
+
+void test_totals_match_over_lossy_link() {
+  E32SimAir air(7);
+  E32SimModule nodeModule(air, "node");
+  E32SimModule gatewayModule(air, "gateway");
+  configure(air, nodeModule, NODE_ADDRESS);
+  configure(air, gatewayModule, GATEWAY_ADDRESS);
+  air.setLossRate(0.2);
+
+  // Firmware defaults: LORA_RELIABLE_WINDOW, LORA_RETRY_*, LORA_REPORT_INTERVAL
+  LoRaReliableSender<4> sender(NODE_ADDRESS, 0x5A, {1000, 60000, 6});
+  LoRaFrameParser<256> nodeParser;
+  LoRaFrameParser<256> gatewayParser;
+  Gateway gateway;
+  CounterReportBase base;
+  uint32_t counts[LORA_REPORT_COUNTERS] = {};
+  uint16_t sequence = 0;
+  const uint64_t ackDelayUs = (estimateAirTimeMs(0x02, 1, LORA_AIR_MAX_BYTES) + 20) * 1000ULL;
+
+  const uint64_t start = air.now();
+  uint64_t lastReport = start;
+  while (air.now() - start < 1800ULL * 1000000) {
+    simNowUs = air.now();
+    uint32_t nowMs = (uint32_t)(simNowUs / 1000);
+    bool counting = air.now() - start < 1200ULL * 1000000;  // Last 10 minutes drain the link
+    if (counting && (air.now() - start) % 1000000 == 0) {
+      counts[0] += 3;
+      counts[2] += 1;
+    }
+    if (air.now() - lastReport >= 30000000) {
+      lastReport = air.now();
+      CounterReport report;
+      report.address = NODE_ADDRESS;
+      report.session = sender.session();
+      report.sequence = sequence;
+      uint8_t payload[LORA_REPORT_MAX_SIZE];
+      if (base.diff(counts, 0, &report) &&
+          sender.queue(LORA_FRAME_COUNTER_REPORT, payload, packCounterReport(payload, report), nowMs)) {
+        base.commit(counts, 0);
+        sequence++;
+      }
+    }
+    sender.poll(nowMs, [&](const uint8_t *frame, uint8_t length) {
+      if (!nodeModule.aux()) {
+        return false;
+      }
+      sendFixed(nodeModule, GATEWAY_ADDRESS, frame, length);
+      return true;
+    }, [&](uint8_t type, const uint8_t *inner, uint8_t length) {
+      CounterReport lost;
+      if (type == LORA_FRAME_COUNTER_REPORT && unpackCounterReport(inner, length, &lost)) {
+        base.fold(lost);
+      }
+    });
+    air.advance(1000);
+    drain(gatewayModule, gatewayParser, onGatewayFrame, &gateway);
+    drain(nodeModule, nodeParser, onNodeFrame, &sender);
+    if (gateway.ackPending && air.now() - gateway.lastFrameUs >= ackDelayUs) {
+      uint8_t body[LORA_ACK_SIZE];
+      uint8_t frame[LORA_MAX_PACKET_SIZE];
+      sendFixed(gatewayModule, NODE_ADDRESS, frame,
+                encodeLoRaFrame(frame, LORA_FRAME_ACK, body, packLoRaAck(body, gateway.ack)));
+      gateway.ackPending = false;
+    }
+  }
+  const LoRaNodeEntry *entry = gateway.table.find(NODE_ADDRESS);
+  TEST_ASSERT_NOT_NULL(entry);
+  TEST_ASSERT_GREATER_THAN(0, sender.stats.retransmissions);
+  TEST_ASSERT_EQUAL_UINT32(counts[0], entry->counts[0]);
+  TEST_ASSERT_EQUAL_UINT32(counts[2], entry->counts[2]);
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_selective_retransmission_fills_hole);
+  RUN_TEST(test_dropped_report_is_folded_into_the_next);
+  RUN_TEST(test_totals_match_over_lossy_link);
+  return UNITY_END();
+}
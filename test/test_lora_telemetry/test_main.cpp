@@ -0,0 +1,139 @@
+// Counter report encoding (lora_telemetry.h): zigzag LEB128 deltas, the
+// changed-counter mask and the optional I/O state
+#include <unity.h>
+#include <limits.h>
+#include "lora_telemetry.h"
+
+void setUp() {}
+void tearDown() {}
+
+void test_zigzag_round_trip() {
+  const int32_t values[] = {0, 1, -1, 2, -2, 63, -64, 1000, -1000, INT32_MAX, INT32_MIN};
+  for (int32_t value : values) {
+    TEST_ASSERT_EQUAL_INT32(value, zigzagDecode(zigzagEncode(value)));
+  }
+  TEST_ASSERT_EQUAL_UINT32(0, zigzagEncode(0));
+  TEST_ASSERT_EQUAL_UINT32(1, zigzagEncode(-1));
+  TEST_ASSERT_EQUAL_UINT32(2, zigzagEncode(1));
+  TEST_ASSERT_EQUAL_UINT32(3, zigzagEncode(-2));
+  TEST_ASSERT_EQUAL_UINT32(UINT32_MAX, zigzagEncode(INT32_MIN));
+}
+
+void test_varint_sizes_and_round_trip() {
+  const struct {
+    uint32_t value;
+    size_t bytes;
+  } cases[] = {{0, 1}, {127, 1}, {128, 2}, {16383, 2}, {16384, 3}, {2097151, 3}, {2097152, 4}, {UINT32_MAX, 5}};
+  for (const auto &c : cases) {
+    uint8_t buffer[5];
+    TEST_ASSERT_EQUAL(c.bytes, writeVarint(buffer, c.value));
+    uint32_t decoded = 0;
+    TEST_ASSERT_EQUAL(c.bytes, readVarint(buffer, c.bytes, &decoded));
+    TEST_ASSERT_EQUAL_UINT32(c.value, decoded);
+  }
+}
+
+void test_varint_rejects_truncated_and_overlong_input() {
+  uint8_t buffer[5];
+  size_t length = writeVarint(buffer, 300000);
+  uint32_t value;
+  TEST_ASSERT_EQUAL(0, readVarint(buffer, length - 1, &value));
+  const uint8_t overlong[6] = {0x80, 0x80, 0x80, 0x80, 0x80, 0x01};
+  TEST_ASSERT_EQUAL(0, readVarint(overlong, sizeof(overlong), &value));
+}
+
+void test_report_round_trip() {
+  CounterReport report = {};
+  report.address = 0x1234;
+  report.session = 0xA7;
+  report.sequence = 0xBEEF;
+  report.deltas[0] = 5;
+  report.deltas[2] = -3;
+  report.hasIo = true;
+  report.ioState = 0x0305;
+
+  uint8_t buffer[LORA_REPORT_MAX_SIZE];
+  size_t length = packCounterReport(buffer, report);
+  TEST_ASSERT_EQUAL(LORA_REPORT_HEADER_SIZE + 2 + 2, length);
+  TEST_ASSERT_EQUAL_HEX8(LORA_REPORT_FLAG_IO | 0x05, buffer[5]);
+
+  CounterReport decoded;
+  TEST_ASSERT_TRUE(unpackCounterReport(buffer, length, &decoded));
+  TEST_ASSERT_EQUAL_HEX16(0x1234, decoded.address);
+  TEST_ASSERT_EQUAL_HEX8(0xA7, decoded.session);
+  TEST_ASSERT_EQUAL_HEX16(0xBEEF, decoded.sequence);
+  TEST_ASSERT_EQUAL_INT32(5, decoded.deltas[0]);
+  TEST_ASSERT_EQUAL_INT32(0, decoded.deltas[1]);
+  TEST_ASSERT_EQUAL_INT32(-3, decoded.deltas[2]);
+  TEST_ASSERT_EQUAL_INT32(0, decoded.deltas[3]);
+  TEST_ASSERT_TRUE(decoded.hasIo);
+  TEST_ASSERT_EQUAL_HEX16(0x0305, decoded.ioState);
+}
+
+void test_unchanged_report_is_header_only() {
+  CounterReport report = {};
+  report.address = 0x0002;
+  uint8_t buffer[LORA_REPORT_MAX_SIZE];
+  size_t length = packCounterReport(buffer, report);
+  TEST_ASSERT_EQUAL(LORA_REPORT_HEADER_SIZE, length);
+  TEST_ASSERT_EQUAL_HEX8(0x00, buffer[5]);
+
+  CounterReport decoded;
+  TEST_ASSERT_TRUE(unpackCounterReport(buffer, length, &decoded));
+  TEST_ASSERT_FALSE(decoded.hasIo);
+  for (int i = 0; i < LORA_REPORT_COUNTERS; i++) {
+    TEST_ASSERT_EQUAL_INT32(0, decoded.deltas[i]);
+  }
+}
+
+void test_worst_case_report_fits() {
+  CounterReport report = {};
+  for (int i = 0; i < LORA_REPORT_COUNTERS; i++) {
+    report.deltas[i] = INT32_MIN;
+  }
+  report.hasIo = true;
+  uint8_t buffer[LORA_REPORT_MAX_SIZE];
+  TEST_ASSERT_EQUAL(LORA_REPORT_MAX_SIZE, packCounterReport(buffer, report));
+  TEST_ASSERT_LESS_OR_EQUAL(LORA_MAX_PACKET_SIZE, LORA_REPORT_MAX_SIZE);
+}
+
+void test_truncated_report_is_rejected() {
+  CounterReport report = {};
+  report.deltas[1] = 200000;
+  report.hasIo = true;
+  report.ioState = 0x00FF;
+  uint8_t buffer[LORA_REPORT_MAX_SIZE];
+  size_t length = packCounterReport(buffer, report);
+  CounterReport decoded;
+  for (size_t cut = 0; cut < length; cut++) {
+    TEST_ASSERT_FALSE(unpackCounterReport(buffer, cut, &decoded));
+  }
+  TEST_ASSERT_TRUE(unpackCounterReport(buffer, length, &decoded));
+}
+
+void test_counter_reset_costs_the_old_count() {
+  // 100000 -> 0: the delta is -100000, which needs three bytes, not one
+  CounterReport report = {};
+  report.deltas[0] = (int32_t)(0u - 100000u);
+  uint8_t buffer[LORA_REPORT_MAX_SIZE];
+  TEST_ASSERT_EQUAL(LORA_REPORT_HEADER_SIZE + 3, packCounterReport(buffer, report));
+
+  CounterReport decoded;
+  TEST_ASSERT_TRUE(unpackCounterReport(buffer, LORA_REPORT_HEADER_SIZE + 3, &decoded));
+  uint32_t total = 100000;
+  total += (uint32_t)decoded.deltas[0];
+  TEST_ASSERT_EQUAL_UINT32(0, total);
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_zigzag_round_trip);
+  RUN_TEST(test_varint_sizes_and_round_trip);
+  RUN_TEST(test_varint_rejects_truncated_and_overlong_input);
+  RUN_TEST(test_report_round_trip);
+  RUN_TEST(test_unchanged_report_is_header_only);
+  RUN_TEST(test_worst_case_report_fits);
+  RUN_TEST(test_truncated_report_is_rejected);
+  RUN_TEST(test_counter_reset_costs_the_old_count);
+  return UNITY_END();
+}